@@ -24,10 +24,41 @@ BytePermutation<128> Transposition128bytesBy8() {
 
 #if UCFG_CPU_X86_X64
 
-void Transpose16x8bytes(__m128i to[8], __m128i from[8])
-{
+static void Transpose8x8words(__m128i to[8], const __m128i a[8]) {
+	__m128i b0 = _mm_unpacklo_epi16(a[0], a[1]), b1 = _mm_unpackhi_epi16(a[0], a[1]),
+		b2 = _mm_unpacklo_epi16(a[2], a[3]), b3 = _mm_unpackhi_epi16(a[2], a[3]),
+		b4 = _mm_unpacklo_epi16(a[4], a[5]), b5 = _mm_unpackhi_epi16(a[4], a[5]),
+		b6 = _mm_unpacklo_epi16(a[6], a[7]), b7 = _mm_unpackhi_epi16(a[6], a[7]);
+	__m128i c0 = _mm_unpacklo_epi32(b0, b2), c1 = _mm_unpackhi_epi32(b0, b2),
+		c2 = _mm_unpacklo_epi32(b1, b3), c3 = _mm_unpackhi_epi32(b1, b3),
+		c4 = _mm_unpacklo_epi32(b4, b6), c5 = _mm_unpackhi_epi32(b4, b6),
+		c6 = _mm_unpacklo_epi32(b5, b7), c7 = _mm_unpackhi_epi32(b5, b7);
+	to[0] = _mm_unpacklo_epi64(c0, c4);
+	to[1] = _mm_unpackhi_epi64(c0, c4);
+	to[2] = _mm_unpacklo_epi64(c1, c5);
+	to[3] = _mm_unpackhi_epi64(c1, c5);
+	to[4] = _mm_unpacklo_epi64(c2, c6);
+	to[5] = _mm_unpackhi_epi64(c2, c6);
+	to[6] = _mm_unpacklo_epi64(c3, c7);
+	to[7] = _mm_unpackhi_epi64(c3, c7);
+}
 
+// SSSE3 equivalent of Transposition128bytesBy8().Apply(). from[] may be unaligned
+void Transpose16x8bytes(__m128i to[8], const __m128i from[8]) {
+	const __m128i interleave = _mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+	__m128i a[8];
+	for (int i = 0; i < 8; ++i)
+		a[i] = _mm_shuffle_epi8(_mm_loadu_si128(from + i), interleave);
+	Transpose8x8words(to, a);
+}
 
+// Inverse of Transpose16x8bytes(). to[] may be unaligned
+void Transpose8x16bytes(__m128i to[8], const __m128i from[8]) {
+	const __m128i deinterleave = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	__m128i a[8];
+	Transpose8x8words(a, from);
+	for (int i = 0; i < 8; ++i)
+		_mm_storeu_si128(to + i, _mm_shuffle_epi8(a[i], deinterleave));
 }
 
 
@@ -54,7 +54,8 @@ BytePermutation<128> Transposition128bytesBy8();
 
 #if UCFG_CPU_X86_X64
 
-void Transpose16x8bytes(__m128i to[8], __m128i from[8]);
+void Transpose16x8bytes(__m128i to[8], const __m128i from[8]);
+void Transpose8x16bytes(__m128i to[8], const __m128i from[8]);
 
 
 #endif // UCFG_CPU_X86_X64
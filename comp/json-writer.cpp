@@ -25,13 +25,9 @@ String JsonEscapeString(RCString s) {
 			v.push_back(ch);
 			break;
 		default:
-			if (ch < 20) {
-				v.push_back('\\');
-				v.push_back('u');
-				v.push_back('0');
-				v.push_back('0');
+			if (unsigned(ch) < 0x20) {
 				ostringstream os;
-				os << "\\u" << setw(4) << setfill('0') << int(ch);
+				os << "\\u" << setw(4) << setfill('0') << hex << int(ch);
 				string str = os.str();
 				v.insert(v.end(), str.begin(), str.end());
 			} else
@@ -51,12 +47,14 @@ JsonTextWriter::JsonTextWriter(std::ostream& os)
 
 void JsonTextWriter::CommonInit() {
 	IndentChar = '\t';
-	Indentation = 1;
+	Indentation = 0;
 }
 
 void JsonTextWriter::WriteIndent() {
 	if (!exchange(FirstItem, false))
-		m_os << ",\n" << string(Indentation, IndentChar);
+		m_os << ",";
+	if (Indentation)
+		m_os << "\n" << string(Indentation, IndentChar);
 }
 
 void JsonTextWriter::Close() {
@@ -80,7 +78,7 @@ void JsonTextWriter::Write(RCString val) {
 
 void JsonTextWriter::Write(bool val) {
 	WriteIndent();
-	m_os << val;
+	m_os << (val ? "true" : "false");
 }
 
 void JsonTextWriter::Write(nullptr_t) {
@@ -100,51 +98,55 @@ void JsonTextWriter::Write(RCString name, double val) {
 
 void JsonTextWriter::Write(RCString name, RCString val) {
 	WriteIndent();
-	m_os << "\"" << JsonEscapeString(name) << "\": \"" << JsonEscapeString(name) << "\"";
+	m_os << "\"" << JsonEscapeString(name) << "\": \"" << JsonEscapeString(val) << "\"";
 }
 
 void JsonTextWriter::Write(RCString name, bool val) {
 	WriteIndent();
-	m_os << "\"" << JsonEscapeString(name) << "\": " << val;
+	m_os << "\"" << JsonEscapeString(name) << "\": " << (val ? "true" : "false");
 }
 
 void JsonTextWriter::Write(RCString name, nullptr_t) {
+	WriteIndent();
 	m_os << "\"" << JsonEscapeString(name) << "\": null";
 }
 
+// Items are separated by ",\n" + indent; a closed object/array is an item of its parent, so the next sibling gets the comma
 JsonWriterObject::JsonWriterObject(JsonTextWriter& writer, RCString name)
 	:	Writer(writer)
 {
-	Writer.Indentation++;
 	Writer.WriteIndent();
 	if (name != nullptr)
 		Writer.m_os << "\"" << JsonEscapeString(name) << "\": ";
-	Writer.m_os << "{\n";
+	Writer.m_os << "{";
+	Writer.Indentation++;
 	Writer.FirstItem = true;
 	m_prevMode = exchange(Writer.Mode, JsonMode::Object);
 }
 
 JsonWriterObject::~JsonWriterObject() {
 	Writer.Indentation--;
-	Writer.m_os << ",\n" << string(Writer.Indentation, Writer.IndentChar) << "}";
+	Writer.m_os << "\n" << string(Writer.Indentation, Writer.IndentChar) << "}";
+	Writer.FirstItem = false;
 	Writer.Mode = m_prevMode;
 }
 
 JsonWriterArray::JsonWriterArray(JsonTextWriter& writer, RCString name)
 	: Writer(writer)
 {
-	Writer.Indentation++;
 	Writer.WriteIndent();
 	if (name != nullptr)
 		Writer.m_os << "\"" << JsonEscapeString(name) << "\": ";
-	Writer.m_os << "[\n";
+	Writer.m_os << "[";
+	Writer.Indentation++;
 	Writer.FirstItem = true;
-	m_prevMode = exchange(Writer.Mode, JsonMode::Object);
+	m_prevMode = exchange(Writer.Mode, JsonMode::Array);
 }
 
 JsonWriterArray::~JsonWriterArray() {
 	Writer.Indentation--;
-	Writer.m_os << ",\n" << string(Writer.Indentation, Writer.IndentChar) << "]";
+	Writer.m_os << "\n" << string(Writer.Indentation, Writer.IndentChar) << "]";
+	Writer.FirstItem = false;
 	Writer.Mode = m_prevMode;
 }
 
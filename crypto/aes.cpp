@@ -138,6 +138,7 @@ InvExpandedKey::InvExpandedKey(RCSpan key, int ekeylen, int nb)
 
 Aes::Aes() {
 	Rounds = 14;
+	m_sched.Rounds = 0;
 	BlockSize = 128;
 	InitAesTables();
 }
@@ -200,7 +201,7 @@ public:
 	operator EVP_CIPHER_CTX* () { return m_ctx; }
 };
 
-#else
+#endif // UCFG_USE_OPENSSL
 
 Blob Aes::CalcExpandedKey() const {
 	Blob r(0, BlockSize/8*(Rounds+1));
@@ -220,9 +221,6 @@ Blob Aes::CalcInvExpandedKey() const {
 	return r;
 }
 
-
-#endif // UCFG_USE_OPENSSL
-
 pair<Blob, Blob> Aes::GetKeyAndIVFromPassword(RCString password, const uint8_t salt[8], int nRounds) {
 	pair<Blob, Blob> r(Blob(0, 32), Blob(0, 16));
 	const unsigned char *psz = (const unsigned char*)(const char*)password;
@@ -233,47 +231,503 @@ pair<Blob, Blob> Aes::GetKeyAndIVFromPassword(RCString password, const uint8_t s
 		Throw(E_FAIL);
 #else
 	SHA512 sha;
+	HashAlgorithm& halgo = sha;
 	Blob data = Span(psz, strlen(password)) + Span(salt, 8);
-	while (nRounds--)
-		data = Span(sha.ComputeHash(data));
+	if (nRounds--) {
+		DECLSPEC_ALIGN(32) uint64_t block[16], buf[64], h[16];		// after the first round the message is one 64-byte digest: a single padded block on the raw state
+		memset(block, 0, sizeof block);
+		memcpy(block, sha.ComputeHash(data).constData(), 64);
+		((uint8_t*)block)[64] = 0x80;
+		block[15] = htobe(uint64_t(64 * 8));
+		while (nRounds--) {
+			memcpy(buf, block, sizeof block);
+			halgo.InitHash(h);
+			halgo.PrepareEndiannessAndHashBlock(h, (uint8_t*)buf, 64 * 8);
+			halgo.OutTransform(h);
+			halgo.PrepareEndianness(h, 8);
+			memcpy(block, h, 64);
+		}
+		data = Span((const uint8_t*)block, 64);
+	}
 	memcpy(r.first.data(), data.constData(), r.first.size());
 	memcpy(r.second.data(), data.constData()+r.first.size(), r.second.size());
 #endif
 	return r;
 }
 
-#if UCFG_USE_OPENSSL
+static const size_t AES_CHUNK_BLOCKS = 16;		// blocks per pipelined batch
+
+#if UCFG_CPU_X86_X64
+
+static bool s_bHasAesNi = CpuInfo().Features.AES && CpuInfo().Features.SSSE3,
+	s_bHasVaes = s_bHasAesNi && CpuInfo().Features.AVX512F && CpuInfo().Features.VAES,
+	s_bHasPclmul = CpuInfo().Features.PCLMULQDQ && CpuInfo().Features.SSSE3;
+
+static CpuDispatch::Registration
+	s_regAes("AES", s_bHasVaes ? "avx512-vaes" : s_bHasAesNi ? "aes-ni" : "generic"),
+	s_regGhash("GHASH", s_bHasPclmul ? "pclmulqdq" : "generic");
+
+template <bool bDec, int N> static __forceinline void AesNiRounds(const __m128i *k, int rounds, __m128i *b) {
+	for (int j = 0; j < N; ++j)
+		b[j] = _mm_xor_si128(b[j], k[0]);
+	for (int i = 1; i < rounds; ++i)
+		for (int j = 0; j < N; ++j)
+			b[j] = bDec ? _mm_aesdec_si128(b[j], k[i]) : _mm_aesenc_si128(b[j], k[i]);
+	for (int j = 0; j < N; ++j)
+		b[j] = bDec ? _mm_aesdeclast_si128(b[j], k[rounds]) : _mm_aesenclast_si128(b[j], k[rounds]);
+}
+
+template <bool bDec> static __forceinline void VaesRounds(const __m512i *k, int rounds, __m512i b[4]) {
+	for (int j = 0; j < 4; ++j)
+		b[j] = _mm512_xor_si512(b[j], k[0]);
+	for (int i = 1; i < rounds; ++i)
+		for (int j = 0; j < 4; ++j)
+			b[j] = bDec ? _mm512_aesdec_epi128(b[j], k[i]) : _mm512_aesenc_epi128(b[j], k[i]);
+	for (int j = 0; j < 4; ++j)
+		b[j] = bDec ? _mm512_aesdeclast_epi128(b[j], k[rounds]) : _mm512_aesenclast_epi128(b[j], k[rounds]);
+}
+
+// ECB over n blocks: 16 blocks per iteration with VAES, 8 with AES-NI to hide the aesenc latency
+template <bool bDec> static void AesNiCryptBlocks(const uint8_t (*keys)[16], int rounds, const uint8_t *src, uint8_t *dst, size_t n) {
+	const __m128i *k = (const __m128i*)keys;
+	size_t i = 0;
+	if (s_bHasVaes && n >= 16) {
+		__m512i kk[15];
+		for (int r = 0; r <= rounds; ++r)
+			kk[r] = _mm512_broadcast_i32x4(k[r]);
+		for (; i + 16 <= n; i += 16) {
+			__m512i b[4];
+			for (int j = 0; j < 4; ++j)
+				b[j] = _mm512_loadu_si512(src + (i + j * 4) * 16);
+			VaesRounds<bDec>(kk, rounds, b);
+			for (int j = 0; j < 4; ++j)
+				_mm512_storeu_si512(dst + (i + j * 4) * 16, b[j]);
+		}
+	}
+	for (; i + 8 <= n; i += 8) {
+		__m128i b[8];
+		for (int j = 0; j < 8; ++j)
+			b[j] = _mm_loadu_si128((const __m128i*)(src + (i + j) * 16));
+		AesNiRounds<bDec, 8>(k, rounds, b);
+		for (int j = 0; j < 8; ++j)
+			_mm_storeu_si128((__m128i*)(dst + (i + j) * 16), b[j]);
+	}
+	for (; i < n; ++i) {
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 16));
+		AesNiRounds<bDec, 1>(k, rounds, &b);
+		_mm_storeu_si128((__m128i*)(dst + i * 16), b);
+	}
+}
+
+#endif // UCFG_CPU_X86_X64
+
+void Aes::put_Key(RCSpan key) {
+	base::put_Key(key);
+	if (BlockSize == 128)
+		PrepareKey();
+}
+
+void Aes::PrepareKey() {
+	InitParams();
+	m_sched.EKey = CalcExpandedKey();
+	m_sched.InvEKey = CalcInvExpandedKey();
+	m_sched.Rounds = Rounds;
+	memcpy(m_sched.Enc, m_sched.EKey.constData(), m_sched.EKey.size());
+#if UCFG_CPU_X86_X64
+	if (s_bHasAesNi) {
+		__m128i *enc = (__m128i*)m_sched.Enc, *dec = (__m128i*)m_sched.Dec;
+		dec[0] = enc[Rounds];
+		for (int i = 1; i < Rounds; ++i)
+			dec[i] = _mm_aesimc_si128(enc[Rounds - i]);
+		dec[Rounds] = enc[0];
+	}
+#endif
+}
+
+void Aes::CheckKey() const {
+	if (BlockSize != 128)
+		Throw(E_NOTIMPL);
+	if (!m_sched.Rounds || m_key.size() != KeySize / 8)
+		Throw(errc::invalid_argument);
+}
+
+void Aes::EncryptBlocks(const uint8_t *src, uint8_t *dst, size_t n) {
+#if UCFG_CPU_X86_X64
+	if (s_bHasAesNi)
+		return AesNiCryptBlocks<false>(m_sched.Enc, m_sched.Rounds, src, dst, n);
+#endif
+	for (size_t i = 0; i < n; ++i) {
+		if (dst != src)
+			memcpy(dst + i * 16, src + i * 16, 16);
+		EncryptBlock(m_sched.EKey, dst + i * 16);
+	}
+}
+
+void Aes::DecryptBlocks(const uint8_t *src, uint8_t *dst, size_t n) {
+#if UCFG_CPU_X86_X64
+	if (s_bHasAesNi)
+		return AesNiCryptBlocks<true>(m_sched.Dec, m_sched.Rounds, src, dst, n);
+#endif
+	for (size_t i = 0; i < n; ++i) {
+		if (dst != src)
+			memcpy(dst + i * 16, src + i * 16, 16);
+		DecryptBlock(m_sched.InvEKey, dst + i * 16);
+	}
+}
+
+// Big-endian counter in ctr[], incremented over all 128 bits or over the low 32 bits (GCM)
+void Aes::CtrCrypt(uint8_t ctr[16], const uint8_t *src, uint8_t *dst, size_t size, bool bInc32) {
+	uint8_t ks[AES_CHUNK_BLOCKS * 16];
+	uint64_t hi = GetBeUInt64(ctr), lo = GetBeUInt64(ctr + 8);
+	while (size) {
+		size_t cb = (min)(size, sizeof ks), n = (cb + 15) / 16;
+		for (size_t i = 0; i < n; ++i) {
+			*(uint64_t*)(ks + i * 16) = htobe(hi);
+			*(uint64_t*)(ks + i * 16 + 8) = htobe(lo);
+			if (bInc32)
+				lo = (lo & 0xFFFFFFFF00000000ULL) | uint32_t(lo + 1);
+			else if (!++lo)
+				++hi;
+		}
+		EncryptBlocks(ks, ks, n);
+		if (dst != src)
+			memcpy(dst, src, cb);
+		VectorXor(dst, ks, cb);
+		src += cb;
+		dst += cb;
+		size -= cb;
+	}
+	*(uint64_t*)ctr = htobe(hi);
+	*(uint64_t*)(ctr + 8) = htobe(lo);
+}
+
+// Keystream XOR of OFB and CTR, the same in both directions
+void Aes::StreamCrypt(RCSpan cbuf, uint8_t *dst) {
+	const size_t cbBlock = 16;
+	if (IV.size() != cbBlock)
+		Throw(errc::invalid_argument);
+	uint8_t iv[cbBlock];
+	memcpy(iv, IV.constData(), cbBlock);
+	const uint8_t *src = cbuf.data();
+	if (Mode == CipherMode::CTR)
+		return CtrCrypt(iv, src, dst, cbuf.size());
+	for (size_t pos = 0; pos < cbuf.size(); pos += cbBlock) {
+		size_t cb = (min)(cbBlock, cbuf.size() - pos);
+		EncryptBlocks(iv, iv, 1);
+		for (size_t j = 0; j < cb; ++j)
+			dst[pos + j] = src[pos + j] ^ iv[j];
+	}
+}
+
+size_t Aes::Encrypt(RCSpan cbuf, uint8_t *dst) {
+	CheckKey();
+	if (Mode == CipherMode::OFB || Mode == CipherMode::CTR) {
+		StreamCrypt(cbuf, dst);
+		return cbuf.size();
+	}
+	const size_t cbBlock = 16;
+	const uint8_t *src = cbuf.data();
+	uint8_t iv[cbBlock];
+	if (Mode != CipherMode::ECB) {
+		if (IV.size() != cbBlock)
+			Throw(errc::invalid_argument);
+		memcpy(iv, IV.constData(), cbBlock);
+	}
+	size_t n = cbuf.size() / cbBlock, rem = cbuf.size() % cbBlock;
+	if (Padding == PaddingMode::None && rem)
+		Throw(errc::invalid_argument);
+	bool bLast = rem || Padding == PaddingMode::PKCS7;
+	uint8_t last[cbBlock];
+	if (bLast) {
+		memcpy(last, src + n * cbBlock, rem);
+		Pad(last, cbBlock - rem);
+	}
+	size_t nAll = n + bLast;
+	switch (Mode) {
+	case CipherMode::ECB:
+		EncryptBlocks(src, dst, n);
+		if (bLast)
+			EncryptBlocks(last, dst + n * cbBlock, 1);
+		break;
+	case CipherMode::CBC:
+	case CipherMode::CFB:
+		for (size_t i = 0; i < nAll; ++i) {
+			const uint8_t *p = i < n ? src + i * cbBlock : last;
+			uint8_t *q = dst + i * cbBlock;
+			if (Mode == CipherMode::CBC) {
+				VectorXor(iv, p, cbBlock);
+				EncryptBlocks(iv, iv, 1);
+				memcpy(q, iv, cbBlock);
+			} else {
+				EncryptBlocks(iv, iv, 1);
+				for (size_t j = 0; j < cbBlock; ++j)
+					q[j] = p[j] ^ iv[j];
+				memcpy(iv, q, cbBlock);
+			}
+		}
+		break;
+	default:
+		Throw(E_NOTIMPL);
+	}
+	return nAll * cbBlock;
+}
+
+size_t Aes::Decrypt(RCSpan cbuf, uint8_t *dst) {
+	CheckKey();
+	if (Mode == CipherMode::OFB || Mode == CipherMode::CTR) {
+		StreamCrypt(cbuf, dst);
+		return cbuf.size();
+	}
+	const size_t cbBlock = 16;
+	if (cbuf.size() % cbBlock)
+		Throw(errc::invalid_argument);
+	const uint8_t *src = cbuf.data();
+	size_t n = cbuf.size() / cbBlock;
+	uint8_t prev[cbBlock], chunk[AES_CHUNK_BLOCKS * cbBlock];
+	if (Mode != CipherMode::ECB) {
+		if (IV.size() != cbBlock)
+			Throw(errc::invalid_argument);
+		memcpy(prev, IV.constData(), cbBlock);
+	}
+	switch (Mode) {
+	case CipherMode::ECB:
+		DecryptBlocks(src, dst, n);
+		break;
+	case CipherMode::CBC:
+	case CipherMode::CFB:
+		for (size_t i = 0; i < n; i += AES_CHUNK_BLOCKS) {		// the chunk copy keeps the ciphertext when dst == src
+			size_t k = (min)(AES_CHUNK_BLOCKS, n - i), cb = k * cbBlock;
+			uint8_t *q = dst + i * cbBlock;
+			memcpy(chunk, src + i * cbBlock, cb);
+			if (Mode == CipherMode::CBC) {
+				DecryptBlocks(chunk, q, k);
+				VectorXor(q, prev, cbBlock);
+				VectorXor(q + cbBlock, chunk, cb - cbBlock);
+			} else {
+				memcpy(q, prev, cbBlock);
+				memcpy(q + cbBlock, chunk, cb - cbBlock);
+				EncryptBlocks(q, q, k);
+				VectorXor(q, chunk, cb);
+			}
+			memcpy(prev, chunk + cb - cbBlock, cbBlock);
+		}
+		break;
+	default:
+		Throw(E_NOTIMPL);
+	}
+	size_t r = n * cbBlock;
+	if (Padding != PaddingMode::None && n) {
+		switch (Padding) {
+		case PaddingMode::PKCS7:
+			{
+				uint8_t nPad = dst[r - 1];
+				if (nPad == 0 || nPad > cbBlock)
+					Throw(ExtErr::Crypto);
+				for (int i = 0; i < nPad; ++i)
+					if (dst[r - 1 - i] != nPad)
+						Throw(ExtErr::Crypto); //!!!TODO Must be EXT_Crypto_DecryptFailed
+				r -= nPad;
+			}
+			break;
+		default:
+			Throw(E_NOTIMPL);
+		}
+	}
+	return r;
+}
 
 Blob Aes::Encrypt(RCSpan cbuf) {
-	int rlen = cbuf.size() + AES_BLOCK_SIZE, flen = 0;
-	Blob r(0, rlen);
-
-	CipherCtx ctx;
-    SslCheck(::EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), 0, m_key.constData(), IV.constData()));
-	if (Padding == PaddingMode::None)
-		SslCheck(::EVP_CIPHER_CTX_set_padding(ctx, false));
-	SslCheck(::EVP_EncryptUpdate(ctx, r.data(), &rlen, cbuf.data(), cbuf.size()));
-    SslCheck(::EVP_EncryptFinal_ex(ctx, r.data()+rlen, &flen));
-	r.resize(rlen + flen);
+	if (BlockSize != 128)
+		return base::Encrypt(cbuf);
+#if UCFG_USE_OPENSSL
+	if (Mode == CipherMode::CBC && KeySize == 256) {
+		int rlen = cbuf.size() + AES_BLOCK_SIZE, flen = 0;
+		Blob r(0, rlen);
+
+		CipherCtx ctx;
+		SslCheck(::EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), 0, m_key.constData(), IV.constData()));
+		if (Padding == PaddingMode::None)
+			SslCheck(::EVP_CIPHER_CTX_set_padding(ctx, false));
+		SslCheck(::EVP_EncryptUpdate(ctx, r.data(), &rlen, cbuf.data(), cbuf.size()));
+		SslCheck(::EVP_EncryptFinal_ex(ctx, r.data()+rlen, &flen));
+		r.resize(rlen + flen);
+		return r;
+	}
+#endif
+	Blob r(0, cbuf.size() + BlockSize/8);
+	r.resize(Encrypt(cbuf, r.data()));
 	return r;
 }
 
 Blob Aes::Decrypt(RCSpan cbuf) {
-	int rlen = cbuf.size(), flen = 0;
-	Blob r(0, rlen);
-	uint8_t* rdata = r.data();
-
-	CipherCtx ctx;
-    SslCheck(::EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), 0, m_key.constData(), IV.constData()));
-	if (Padding == PaddingMode::None)
-		SslCheck(::EVP_CIPHER_CTX_set_padding(ctx, false));
-	SslCheck(::EVP_DecryptUpdate(ctx, rdata, &rlen, cbuf.data(), cbuf.size()));
-	SslCheck(::EVP_DecryptFinal_ex(ctx, rdata + rlen, &flen));
-	r.resize(rlen + flen);
+	if (BlockSize != 128)
+		return base::Decrypt(cbuf);
+#if UCFG_USE_OPENSSL
+	if (Mode == CipherMode::CBC && KeySize == 256) {
+		int rlen = cbuf.size(), flen = 0;
+		Blob r(0, rlen);
+		uint8_t* rdata = r.data();
+
+		CipherCtx ctx;
+		SslCheck(::EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), 0, m_key.constData(), IV.constData()));
+		if (Padding == PaddingMode::None)
+			SslCheck(::EVP_CIPHER_CTX_set_padding(ctx, false));
+		SslCheck(::EVP_DecryptUpdate(ctx, rdata, &rlen, cbuf.data(), cbuf.size()));
+		SslCheck(::EVP_DecryptFinal_ex(ctx, rdata + rlen, &flen));
+		r.resize(rlen + flen);
+		return r;
+	}
+#endif
+	Blob r(0, cbuf.size());
+	r.resize(Decrypt(cbuf, r.data()));
 	return r;
 }
 
-#endif // UCFG_USE_OPENSSL
+// GHASH multiplication in GF(2^128)
+#if UCFG_CPU_X86_X64
+
+static __forceinline __m128i GfMulClmul(__m128i a, __m128i b) {		// operands byte-reflected
+	__m128i t3 = _mm_clmulepi64_si128(a, b, 0x00),
+		t4 = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01)),
+		t6 = _mm_clmulepi64_si128(a, b, 0x11);
+	t3 = _mm_xor_si128(t3, _mm_slli_si128(t4, 8));
+	t6 = _mm_xor_si128(t6, _mm_srli_si128(t4, 8));
+
+	__m128i t7 = _mm_srli_epi32(t3, 31), t8 = _mm_srli_epi32(t6, 31);		// shift the 256-bit product left by 1
+	t3 = _mm_or_si128(_mm_slli_epi32(t3, 1), _mm_slli_si128(t7, 4));
+	t6 = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(t6, 1), _mm_slli_si128(t8, 4)), _mm_srli_si128(t7, 12));
+
+	t7 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(t3, 31), _mm_slli_epi32(t3, 30)), _mm_slli_epi32(t3, 25));		// reduce modulo x^128 + x^7 + x^2 + x + 1
+	t8 = _mm_srli_si128(t7, 4);
+	t3 = _mm_xor_si128(t3, _mm_slli_si128(t7, 12));
+	__m128i t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(t3, 1), _mm_srli_epi32(t3, 2)), _mm_xor_si128(_mm_srli_epi32(t3, 7), t8));
+	return _mm_xor_si128(t6, _mm_xor_si128(t3, t2));
+}
+
+#endif // UCFG_CPU_X86_X64
+
+static void GfMul(uint64_t& xh, uint64_t& xl, uint64_t hh, uint64_t hl) {
+	uint64_t zh = 0, zl = 0;
+	for (int i = 0; i < 128; ++i) {
+		uint64_t m = 0 - ((i < 64 ? xh >> (63 - i) : xl >> (127 - i)) & 1),
+			lsb = 0 - (hl & 1);
+		zh ^= hh & m;
+		zl ^= hl & m;
+		hl = (hl >> 1) | (hh << 63);
+		hh = (hh >> 1) ^ (0xE100000000000000ULL & lsb);
+	}
+	xh = zh;
+	xl = zl;
+}
+
+AesGcm::AesGcm(RCSpan key) {
+	if (key.size() != 16 && key.size() != 24 && key.size() != 32)
+		Throw(errc::invalid_argument);
+	m_aes.KeySize = int(key.size() * 8);
+	m_aes.Key = key;
+	memset(m_h, 0, sizeof m_h);
+	m_aes.EncryptBlocks(m_h, m_h, 1);
+}
+
+void AesGcm::Ghash(uint8_t y[16], RCSpan data) const {
+	const uint8_t *p = data.data();
+	size_t size = data.size();
+	uint8_t block[16];
+#if UCFG_CPU_X86_X64
+	if (s_bHasPclmul) {
+		const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+		__m128i h = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)m_h), bswap),
+			x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)y), bswap);
+		for (; size; p += 16, size -= (min)(size, size_t(16))) {
+			const uint8_t *q = p;
+			if (size < 16) {
+				memset(block, 0, 16);
+				memcpy(q = block, p, size);
+			}
+			x = GfMulClmul(_mm_xor_si128(x, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)q), bswap)), h);
+		}
+		_mm_storeu_si128((__m128i*)y, _mm_shuffle_epi8(x, bswap));
+		return;
+	}
+#endif
+	uint64_t hh = GetBeUInt64(m_h), hl = GetBeUInt64(m_h + 8),
+		xh = GetBeUInt64(y), xl = GetBeUInt64(y + 8);
+	for (; size; p += 16, size -= (min)(size, size_t(16))) {
+		const uint8_t *q = p;
+		if (size < 16) {
+			memset(block, 0, 16);
+			memcpy(q = block, p, size);
+		}
+		xh ^= GetBeUInt64(q);
+		xl ^= GetBeUInt64(q + 8);
+		GfMul(xh, xl, hh, hl);
+	}
+	*(uint64_t*)y = htobe(xh);
+	*(uint64_t*)(y + 8) = htobe(xl);
+}
+
+void AesGcm::InitCounter(RCSpan iv, uint8_t j0[16]) {
+	memset(j0, 0, 16);
+	if (iv.size() == 12) {
+		memcpy(j0, iv.data(), 12);
+		j0[15] = 1;
+	} else {
+		Ghash(j0, iv);
+		uint8_t lens[16] = { 0 };
+		*(uint64_t*)(lens + 8) = htobe(uint64_t(iv.size()) * 8);
+		Ghash(j0, Span(lens, 16));
+	}
+}
+
+void AesGcm::CalcTag(const uint8_t j0[16], RCSpan aad, RCSpan cbuf, uint8_t tag[16]) {
+	uint8_t s[16] = { 0 }, lens[16], ek[16];
+	Ghash(s, aad);
+	Ghash(s, cbuf);
+	*(uint64_t*)lens = htobe(uint64_t(aad.size()) * 8);
+	*(uint64_t*)(lens + 8) = htobe(uint64_t(cbuf.size()) * 8);
+	Ghash(s, Span(lens, 16));
+	m_aes.EncryptBlocks(j0, ek, 1);
+	for (int i = 0; i < 16; ++i)
+		tag[i] = s[i] ^ ek[i];
+}
+
+void AesGcm::Encrypt(RCSpan iv, RCSpan aad, RCSpan plain, uint8_t *dst, uint8_t tag[16]) {
+	uint8_t j0[16], ctr[16];
+	InitCounter(iv, j0);
+	memcpy(ctr, j0, 16);
+	*(uint32_t*)(ctr + 12) = htobe(uint32_t(betoh(*(uint32_t*)(ctr + 12)) + 1));
+	m_aes.CtrCrypt(ctr, plain.data(), dst, plain.size(), true);
+	CalcTag(j0, aad, Span(dst, plain.size()), tag);
+}
+
+void AesGcm::Decrypt(RCSpan iv, RCSpan aad, RCSpan cbuf, const uint8_t tag[16], uint8_t *dst) {
+	uint8_t j0[16], ctr[16], t[16];
+	InitCounter(iv, j0);
+	CalcTag(j0, aad, cbuf, t);
+	uint8_t diff = 0;
+	for (int i = 0; i < 16; ++i)
+		diff |= t[i] ^ tag[i];
+	if (diff)
+		Throw(ExtErr::Crypto);
+	memcpy(ctr, j0, 16);
+	*(uint32_t*)(ctr + 12) = htobe(uint32_t(betoh(*(uint32_t*)(ctr + 12)) + 1));
+	m_aes.CtrCrypt(ctr, cbuf.data(), dst, cbuf.size(), true);
+}
+
+Blob AesGcm::Encrypt(RCSpan iv, RCSpan aad, RCSpan plain) {
+	Blob r(0, plain.size() + 16);
+	Encrypt(iv, aad, plain, r.data(), r.data() + plain.size());
+	return r;
+}
+
+Blob AesGcm::Decrypt(RCSpan iv, RCSpan aad, RCSpan cbuf) {
+	if (cbuf.size() < 16)
+		Throw(ExtErr::Crypto);
+	size_t size = cbuf.size() - 16;
+	Blob r(0, size);
+	Decrypt(iv, aad, Span(cbuf.data(), size), cbuf.data() + size, r.data());
+	return r;
+}
 
 
 
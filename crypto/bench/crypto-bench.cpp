@@ -0,0 +1,109 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// crypto-bench: throughput of all crypto backends of this build as JSON, see CryptoBenchmark.
+// Kernels are selected once per process, so each CPU tier from generic up to the detected one runs in a child process with UCFG_CPU_TIER set:
+//	{ "schema": 1, "tiers": [ CryptoBenchmark report, ... ] }, each report with its own "cpu"."tier" and "kernels". -single measures this process only
+//
+// Drop-in source, no project in this tree references it. Build it as a console application from this file, the crypto sources
+// (crypto/*.cpp with crypto-bench.cpp and the crypto/x86x64 kernels) and libext, e.g. a Console Application project referencing libext.vcxproj
+// with el/ on the include path the way libext.vcxproj has it; on POSIX the same files with -I<repo parent> -pthread and OpenSSL's libcrypto
+
+#include <el/ext.h>
+
+#include <el/crypto/crypto-bench.h>
+
+#define VER_FILEDESCRIPTION_STR "Crypto benchmark"
+#define VER_PRODUCTVERSION_STR "1.0"
+#define VER_LEGALCOPYRIGHT_STR "Copyright (c) 2019 Ufasoft"
+#define VER_EXT_URL "http://ufasoft.com"
+
+using namespace Ext::Crypto;
+
+class CCryptoBenchApp : public CConApp {
+	CryptoBenchmark m_bench;
+	String m_flag, m_outFile;
+	String m_childArgs;						// the options passed on to the child of each tier
+	bool m_bSingle;
+public:
+	CCryptoBenchApp()
+		: m_bSingle(false)
+	{
+		m_bPrintLogo = false;
+	}
+
+	void Usage() override {
+		cerr << "Usage: crypto-bench [-single] [-t seconds] [-min bytes] [-max bytes] [-f algorithm/variant] [-o file.json]" << endl;
+	}
+
+	void ParseParam(RCString param, bool bFlag, bool bLast) override {
+		if (bFlag && param == "single") {
+			m_bSingle = true;
+			return;
+		}
+		if (bFlag) {
+			if (param != "t" && param != "min" && param != "max" && param != "f" && param != "o" || bLast) {
+				Usage();
+				Throw(errc::invalid_argument);
+			}
+			m_flag = param;
+			return;
+		}
+		if (m_flag == "t")
+			m_bench.MinSeconds = atof(param.c_str());
+		else if (m_flag == "min")
+			m_bench.MinSize = (size_t)Convert::ToUInt64(param);
+		else if (m_flag == "max")
+			m_bench.MaxSize = (size_t)Convert::ToUInt64(param);
+		else if (m_flag == "f")
+			m_bench.Filter = param;
+		else if (m_flag == "o")
+			m_outFile = param;
+		else {
+			Usage();
+			Throw(errc::invalid_argument);
+		}
+		if (m_flag != "o")
+			m_childArgs += String(" -") + m_flag + " \"" + param + "\"";
+		m_flag = nullptr;
+	}
+
+#if UCFG_CPU_X86_X64
+	void RunTiers(ostream& os) {
+		os << "{\"schema\": 1, \"tiers\": [";
+		for (int tier = 0; tier <= (int)CpuInfo().Features.Tier; ++tier) {
+			path tmp = Path::GetTempFileName();
+			Environment::SetEnvironmentVariable("UCFG_CPU_TIER", CpuInfo::TierName(CpuTier(tier)));		// inherited by the child on POSIX, copied into ProcessStartInfo on Windows
+			Process child = Process::Start(ProcessStartInfo(System.ExeFilePath, String("-single") + m_childArgs + " -o \"" + String(tmp.native()) + "\""));
+			child.WaitForExit();
+			String report = child.ExitCode ? String() : File::ReadAllText(tmp);
+			error_code ec;
+			remove(tmp, ec);
+			if (report.empty()) {
+				cerr << "crypto-bench: tier " << CpuInfo::TierName(CpuTier(tier)) << " failed" << endl;
+				Throw(E_FAIL);
+			}
+			os << (tier ? ",\n" : "\n") << report.Trim();
+		}
+		os << "\n]}" << endl;
+	}
+#endif
+
+	void Execute() override {
+		ofstream ofs;
+		if (!m_outFile.empty())
+			ofs.open(m_outFile.c_str());
+		ostream& os = m_outFile.empty() ? cout : ofs;
+#if UCFG_CPU_X86_X64
+		if (!m_bSingle) {
+			RunTiers(os);
+			return;
+		}
+#endif
+		m_bench.Run(os);
+	}
+} theApp;
+
+EXT_DEFINE_MAIN(theApp)
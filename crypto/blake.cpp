@@ -6,6 +6,7 @@
 #include <el/ext.h>
 
 #include "hash.h"
+#include "salsa20.h"
 
 using namespace Ext;
 
@@ -91,12 +92,293 @@ template <typename W, int R> void CalcHashBlock(void* dst, const uint8_t* src, u
 		h[i] ^= salt[i % 4] ^ w[i % 8] ^ w[8 + i % 8];
 }
 
+#if UCFG_CPU_X86_X64
+
+// Row-parallel compression: the rows (v0..v3), (v4..v7), (v8..v11), (v12..v15) of the state are vectors, so the 4 G of a column step run at once.
+// For the diagonal step the rows 2..4 are rotated by 1..3 words, which turns the diagonals into columns, and rotated back after it
+
+template <int n> static __forceinline __m128i Blake256Rotr(__m128i a) {
+	switch (n) {
+	case 16: return _mm_shuffle_epi8(a, _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+	case 8: return _mm_shuffle_epi8(a, _mm_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12));
+	default: return _mm_or_si128(_mm_srli_epi32(a, n), _mm_slli_epi32(a, 32 - n));
+	}
+}
+
+static __forceinline void Blake256RowG(__m128i& a, __m128i& b, __m128i& c, __m128i& d, __m128i x, __m128i y) {
+	a = _mm_add_epi32(_mm_add_epi32(a, b), x);
+	d = Blake256Rotr<16>(_mm_xor_si128(d, a));
+	c = _mm_add_epi32(c, d);
+	b = Blake256Rotr<12>(_mm_xor_si128(b, c));
+	a = _mm_add_epi32(_mm_add_epi32(a, b), y);
+	d = Blake256Rotr<8>(_mm_xor_si128(d, a));
+	c = _mm_add_epi32(c, d);
+	b = Blake256Rotr<7>(_mm_xor_si128(b, c));
+}
+
+static void Blake256CompressSse41(uint32_t h[8], const uint32_t m[16], const uint32_t salt[4], uint64_t counter) {
+	const uint32_t *k = g_blake256_c, t0 = uint32_t(counter), t1 = uint32_t(counter >> 32);
+	const __m128i h0 = _mm_loadu_si128((const __m128i*)h), h1 = _mm_loadu_si128((const __m128i*)(h + 4)),
+		s = _mm_loadu_si128((const __m128i*)salt);
+	__m128i a = h0, b = h1,
+		c = _mm_xor_si128(s, _mm_loadu_si128((const __m128i*)k)),
+		d = _mm_xor_si128(_mm_setr_epi32(t0, t0, t1, t1), _mm_loadu_si128((const __m128i*)(k + 4)));
+	for (int r = 0; r < 14; ++r) {
+		const uint8_t *sg = g_blake_sigma[r % 10];
+		Blake256RowG(a, b, c, d,
+			_mm_setr_epi32(m[sg[0]] ^ k[sg[1]], m[sg[2]] ^ k[sg[3]], m[sg[4]] ^ k[sg[5]], m[sg[6]] ^ k[sg[7]]),
+			_mm_setr_epi32(m[sg[1]] ^ k[sg[0]], m[sg[3]] ^ k[sg[2]], m[sg[5]] ^ k[sg[4]], m[sg[7]] ^ k[sg[6]]));
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1));
+		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 1, 0, 3));
+		Blake256RowG(a, b, c, d,
+			_mm_setr_epi32(m[sg[8]] ^ k[sg[9]], m[sg[10]] ^ k[sg[11]], m[sg[12]] ^ k[sg[13]], m[sg[14]] ^ k[sg[15]]),
+			_mm_setr_epi32(m[sg[9]] ^ k[sg[8]], m[sg[11]] ^ k[sg[10]], m[sg[13]] ^ k[sg[12]], m[sg[15]] ^ k[sg[14]]));
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3));
+		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm_shuffle_epi32(d, _MM_SHUFFLE(0, 3, 2, 1));
+	}
+	_mm_storeu_si128((__m128i*)h, _mm_xor_si128(_mm_xor_si128(h0, s), _mm_xor_si128(a, c)));
+	_mm_storeu_si128((__m128i*)(h + 4), _mm_xor_si128(_mm_xor_si128(h1, s), _mm_xor_si128(b, d)));
+}
+
+template <int n> static __forceinline __m256i Blake512Rotr(__m256i a) {
+	switch (n) {
+	case 32: return _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1));
+	case 16: return _mm256_shuffle_epi8(a, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+	default: return _mm256_or_si256(_mm256_srli_epi64(a, n), _mm256_slli_epi64(a, 64 - n));
+	}
+}
+
+static __forceinline void Blake512RowG(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y) {
+	a = _mm256_add_epi64(_mm256_add_epi64(a, b), x);
+	d = Blake512Rotr<32>(_mm256_xor_si256(d, a));
+	c = _mm256_add_epi64(c, d);
+	b = Blake512Rotr<25>(_mm256_xor_si256(b, c));
+	a = _mm256_add_epi64(_mm256_add_epi64(a, b), y);
+	d = Blake512Rotr<16>(_mm256_xor_si256(d, a));
+	c = _mm256_add_epi64(c, d);
+	b = Blake512Rotr<11>(_mm256_xor_si256(b, c));
+}
+
+static void Blake512CompressAvx2(uint64_t h[8], const uint64_t m[16], const uint64_t salt[4], uint64_t counter) {
+	const uint64_t *k = g_blake512_c;
+	const __m256i h0 = _mm256_loadu_si256((const __m256i*)h), h1 = _mm256_loadu_si256((const __m256i*)(h + 4)),
+		s = _mm256_loadu_si256((const __m256i*)salt);
+	__m256i a = h0, b = h1,
+		c = _mm256_xor_si256(s, _mm256_loadu_si256((const __m256i*)k)),
+		d = _mm256_xor_si256(_mm256_setr_epi64x(counter, counter, 0, 0), _mm256_loadu_si256((const __m256i*)(k + 4)));
+	for (int r = 0; r < 16; ++r) {
+		const uint8_t *sg = g_blake_sigma[r % 10];
+		Blake512RowG(a, b, c, d,
+			_mm256_setr_epi64x(m[sg[0]] ^ k[sg[1]], m[sg[2]] ^ k[sg[3]], m[sg[4]] ^ k[sg[5]], m[sg[6]] ^ k[sg[7]]),
+			_mm256_setr_epi64x(m[sg[1]] ^ k[sg[0]], m[sg[3]] ^ k[sg[2]], m[sg[5]] ^ k[sg[4]], m[sg[7]] ^ k[sg[6]]));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+		Blake512RowG(a, b, c, d,
+			_mm256_setr_epi64x(m[sg[8]] ^ k[sg[9]], m[sg[10]] ^ k[sg[11]], m[sg[12]] ^ k[sg[13]], m[sg[14]] ^ k[sg[15]]),
+			_mm256_setr_epi64x(m[sg[9]] ^ k[sg[8]], m[sg[11]] ^ k[sg[10]], m[sg[13]] ^ k[sg[12]], m[sg[15]] ^ k[sg[14]]));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));
+		c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+		d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+	}
+	_mm256_storeu_si256((__m256i*)h, _mm256_xor_si256(_mm256_xor_si256(h0, s), _mm256_xor_si256(a, c)));
+	_mm256_storeu_si256((__m256i*)(h + 4), _mm256_xor_si256(_mm256_xor_si256(h1, s), _mm256_xor_si256(b, d)));
+}
+
+typedef void (*PFN_Blake256Compress)(uint32_t h[8], const uint32_t m[16], const uint32_t salt[4], uint64_t counter);
+typedef void (*PFN_Blake512Compress)(uint64_t h[8], const uint64_t m[16], const uint64_t salt[4], uint64_t counter);
+
+static const PFN_Blake256Compress s_pfnBlake256Compress = CpuDispatch::Select<PFN_Blake256Compress>("Blake-256", {
+	{ "sse4.1", CpuInfo().Features.SSE41 && CpuInfo().Features.SSSE3, Blake256CompressSse41 },
+	{ "generic", true, nullptr },
+});
+
+static const PFN_Blake512Compress s_pfnBlake512Compress = CpuDispatch::Select<PFN_Blake512Compress>("Blake-512", {
+	{ "avx2", CpuInfo().Features.AVX2, Blake512CompressAvx2 },
+	{ "generic", true, nullptr },
+});
+
+// Batch mode: state[8][N] and data[16][N] hold word i of every lane in one vector, as in SHA256::UpdateNWay()
+
+static const int s_blake256Lanes = CpuDispatch::Select<int>("Blake-256 batch", {
+	{ "avx512 x16", CpuInfo().Features.AVX512F, 16 },
+	{ "avx2 x8", CpuInfo().Features.AVX2, 8 },
+	{ "sse2 x4", true, 4 },
+});
+
+static const int s_blake512Lanes = CpuDispatch::Select<int>("Blake-512 batch", {
+	{ "avx512 x8", CpuInfo().Features.AVX512F, 8 },
+	{ "avx2 x4", CpuInfo().Features.AVX2, 4 },
+	{ "generic", true, 0 },
+});
+
+static __forceinline __m256i VAdd64(__m256i a, __m256i b) { return _mm256_add_epi64(a, b); }
+static __forceinline __m256i VSet64(uint64_t v, __m256i) { return _mm256_set1_epi64x(v); }
+template <int n> static __forceinline __m256i VRotr64(__m256i a) { return Blake512Rotr<n>(a); }
+
+static __forceinline __m512i VAdd64(__m512i a, __m512i b) { return _mm512_add_epi64(a, b); }
+static __forceinline __m512i VSet64(uint64_t v, __m512i) { return _mm512_set1_epi64(v); }
+template <int n> static __forceinline __m512i VRotr64(__m512i a) { return _mm512_ror_epi64(a, n); }
+
+template <class W> struct BlakeWord;
+
+template <> struct BlakeWord<uint32_t> {
+	static const int Rounds = 14, R0 = 16, R1 = 12, R2 = 8, R3 = 7;
+	static const uint32_t *Constants() { return g_blake256_c; }
+	template <class V> static __forceinline V Add(V a, V b) { return VAdd32(a, b); }
+	template <class V> static __forceinline V Set1(uint32_t w) { return VSet1(w, V()); }
+	template <int n, class V> static __forceinline V Rotr(V a) { return VRotl32<32 - n>(a); }
+};
+
+template <> struct BlakeWord<uint64_t> {
+	static const int Rounds = 16, R0 = 32, R1 = 25, R2 = 16, R3 = 11;
+	static const uint64_t *Constants() { return g_blake512_c; }
+	template <class V> static __forceinline V Add(V a, V b) { return VAdd64(a, b); }
+	template <class V> static __forceinline V Set1(uint64_t w) { return VSet64(w, V()); }
+	template <int n, class V> static __forceinline V Rotr(V a) { return VRotr64<n>(a); }
+};
+
+template <class W, class V>
+static __forceinline void BlakeLaneG(V& a, V& b, V& c, V& d, V x, V y) {
+	typedef BlakeWord<W> B;
+	a = B::Add(B::Add(a, b), x);
+	d = B::template Rotr<B::R0>(VXor(d, a));
+	c = B::Add(c, d);
+	b = B::template Rotr<B::R1>(VXor(b, c));
+	a = B::Add(B::Add(a, b), y);
+	d = B::template Rotr<B::R2>(VXor(d, a));
+	c = B::Add(c, d);
+	b = B::template Rotr<B::R3>(VXor(b, c));
+}
+
+template <class W, class V>
+static void BlakeUpdateLanes(W *state, const W *data, const W salt[4], uint64_t counter) {
+	typedef BlakeWord<W> B;
+	const W *k = B::Constants(),
+		t0 = W(counter), t1 = W(sizeof(W) == 4 ? counter >> 32 : 0);		// Blake-512's counter is 128-bit
+	V *h = (V*)state, m[16], v[16];
+	for (int i = 0; i < 16; ++i)
+		m[i] = ((const V*)data)[i];
+	for (int i = 0; i < 8; ++i)
+		v[i] = h[i];
+	for (int i = 0; i < 4; ++i)
+		v[8 + i] = B::template Set1<V>(salt[i] ^ k[i]);
+	v[12] = B::template Set1<V>(t0 ^ k[4]);
+	v[13] = B::template Set1<V>(t0 ^ k[5]);
+	v[14] = B::template Set1<V>(t1 ^ k[6]);
+	v[15] = B::template Set1<V>(t1 ^ k[7]);
+	for (int r = 0; r < B::Rounds; ++r) {
+		const uint8_t *sg = g_blake_sigma[r % 10];
+		V x[16];
+		for (int i = 0; i < 16; ++i)
+			x[i] = VXor(m[sg[i]], B::template Set1<V>(k[sg[i ^ 1]]));
+		BlakeLaneG<W>(v[0], v[4], v[8], v[12], x[0], x[1]);
+		BlakeLaneG<W>(v[1], v[5], v[9], v[13], x[2], x[3]);
+		BlakeLaneG<W>(v[2], v[6], v[10], v[14], x[4], x[5]);
+		BlakeLaneG<W>(v[3], v[7], v[11], v[15], x[6], x[7]);
+		BlakeLaneG<W>(v[0], v[5], v[10], v[15], x[8], x[9]);
+		BlakeLaneG<W>(v[1], v[6], v[11], v[12], x[10], x[11]);
+		BlakeLaneG<W>(v[2], v[7], v[8], v[13], x[12], x[13]);
+		BlakeLaneG<W>(v[3], v[4], v[9], v[14], x[14], x[15]);
+	}
+	for (int i = 0; i < 8; ++i)
+		h[i] = VXor(VXor(h[i], B::template Set1<V>(salt[i % 4])), VXor(v[i], v[8 + i]));
+}
+
+static void BlakeUpdateNWay(uint32_t *state, const uint32_t *data, const uint32_t salt[4], uint64_t counter, int lanes) {
+	switch (lanes) {
+	case 16: BlakeUpdateLanes<uint32_t, __m512i>(state, data, salt, counter); break;
+	case 8: BlakeUpdateLanes<uint32_t, __m256i>(state, data, salt, counter); break;
+	default: BlakeUpdateLanes<uint32_t, __m128i>(state, data, salt, counter);
+	}
+}
+
+static void BlakeUpdateNWay(uint64_t *state, const uint64_t *data, const uint64_t salt[4], uint64_t counter, int lanes) {
+	if (lanes == 8)
+		BlakeUpdateLanes<uint64_t, __m512i>(state, data, salt, counter);
+	else
+		BlakeUpdateLanes<uint64_t, __m256i>(state, data, salt, counter);
+}
+
+// Up to 16 equal-length messages in one pass, padded as in ComputeHashImp(); unused lanes repeat the last message
+template <class W>
+static void BlakeHashLanes(uint8_t *dst, size_t cbHash, const uint8_t *const *messages, size_t len, int cnt, int lanes, const W hinit[8], const W salt[4]) {
+	const size_t cbBlock = 16 * sizeof(W), cbLen = 2 * sizeof(W);
+	DECLSPEC_ALIGN(64) W state[8 * 16], data[16 * 16];
+	uint8_t tails[16][2 * 128];
+	size_t nFull = len / cbBlock, cbTail = len % cbBlock;
+	int nTail = cbTail + 1 + cbLen <= cbBlock ? 1 : 2;
+	for (int k = 0; k < cnt; ++k) {
+		uint8_t *tail = tails[k];
+		memset(tail, 0, sizeof tails[k]);
+		memcpy(tail, messages[k] + nFull * cbBlock, cbTail);
+		tail[cbTail] = 0x80;
+		tail[nTail * cbBlock - cbLen - 1] |= 1;
+		*(uint64_t*)(tail + nTail * cbBlock - 8) = htobe64(uint64_t(len) << 3);
+	}
+	for (int j = 0; j < 8; ++j)
+		for (int k = 0; k < lanes; ++k)
+			state[j * lanes + k] = hinit[j];
+	for (size_t b = 0; b < nFull + nTail; ++b) {
+		for (int k = 0; k < lanes; ++k) {
+			int m = (min)(k, cnt - 1);
+			const W *p = (const W*)(b < nFull ? messages[m] + b * cbBlock : tails[m] + (b - nFull) * cbBlock);
+			for (int j = 0; j < 16; ++j)
+				data[j * lanes + k] = betoh(p[j]);
+		}
+		uint64_t counter = b < nFull ? uint64_t(b + 1) * cbBlock << 3		// message bits up to the end of the block, 0 for a block of padding only
+			: b == nFull && cbTail ? uint64_t(len) << 3
+			: 0;
+		BlakeUpdateNWay(state, data, salt, counter, lanes);
+	}
+	for (int k = 0; k < cnt; ++k)
+		for (size_t j = 0; j < cbHash / sizeof(W); ++j)
+			*(W*)(dst + k * cbHash + j * sizeof(W)) = htobe(state[j * lanes + k]);
+}
+
+template <class W>
+static size_t BlakeHashMany(int maxLanes, uint8_t *dst, size_t cbHash, const uint8_t *const *messages, size_t len, size_t n, const W hinit[8], const W salt[4]) {
+	size_t i = 0;
+	if (maxLanes) {
+		while (n - i >= 2) {
+			int lanes = maxLanes;
+			while (lanes > 4 && n - i <= size_t(lanes / 2))
+				lanes /= 2;
+			int cnt = (int)(min)(n - i, size_t(lanes));
+			BlakeHashLanes<W>(dst + i * cbHash, cbHash, messages + i, len, cnt, lanes, hinit, salt);
+			i += cnt;
+		}
+	}
+	return i;
+}
+
+#endif // UCFG_CPU_X86_X64
+
+void Blake256::Compress(uint32_t h[8], const uint32_t m[16], const uint32_t salt[4], uint64_t counter) noexcept {
+#if UCFG_CPU_X86_X64
+	if (s_pfnBlake256Compress)
+		return s_pfnBlake256Compress(h, m, salt, counter);
+#endif
+	CalcHashBlock<uint32_t, 14>(h, (const uint8_t*)m, counter, salt, g_blake256_c, uint32_t(counter), uint32_t(counter >> 32));
+}
+
 void Blake256::InitHash(void *dst) noexcept {
 	memcpy(dst, g_sha256_hinit, sizeof(g_sha256_hinit));
 }
 
 void Blake256::HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept {
-	CalcHashBlock<uint32_t, 14>(dst, src, counter, Salt, g_blake256_c, uint32_t(counter), counter >> 32);
+	Compress((uint32_t*)dst, (const uint32_t*)src, Salt, counter);
+}
+
+void Blake256::ComputeHashes(uint8_t (*dst)[32], const uint8_t *const *messages, size_t len, size_t n) {
+	size_t i = 0;
+#if UCFG_CPU_X86_X64
+	i = BlakeHashMany<uint32_t>(s_blake256Lanes, dst[0], 32, messages, len, n, g_sha256_hinit, Salt);
+#endif
+	for (; i < n; ++i)
+		memcpy(dst[i], ComputeHash(Span(messages[i], len)).constData(), 32);
 }
 
 void Blake512::InitHash(void *dst) noexcept {
@@ -104,9 +386,22 @@ void Blake512::InitHash(void *dst) noexcept {
 }
 
 void Blake512::HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept {
+#if UCFG_CPU_X86_X64
+	if (s_pfnBlake512Compress)
+		return s_pfnBlake512Compress((uint64_t*)dst, (const uint64_t*)src, Salt, counter);
+#endif
 	CalcHashBlock<uint64_t, 16>(dst, src, counter, Salt, g_blake512_c, counter, 0);
 }
 
+void Blake512::ComputeHashes(uint8_t (*dst)[64], const uint8_t *const *messages, size_t len, size_t n) {
+	size_t i = 0;
+#if UCFG_CPU_X86_X64
+	i = BlakeHashMany<uint64_t>(s_blake512Lanes, dst[0], 64, messages, len, n, g_sha512_hinit, Salt);
+#endif
+	for (; i < n; ++i)
+		memcpy(dst[i], ComputeHash(Span(messages[i], len)).constData(), 64);
+}
+
 }} // Ext::Crypto::
 
 
@@ -21,9 +21,123 @@ void BloomFilter::Insert(RCSpan key) {
 		Bitset.set(Hash(key, i));
 }
 
+#if UCFG_CPU_X86_X64
+static bool s_bBloomHasAvx2 = CpuInfo().Features.AVX2;
+static CpuDispatch::Registration s_regBloom("BlockedBloomFilter", s_bBloomHasAvx2 ? "avx2" : "generic");
+#endif
 
+static const size_t BLOOM_BATCH = 16;		// keys hashed & prefetched ahead of the block access
 
+BlockedBloomFilter::BlockedBloomFilter(size_t nBits, int hashNum, uint32_t tweak)
+	:	HashNum(hashNum)
+	,	Tweak(tweak)
+	,	m_blocks((max)(size_t(1), (nBits + BLOCK_BITS - 1) / BLOCK_BITS))
+{
+	if (hashNum < 1 || hashNum > BLOCK_BITS)
+		Throw(E_INVALIDARG);
+	Clear();
+}
 
-}} // Ext::Crypto::
+void BlockedBloomFilter::Clear() {
+	memset(m_blocks.data(), 0, m_blocks.size() * sizeof(Block));
+}
+
+void BlockedBloomFilter::MakeProbe(RCSpan key, Probe& probe) const {
+	uint64_t h[2];
+	MurmurHash3_128(key, Tweak, h);
+	probe.Idx = size_t(h[0] % m_blocks.size());
+	probe.H1 = uint32_t(h[1]);
+	probe.H2 = uint32_t(h[1] >> 32) | 1;
+}
+
+void BlockedBloomFilter::MakeMask(const Probe& probe, Block& mask) const {
+	ZeroStruct(mask);
+	uint32_t g = probe.H1;
+	for (int i = 0; i < HashNum; ++i, g += probe.H2) {
+		int bit = g >> 23;								// top 9 bits
+		mask.W[bit >> 6] |= uint64_t(1) << (bit & 63);
+	}
+}
+
+static __forceinline void PrefetchBlock(const void *p) {
+#if UCFG_CPU_X86_X64
+	_mm_prefetch((const char*)p, _MM_HINT_T0);
+#endif
+}
+
+static __forceinline bool TestBlock(const BlockedBloomFilter::Block& block, const BlockedBloomFilter::Block& mask) {
+#if UCFG_CPU_X86_X64
+	if (s_bBloomHasAvx2) {
+		__m256i b0 = _mm256_load_si256((const __m256i*)block.W), b1 = _mm256_load_si256((const __m256i*)(block.W + 4)),
+			m0 = _mm256_load_si256((const __m256i*)mask.W), m1 = _mm256_load_si256((const __m256i*)(mask.W + 4));
+		return _mm256_testc_si256(b0, m0) & _mm256_testc_si256(b1, m1);
+	}
+	__m128i miss = _mm_setzero_si128();
+	for (int i = 0; i < 4; ++i)
+		miss = _mm_or_si128(miss, _mm_andnot_si128(_mm_load_si128((const __m128i*)block.W + i), _mm_load_si128((const __m128i*)mask.W + i)));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(miss, _mm_setzero_si128())) == 0xFFFF;
+#else
+	uint64_t miss = 0;
+	for (int i = 0; i < 8; ++i)
+		miss |= mask.W[i] & ~block.W[i];
+	return !miss;
+#endif
+}
 
+static __forceinline void OrBlock(BlockedBloomFilter::Block& block, const BlockedBloomFilter::Block& mask) {
+	for (int i = 0; i < 8; ++i)
+		block.W[i] |= mask.W[i];
+}
+
+bool BlockedBloomFilter::Contains(RCSpan key) const {
+	Probe probe;
+	MakeProbe(key, probe);
+	Block mask;
+	MakeMask(probe, mask);
+	return TestBlock(m_blocks[probe.Idx], mask);
+}
 
+void BlockedBloomFilter::Insert(RCSpan key) {
+	Probe probe;
+	MakeProbe(key, probe);
+	Block mask;
+	MakeMask(probe, mask);
+	OrBlock(m_blocks[probe.Idx], mask);
+}
+
+vector<bool> BlockedBloomFilter::ContainsMany(const vector<Span>& keys) const {
+	vector<bool> r(keys.size());
+	Probe probes[BLOOM_BATCH];
+	Block mask;
+	for (size_t i = 0; i < keys.size(); i += BLOOM_BATCH) {
+		size_t n = (min)(BLOOM_BATCH, keys.size() - i);
+		for (size_t j = 0; j < n; ++j) {
+			MakeProbe(keys[i + j], probes[j]);
+			PrefetchBlock(&m_blocks[probes[j].Idx]);
+		}
+		for (size_t j = 0; j < n; ++j) {
+			MakeMask(probes[j], mask);
+			r[i + j] = TestBlock(m_blocks[probes[j].Idx], mask);
+		}
+	}
+	return r;
+}
+
+void BlockedBloomFilter::InsertMany(const vector<Span>& keys) {
+	Probe probes[BLOOM_BATCH];
+	Block mask;
+	for (size_t i = 0; i < keys.size(); i += BLOOM_BATCH) {
+		size_t n = (min)(BLOOM_BATCH, keys.size() - i);
+		for (size_t j = 0; j < n; ++j) {
+			MakeProbe(keys[i + j], probes[j]);
+			PrefetchBlock(&m_blocks[probes[j].Idx]);
+		}
+		for (size_t j = 0; j < n; ++j) {
+			MakeMask(probes[j], mask);
+			OrBlock(m_blocks[probes[j].Idx], mask);
+		}
+	}
+}
+
+
+}} // Ext::Crypto::
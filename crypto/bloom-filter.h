@@ -27,6 +27,39 @@ protected:
 	virtual size_t Hash(RCSpan cbuf, int n) const =0;
 };
 
+// All HashNum bits of a key land in one 512-bit block (one cache line); block index and bit positions
+// are derived from a single 128-bit MurmurHash3 by double hashing. Not BIP37-compatible.
+class BlockedBloomFilter {
+public:
+	static const int BLOCK_BITS = 512;
+
+	struct DECLSPEC_ALIGN(64) Block {
+		uint64_t W[8];
+	};
+
+	int HashNum;
+	uint32_t Tweak;
+
+	BlockedBloomFilter(size_t nBits = BLOCK_BITS, int hashNum = 8, uint32_t tweak = 0);
+
+	size_t size() const { return m_blocks.size() * BLOCK_BITS; }
+	void Clear();
+	bool Contains(RCSpan key) const;
+	void Insert(RCSpan key);
+	vector<bool> ContainsMany(const vector<Span>& keys) const;
+	void InsertMany(const vector<Span>& keys);
+private:
+	struct Probe {
+		size_t Idx;
+		uint32_t H1, H2;
+	};
+
+	vector<Block> m_blocks;
+
+	void MakeProbe(RCSpan key, Probe& probe) const;
+	void MakeMask(const Probe& probe, Block& mask) const;
+};
+
 
 
 }} // Ext::Crypto::
@@ -11,7 +11,7 @@ namespace Ext { namespace Crypto {
 using namespace std;
 
 ENUM_CLASS(CipherMode) {
-	CBC, CFB, CTS, ECB, OFB
+	CBC, CFB, CTS, ECB, OFB, CTR
 } END_ENUM_CLASS(CipherMode);
 
 ENUM_CLASS(PaddingMode) {
@@ -38,7 +38,7 @@ public:
 	{}
 
 	Span get_Key() const { return m_key; }
-	void put_Key(RCSpan key) {
+	virtual void put_Key(RCSpan key) {
 		if (key.size() != KeySize/8)
 			Throw(errc::invalid_argument);
 		m_key = key;
@@ -84,10 +84,15 @@ public:
 	Aes();
 
 	static std::pair<Blob, Blob> GetKeyAndIVFromPassword(RCString password, const uint8_t salt[8], int nRounds); // don't set default value for nRound
-#if UCFG_USE_OPENSSL
 	Blob Encrypt(RCSpan cbuf) override;
 	Blob Decrypt(RCSpan cbuf) override;
-#endif
+
+	// Into a caller-provided buffer, dst may be cbuf.data(). Encrypt() needs cbuf.size()+16 bytes in dst when padding. Return the output size
+	// OFB and CTR are stream modes: no padding, the output is as long as the input
+	size_t Encrypt(RCSpan cbuf, uint8_t *dst);
+	size_t Decrypt(RCSpan cbuf, uint8_t *dst);
+
+	void put_Key(RCSpan key) override;				// also builds the key schedule, so Encrypt/Decrypt only read the object
 protected:
 	void InitParams() override {
 		switch (KeySize) {
@@ -97,14 +102,117 @@ protected:
 		}
 	}
 
-#if !UCFG_USE_OPENSSL
 	Blob CalcExpandedKey() const override;
 	Blob CalcInvExpandedKey() const override;
-#endif // !UCFG_USE_OPENSSL
 	void EncryptBlock(RCSpan ekey, uint8_t* data) override;
 	void DecryptBlock(RCSpan ekey, uint8_t* data) override;
 private:
+	struct KeySchedule {
+		Blob EKey, InvEKey;								// for EncDec()
+		DECLSPEC_ALIGN(16) uint8_t Enc[15][16];			// AES-NI round keys
+		DECLSPEC_ALIGN(16) uint8_t Dec[15][16];
+		int Rounds;
+	} m_sched;
+
+	void PrepareKey();
+	void CheckKey() const;
+	void StreamCrypt(RCSpan cbuf, uint8_t *dst);
+	void EncryptBlocks(const uint8_t *src, uint8_t *dst, size_t n);
+	void DecryptBlocks(const uint8_t *src, uint8_t *dst, size_t n);
+	void CtrCrypt(uint8_t ctr[16], const uint8_t *src, uint8_t *dst, size_t size, bool bInc32 = false);
 	void EncDec(RCSpan ekey, uint32_t* data, const uint8_t subTable[256], uint32_t (*pfnMixColumn)(uint32_t));
+
+	friend class AesGcm;
+};
+
+// AES-GCM (NIST SP 800-38D) with 128-bit tag
+class AesGcm {
+public:
+	explicit AesGcm(RCSpan key);
+
+	void Encrypt(RCSpan iv, RCSpan aad, RCSpan plain, uint8_t *dst, uint8_t tag[16]);
+	void Decrypt(RCSpan iv, RCSpan aad, RCSpan cbuf, const uint8_t tag[16], uint8_t *dst);		// throws ExtErr::Crypto on tag mismatch
+	Blob Encrypt(RCSpan iv, RCSpan aad, RCSpan plain);		// ciphertext || tag
+	Blob Decrypt(RCSpan iv, RCSpan aad, RCSpan cbuf);
+private:
+	Aes m_aes;
+	DECLSPEC_ALIGN(16) uint8_t m_h[16];
+
+	void InitCounter(RCSpan iv, uint8_t j0[16]);
+	void Ghash(uint8_t y[16], RCSpan data) const;
+	void CalcTag(const uint8_t j0[16], RCSpan aad, RCSpan cbuf, uint8_t tag[16]);
+};
+
+// Salsa20 / ChaCha20 keystream XORed into the data, so Crypt() both encrypts and decrypts, in place when dst == src.
+// Successive Crypt() calls continue the stream
+class StreamCipher {
+public:
+	virtual ~StreamCipher() {}
+
+	void Crypt(const uint8_t *src, uint8_t *dst, size_t size);
+	Blob Crypt(RCSpan cbuf);
+	void Seek(uint64_t pos);							// byte offset from the initial counter
+protected:
+	DECLSPEC_ALIGN(16) uint32_t m_state[16];
+	uint8_t m_ks[64];									// keystream of the block before m_state's counter
+	size_t m_ksPos;										// used bytes of m_ks
+	uint64_t m_counter0;
+	int m_rounds;
+	int m_idxCounter;									// index of the counter's low word in m_state
+	bool m_bCounter64;
+
+	StreamCipher(int idxCounter, bool bCounter64, int rounds);
+
+	uint64_t GetCounter() const;
+	void SetCounter(uint64_t counter);
+	virtual void XorBlocks(const uint8_t *src, uint8_t *dst, size_t n) = 0;		// n whole blocks, advances the counter
+};
+
+class Salsa20 : public StreamCipher {
+public:
+	Salsa20(RCSpan key, RCSpan nonce, int rounds = 20);	// 16- or 32-byte key, 8-byte nonce
+protected:
+	void XorBlocks(const uint8_t *src, uint8_t *dst, size_t n) override;
+};
+
+class ChaCha20 : public StreamCipher {
+public:
+	// 32-byte key; 12-byte nonce with 32-bit counter (RFC 8439) or 8-byte nonce with 64-bit counter (original ChaCha)
+	ChaCha20(RCSpan key, RCSpan nonce, uint32_t counter = 0, int rounds = 20);
+protected:
+	void XorBlocks(const uint8_t *src, uint8_t *dst, size_t n) override;
+};
+
+// One-time authenticator of RFC 8439
+class Poly1305 {
+public:
+	explicit Poly1305(const uint8_t key[32]);
+	Poly1305& Update(RCSpan s);
+	void PadTo16();										// zero bytes up to the 16-byte boundary of the data so far
+	void Final(uint8_t tag[16]);
+private:
+#if UCFG_64
+	uint64_t m_r[3], m_h[3], m_pad[2];					// 44+44+42-bit limbs
+#else
+	uint32_t m_r[5], m_h[5], m_pad[4];					// 26-bit limbs
+#endif
+	uint8_t m_buf[16];
+	size_t m_cbBuf;
+
+	void Blocks(const uint8_t *p, size_t n, bool bFull);	// bFull: add 2^128, false for the padded last block
+};
+
+// ChaCha20-Poly1305 AEAD (RFC 8439), 12-byte nonce, 128-bit tag
+class ChaCha20Poly1305 {
+public:
+	explicit ChaCha20Poly1305(RCSpan key);
+
+	void Encrypt(RCSpan nonce, RCSpan aad, RCSpan plain, uint8_t *dst, uint8_t tag[16]);
+	void Decrypt(RCSpan nonce, RCSpan aad, RCSpan cbuf, const uint8_t tag[16], uint8_t *dst);		// throws ExtErr::Crypto on tag mismatch
+	Blob Encrypt(RCSpan nonce, RCSpan aad, RCSpan plain);		// ciphertext || tag
+	Blob Decrypt(RCSpan nonce, RCSpan aad, RCSpan cbuf);
+private:
+	uint8_t m_key[32];
 };
 
 
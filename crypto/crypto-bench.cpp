@@ -0,0 +1,351 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#include "hash.h"
+#include "cipher.h"
+#include "salsa20.h"
+#include "crypto-bench.h"
+
+namespace Ext { namespace Crypto {
+using namespace std::chrono;
+
+static const size_t s_benchSizes[] = { 32, 64, 256, 1024, 4096, 16384, 65536, 256 * 1024, 1 << 20, 4 << 20, 16 << 20 };
+
+static const size_t
+	BENCH_LANES_MAX_SIZE = 1 << 20,			// per-lane cap of multi-lane cases
+	BENCH_CORE_LANES_MAX_SIZE = 65536;		// word-sliced cores read lanes*size contiguous bytes
+
+static const char *LaneVariant(int lanes) {
+	switch (lanes) {
+	case 3: return "3-lane";
+	case 4: return "4-lane";
+	case 8: return "8-lane";
+	default: return "16-lane";
+	}
+}
+
+static void LanePtrs(const uint8_t *p, int lanes, const uint8_t *msgs[]) {
+	for (int i = 0; i < lanes; ++i)
+		msgs[i] = p + i * CryptoBenchmark::LANE_STRIDE;
+}
+
+CryptoBenchmark::CryptoBenchmark()
+	: MinSeconds(0.3)
+	, MinSize(32)
+	, MaxSize(16 << 20)
+{}
+
+void CryptoBenchmark::AddCases(uint8_t *out) {
+	typedef std::shared_ptr<HashAlgorithm> PAlgo;
+	auto addHash = [this](const char *name, PAlgo algo) {
+		Case c = { name, "single", 1, 0, 0, [algo](const uint8_t *p, size_t size) { algo->ComputeHash(Span(p, size)); } };
+		m_cases.push_back(c);
+	};
+	auto add = [this](const char *name, const char *variant, int lanes, size_t maxSize, std::function<void(const uint8_t *p, size_t size)> fn) {
+		Case c = { name, variant, lanes, 0, maxSize, fn };
+		m_cases.push_back(c);
+	};
+	auto addFixed = [this](const char *name, const char *variant, int lanes, size_t size, std::function<void(const uint8_t *p, size_t size)> fn) {
+		Case c = { name, variant, lanes, size, 0, fn };
+		m_cases.push_back(c);
+	};
+
+	addHash("SHA-256", std::make_shared<SHA256>());
+	for (int lanes = 4; lanes <= SHA256::NWayLanes(); lanes *= 2)
+		add("SHA-256", LaneVariant(lanes), lanes, BENCH_LANES_MAX_SIZE, [lanes](const uint8_t *p, size_t size) {
+			const uint8_t *msgs[16];
+			DECLSPEC_ALIGN(64) uint32_t state[8 * 16];
+			LanePtrs(p, lanes, msgs);
+			SHA256::HashNWay(state, msgs, size, lanes, lanes);
+		});
+
+	addHash("SHA-512", std::make_shared<SHA512>());
+
+	std::shared_ptr<Groestl512Hash> groestl = std::make_shared<Groestl512Hash>();
+	addHash("Groestl-512", groestl);
+	add("Groestl-512", "batch16", 16, BENCH_LANES_MAX_SIZE, [groestl, out](const uint8_t *p, size_t size) {
+		const uint8_t *msgs[16];
+		LanePtrs(p, 16, msgs);
+		groestl->ComputeHashes((uint8_t(*)[64])out, msgs, size, 16);
+	});
+
+	std::shared_ptr<Blake256> blake256 = std::make_shared<Blake256>();
+	addHash("Blake-256", blake256);
+	add("Blake-256", "batch16", 16, BENCH_LANES_MAX_SIZE, [blake256, out](const uint8_t *p, size_t size) {
+		const uint8_t *msgs[16];
+		LanePtrs(p, 16, msgs);
+		blake256->ComputeHashes((uint8_t(*)[32])out, msgs, size, 16);
+	});
+	std::shared_ptr<Blake512> blake512 = std::make_shared<Blake512>();
+	addHash("Blake-512", blake512);
+	add("Blake-512", "batch8", 8, BENCH_LANES_MAX_SIZE, [blake512, out](const uint8_t *p, size_t size) {
+		const uint8_t *msgs[8];
+		LanePtrs(p, 8, msgs);
+		blake512->ComputeHashes((uint8_t(*)[64])out, msgs, size, 8);
+	});
+
+	addHash("RIPEMD-160", std::make_shared<RIPEMD160>());
+	for (int lanes = 4; lanes <= RIPEMD160::NWayLanes(); lanes *= 2)
+		add("RIPEMD-160", LaneVariant(lanes), lanes, BENCH_LANES_MAX_SIZE, [lanes](const uint8_t *p, size_t size) {		// compression only, as the transposition is the caller's
+			const uint8_t *msgs[16];
+			DECLSPEC_ALIGN(64) uint32_t state[5 * 16], data[16 * 16];
+			LanePtrs(p, lanes, msgs);
+			RIPEMD160::InitNWay(state, lanes);
+			for (size_t off = 0; off + 64 <= size; off += 64) {
+				for (int k = 0; k < lanes; ++k)
+					for (int j = 0; j < 16; ++j)
+						data[j * lanes + k] = GetLeUInt32(msgs[k] + off + j * 4);
+				RIPEMD160::UpdateNWay(state, data, lanes);
+			}
+		});
+
+	add("Hash160", "single", 1, 0, [out](const uint8_t *p, size_t size) {
+		Hash160(out, Span(p, size));
+	});
+	add("Hash160", "batch16", 16, BENCH_LANES_MAX_SIZE, [out](const uint8_t *p, size_t size) {
+		const uint8_t *msgs[16];
+		LanePtrs(p, 16, msgs);
+		Hash160Many((uint8_t(*)[20])out, msgs, size, 16);
+	});
+
+	std::shared_ptr<SipHash2_4> sip = std::make_shared<SipHash2_4>(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+	add("SipHash-2-4", "single", 1, 0, [sip, out](const uint8_t *p, size_t size) {
+		*(uint64_t*)out = sip->Hash(Span(p, size));
+	});
+	add("SipHash-2-4", "batch8", 8, BENCH_LANES_MAX_SIZE, [sip, out](const uint8_t *p, size_t size) {
+		const uint8_t *msgs[8];
+		LanePtrs(p, 8, msgs);
+		sip->HashMany((uint64_t*)out, msgs, size, 8);
+	});
+
+	add("CRC-32", "single", 1, 0, [out](const uint8_t *p, size_t size) {
+		*(uint32_t*)out = Crc32Update(0, Span(p, size));
+	});
+	add("CRC-32C", "single", 1, 0, [out](const uint8_t *p, size_t size) {
+		*(uint32_t*)out = Crc32cUpdate(0, Span(p, size));
+	});
+
+	add("Salsa20", "core", 1, 0, [out](const uint8_t *p, size_t size) {
+		for (size_t off = 0; off + 64 <= size; off += 64)
+			Salsa20Core((uint32_t*)out, (const uint32_t*)(p + off));
+	});
+	add("ChaCha20", "core", 1, 0, [out](const uint8_t *p, size_t size) {
+		for (size_t off = 0; off + 64 <= size; off += 64)
+			ChaCha20Core((uint32_t*)out, (const uint32_t*)(p + off));
+	});
+#if UCFG_CPU_X86_X64
+	add("Salsa20", "4-lane", 4, BENCH_CORE_LANES_MAX_SIZE, [out](const uint8_t *p, size_t size) {
+		for (size_t off = 0; off + 64 <= size; off += 64)
+			SalsaCoreLanes<__m128i>((__m128i*)out, (const __m128i*)(p + off * 4), 20);
+	});
+	add("ChaCha20", "4-lane", 4, BENCH_CORE_LANES_MAX_SIZE, [out](const uint8_t *p, size_t size) {
+		for (size_t off = 0; off + 64 <= size; off += 64)
+			ChaChaCoreLanes<__m128i>((__m128i*)out, (const __m128i*)(p + off * 4), 20);
+	});
+	if (CpuInfo().Features.AVX2) {
+		add("Salsa20", "8-lane", 8, BENCH_CORE_LANES_MAX_SIZE, [out](const uint8_t *p, size_t size) {
+			for (size_t off = 0; off + 64 <= size; off += 64)
+				SalsaCoreLanes<__m256i>((__m256i*)out, (const __m256i*)(p + off * 8), 20);
+		});
+		add("ChaCha20", "8-lane", 8, BENCH_CORE_LANES_MAX_SIZE, [out](const uint8_t *p, size_t size) {
+			for (size_t off = 0; off + 64 <= size; off += 64)
+				ChaChaCoreLanes<__m256i>((__m256i*)out, (const __m256i*)(p + off * 8), 20);
+		});
+	}
+#endif
+
+	addFixed("scrypt", "single", 1, 80, [](const uint8_t *p, size_t size) {
+		CalcSCryptHash(Span(p, size));
+	});
+	addFixed("scrypt", LaneVariant(3), 3, 80, [](const uint8_t *p, size_t size) {
+		CalcSCryptHash_80_3way((const uint32_t*)p);
+	});
+	addFixed("NeoScrypt", "single", 1, 80, [](const uint8_t *p, size_t size) {
+		CalcNeoSCryptHash(Span(p, size));
+	});
+	addFixed("NeoScrypt", "batch8", 8, 80, [](const uint8_t *p, size_t size) {
+		vector<Span> passwords;
+		for (int i = 0; i < 8; ++i)
+			passwords.push_back(Span(p + i * LANE_STRIDE, size));
+		CalcNeoSCryptHashes(passwords);
+	});
+
+	uint8_t key[32];
+	for (int i = 0; i < 32; ++i)
+		key[i] = uint8_t(i);
+	struct AesModeCase {
+		const char *Variant;
+		CipherMode Mode;
+		bool Decrypt;
+	} aesModes[] = {
+		{ "ECB-enc", CipherMode::ECB, false },
+		{ "CBC-enc", CipherMode::CBC, false },
+		{ "CBC-dec", CipherMode::CBC, true },
+		{ "CFB-dec", CipherMode::CFB, true },
+		{ "CTR", CipherMode::CTR, false },
+	};
+	for (size_t i = 0; i < _countof(aesModes); ++i) {
+		std::shared_ptr<Aes> aes = std::make_shared<Aes>();
+		aes->Key = Span(key, sizeof key);
+		aes->IV = Blob(0, 16);
+		aes->Mode = aesModes[i].Mode;
+		aes->Padding = PaddingMode::None;
+		bool bDecrypt = aesModes[i].Decrypt;
+		add("AES-256", aesModes[i].Variant, 1, 0, [aes, bDecrypt, out](const uint8_t *p, size_t size) {
+			if (bDecrypt)
+				aes->Decrypt(Span(p, size), out);
+			else
+				aes->Encrypt(Span(p, size), out);
+		});
+	}
+	std::shared_ptr<AesGcm> gcm = std::make_shared<AesGcm>(Span(key, sizeof key));
+	add("AES-256", "GCM-enc", 1, 0, [gcm, out](const uint8_t *p, size_t size) {
+		uint8_t iv[12] = { 0 }, tag[16];
+		gcm->Encrypt(Span(iv, sizeof iv), Span(), Span(p, size), out, tag);
+	});
+}
+
+void CryptoBenchmark::WriteBuild(JsonTextWriter& w) {
+	JsonWriterObject jwo(w, "build");
+#if defined(_MSC_FULL_VER)
+	w.Write("compiler", String(EXT_STR("msvc " << _MSC_FULL_VER)));
+#elif defined(__clang__)
+	w.Write("compiler", String("clang " __clang_version__));
+#elif defined(__GNUC__)
+	w.Write("compiler", String("gcc " __VERSION__));
+#endif
+	w.Write("x64", bool(UCFG_64));
+#ifdef _DEBUG
+	w.Write("debug", true);
+#else
+	w.Write("debug", false);
+#endif
+	w.Write("masm", bool(UCFG_USE_MASM));
+	w.Write("openssl", bool(UCFG_USE_OPENSSL));
+	w.Write("imp_groestl", String(std::string(1, char(UCFG_IMP_GROESTL))));
+	w.Write("imp_sha3", String(std::string(1, char(UCFG_IMP_SHA3))));
+}
+
+void CryptoBenchmark::WriteCpu(JsonTextWriter& w) {
+	JsonWriterObject jwo(w, "cpu");
+#if UCFG_CPU_X86_X64
+	w.Write("vendor", String(CpuInfo().Vendor.Name));
+#	if UCFG_FRAMEWORK
+	w.Write("name", CpuInfo().Name);
+#	endif
+	const CpuInfo::FeatureInfo& f = CpuInfo().Features;
+	{
+		JsonWriterArray jwa(w, "features");
+		struct {
+			const char *Name;
+			bool Present;
+		} features[] = {
+			{ "sse2", f.SSE2 }, { "ssse3", f.SSSE3 }, { "sse4.1", f.SSE41 }, { "sse4.2", f.SSE42 }, { "aes", f.AES }, { "pclmulqdq", f.PCLMULQDQ },
+			{ "avx", f.AVX }, { "avx2", f.AVX2 }, { "bmi2", f.BMI2 }, { "sha", f.SHA },
+			{ "avx512f", f.AVX512F }, { "avx512bw", f.AVX512BW }, { "avx512vl", f.AVX512VL }, { "vaes", f.VAES }, { "vpclmulqdq", f.VPCLMULQDQ },
+		};
+		for (size_t i = 0; i < _countof(features); ++i)
+			if (features[i].Present)
+				w.Write(String(features[i].Name));
+	}
+	w.Write("tier", String(CpuInfo::TierName(f.Tier)));
+
+	steady_clock::time_point t0 = steady_clock::now();			// TSC rate, to convert cycles_per_byte into time
+	uint64_t tsc0 = __rdtsc();
+	while (steady_clock::now() - t0 < milliseconds(50))
+		;
+	double dt = duration<double>(steady_clock::now() - t0).count();
+	w.Write("tsc_ghz", double(__rdtsc() - tsc0) / dt / 1e9);
+#endif
+	w.Write("threads", int(thread::hardware_concurrency()));
+}
+
+void CryptoBenchmark::Measure(JsonTextWriter& w, const Case& c, const uint8_t *p, size_t size) {
+	c.Func(p, size);													// warm-up: lazy tables, page faults
+	double runSeconds = MinSeconds / 3;
+	uint64_t calls = 1;
+	for (;;) {
+		steady_clock::time_point t0 = steady_clock::now();
+		for (uint64_t i = 0; i < calls; ++i)
+			c.Func(p, size);
+		double dt = duration<double>(steady_clock::now() - t0).count();
+		if (dt >= runSeconds / 8) {
+			calls = (max)(calls, uint64_t(calls * runSeconds / dt));
+			break;
+		}
+		calls *= 8;
+	}
+	double best = 1e300, bestTsc = 0;
+	for (int run = 0; run < 3; ++run) {
+#if UCFG_CPU_X86_X64
+		uint64_t tsc0 = __rdtsc();
+#endif
+		steady_clock::time_point t0 = steady_clock::now();
+		for (uint64_t i = 0; i < calls; ++i)
+			c.Func(p, size);
+		double dt = duration<double>(steady_clock::now() - t0).count();
+		if (dt < best) {
+			best = dt;
+#if UCFG_CPU_X86_X64
+			bestTsc = double(__rdtsc() - tsc0);
+#endif
+		}
+	}
+	double bytes = double(size) * c.Lanes * calls;
+
+	JsonWriterObject jwo(w);
+	w.Write("algorithm", String(c.Algorithm));
+	w.Write("variant", String(c.Variant));
+	w.Write("lanes", c.Lanes);
+	w.Write("size", int(size));
+	w.Write("calls", double(calls));
+	w.Write("ns_per_call", best * 1e9 / calls);
+	w.Write("mb_per_s", bytes / best / 1e6);
+	if (bestTsc)
+		w.Write("cycles_per_byte", bestTsc / bytes);
+}
+
+void CryptoBenchmark::Run(std::ostream& os) {
+	size_t cbBuf = (max)(MaxSize, 8 * (min)(MaxSize, BENCH_CORE_LANES_MAX_SIZE)) + 16 * LANE_STRIDE + 80;
+	AlignedMem memIn(cbBuf, 64), memOut(cbBuf + 64, 64);
+	uint8_t *in = (uint8_t*)memIn.get(), *out = (uint8_t*)memOut.get();
+	Crypto::Random().NextBytes(span<uint8_t>(in, cbBuf));
+	m_cases.clear();
+	AddCases(out);
+
+	JsonTextWriter w(os);
+	{
+		JsonWriterObject jwo(w);
+		w.Write("schema", 1);
+		WriteBuild(w);
+		WriteCpu(w);
+		{
+			JsonWriterObject jwk(w, "kernels");
+			vector<pair<String, String>> kernels = CpuDispatch::Kernels();
+			for (size_t i = 0; i < kernels.size(); ++i)
+				w.Write(kernels[i].first, kernels[i].second);
+		}
+		JsonWriterArray jwa(w, "results");
+		for (size_t i = 0; i < m_cases.size(); ++i) {
+			const Case& c = m_cases[i];
+			if (!Filter.empty() && !String(EXT_STR(c.Algorithm << "/" << c.Variant)).Contains(Filter))
+				continue;
+			if (c.FixedSize) {
+				Measure(w, c, in, c.FixedSize);
+				continue;
+			}
+			for (size_t j = 0; j < _countof(s_benchSizes); ++j) {
+				size_t cb = s_benchSizes[j];
+				if (cb >= MinSize && cb <= MaxSize && (!c.MaxSize || cb <= c.MaxSize))
+					Measure(w, c, in, cb);
+			}
+		}
+	}
+	os << endl;
+}
+
+}} // Ext::Crypto::
@@ -0,0 +1,42 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#pragma once
+
+#include <el/comp/json-writer.h>
+
+namespace Ext { namespace Crypto {
+
+// Throughput of the hash and cipher implementations compiled into this build, as JSON:
+//	{ "schema": 1, "build": {...}, "cpu": {...}, "kernels": { primitive: kernel }, "results": [ { "algorithm", "variant", "lanes", "size", "mb_per_s", "cycles_per_byte", "ns_per_call", "calls" }, ... ] }
+// "size" is the message size per lane; cycles are TSC ticks, so they compare builds on one machine rather than CPUs with different clocks
+class CryptoBenchmark {
+public:
+	double MinSeconds;					// per result, the best of 3 runs of at least MinSeconds/3 each
+	size_t MinSize, MaxSize;			// message sizes: 32, 64, 256, ... 16M within [MinSize, MaxSize]
+	String Filter;						// substring of "algorithm/variant", empty for all
+
+	CryptoBenchmark();
+	void Run(std::ostream& os);
+
+	struct Case {
+		const char *Algorithm, *Variant;
+		int Lanes;						// messages per call, at p + i*LANE_STRIDE
+		size_t FixedSize;				// non-zero for KDFs with a fixed input size
+		size_t MaxSize;					// cap per lane, 0 for none
+		std::function<void(const uint8_t *p, size_t size)> Func;
+	};
+
+	static const size_t LANE_STRIDE = 64;
+private:
+	vector<Case> m_cases;
+
+	void AddCases(uint8_t *out);
+	void WriteBuild(JsonTextWriter& w);
+	void WriteCpu(JsonTextWriter& w);
+	void Measure(JsonTextWriter& w, const Case& c, const uint8_t *p, size_t size);
+};
+
+}} // Ext::Crypto::
@@ -7,6 +7,7 @@
 
 #include <el/num/num.h>
 
+#include "hash.h"
 #include "ecdsa.h"
 
 #ifdef _AFXDLL
@@ -100,6 +101,27 @@ static inline EC_KEY *ToEcKey(const CngKey &ck) {
 	return EVP_PKEY_get0_EC_KEY((EVP_PKEY *) ck.m_pimpl);
 }
 
+// secp256k1 group shared by the parsed public keys, with the generator multiples precomputed once
+static EC_GROUP *Secp256k1Group() {
+	static EC_GROUP *s_group = [] {
+		EC_GROUP *group = ::EC_GROUP_new_by_curve_name(NID_secp256k1);
+		SslCheck(group);
+		SslCheck(::EC_GROUP_precompute_mult(group, 0));
+		return group;
+	}();
+	return s_group;
+}
+
+static EC_KEY *ParsePubKey(RCSpan pubKey) {			// nullptr if the point is invalid
+	EC_KEY *key = ::EC_KEY_new();
+	SslCheck(key);
+	const uint8_t *p = pubKey.data();
+	if (::EC_KEY_set_group(key, Secp256k1Group()) && ::o2i_ECPublicKey(&key, &p, long(pubKey.size())))
+		return key;
+	::EC_KEY_free(key);
+	return nullptr;
+}
+
 /*!!!
 CngKey::CngKey() {
 	m_pimpl = ::EC_KEY_new_by_curve_name(NID_secp256k1);
@@ -122,9 +144,10 @@ CngKey& CngKey::operator=(const CngKey& key) {
 			::EVP_PKEY_free(ToKey(_self));
 			m_pimpl = 0;
 		}
-		auto pFromKey = ToKey(key);
-		SslCheck(::EVP_PKEY_up_ref(pFromKey));
-		m_pimpl = pFromKey;
+		if (auto pFromKey = ToKey(key)) {
+			SslCheck(::EVP_PKEY_up_ref(pFromKey));
+			m_pimpl = pFromKey;
+		}
 	}
 	/*!!!
 
@@ -140,6 +163,16 @@ CngKey& CngKey::operator=(const CngKey& key) {
 	return _self;
 }
 
+static Blob PubKeyToBlob(const EC_KEY *key, point_conversion_form_t form) {
+	const EC_GROUP *group = ::EC_KEY_get0_group(key);
+	const EC_POINT *point = ::EC_KEY_get0_public_key(key);
+	size_t size = ::EC_POINT_point2oct(group, point, form, 0, 0, 0);
+	SslCheck(size);
+	Blob r(0, size);
+	SslCheck(::EC_POINT_point2oct(group, point, form, r.data(), size, 0) == size);
+	return r;
+}
+
 Blob CngKey::Export(CngKeyBlobFormat format) const {
 	EVP_PKEY* key = ToKey(_self);
 	Blob r;
@@ -168,18 +201,10 @@ Blob CngKey::Export(CngKeyBlobFormat format) const {
 		SslCheck(::i2d_PublicKey(key, &(buf = r.data())) == size);
 		break;
 	case CngKeyBlobFormat::OSslEccPublicCompressedBlob:
-		{
-			CngKey tmp = _self;
-			::EC_KEY_set_conv_form(ToEcKey(tmp), POINT_CONVERSION_COMPRESSED);
-			r = tmp.Export(CngKeyBlobFormat::OSslEccPublicBlob);
-		}
+		r = PubKeyToBlob(ToEcKey(_self), POINT_CONVERSION_COMPRESSED);		// keys may be shared through EcPubKeyCache, so don't change their conversion form
 		break;
 	case CngKeyBlobFormat::OSslEccPublicUncompressedBlob:
-		{
-			CngKey tmp = _self;
-			::EC_KEY_set_conv_form(ToEcKey(tmp), POINT_CONVERSION_UNCOMPRESSED);
-			r = tmp.Export(CngKeyBlobFormat::OSslEccPublicBlob);
-		}
+		r = PubKeyToBlob(ToEcKey(_self), POINT_CONVERSION_UNCOMPRESSED);
 		break;
 	case CngKeyBlobFormat::OSslEccPrivateCompressedBlob:
 		{
@@ -221,18 +246,13 @@ CngKey CngKey::Import(RCSpan mb, CngKeyBlobFormat format) {
 		}
 		break;
 	case CngKeyBlobFormat::OSslEccPublicBlob:
-		//!!!SslCheck(impl = ::d2i_PublicKey(EVP_PKEY_EC, &impl, &p, mb.m_len));
-		r = CngKey(impl = ::EVP_PKEY_new());
-		SslCheck(ec_key = ::EC_KEY_new_by_curve_name(NID_secp256k1));
-		SslCheck(::o2i_ECPublicKey(&ec_key, &p, mb.size()));
-		SslCheck(::EVP_PKEY_assign_EC_KEY(impl, ec_key));
-		break;
 	case CngKeyBlobFormat::OSslEccPublicCompressedBlob:
+		//!!!SslCheck(impl = ::d2i_PublicKey(EVP_PKEY_EC, &impl, &p, mb.m_len));
 		r = CngKey(impl = ::EVP_PKEY_new());
-		SslCheck(ec_key = ::EC_KEY_new_by_curve_name(NID_secp256k1));
-		SslCheck(::o2i_ECPublicKey(&ec_key, &p, mb.size()));
+		SslCheck(ec_key = ParsePubKey(mb));
 		SslCheck(::EVP_PKEY_assign_EC_KEY(impl, ec_key));
-		::EC_KEY_set_conv_form(ec_key, POINT_CONVERSION_COMPRESSED);
+		if (format == CngKeyBlobFormat::OSslEccPublicCompressedBlob)
+			::EC_KEY_set_conv_form(ec_key, POINT_CONVERSION_COMPRESSED);
 		break;
 	default:
 		Throw(errc::invalid_argument);
@@ -279,6 +299,194 @@ ptr<Dsa> CreateECDsa() {
 	return new ECDsa;
 }
 
+EcPubKeyCache::EcPubKeyCache(size_t maxSize) {
+	for (int i = 0; i < SHARDS; ++i)
+		m_shards[i].Map.SetMaxSize((max)(maxSize / SHARDS + 1, size_t(2)));		// LruMap evicts on reaching its max size, so it holds max - 1 entries
+}
+
+void EcPubKeyCache::Clear() {
+	for (int i = 0; i < SHARDS; ++i)
+		EXT_LOCK (m_shards[i].Mtx) {
+			m_shards[i].Map.clear();
+		}
+}
+
+CngKey EcPubKeyCache::Get(RCSpan pubKey) {
+	Blob key = pubKey;
+	Shard& shard = m_shards[std::hash<Blob>()(key) % SHARDS];
+	EXT_LOCK (shard.Mtx) {
+		auto it = shard.Map.find(key);
+		if (it != shard.Map.end())
+			return it->second.first;
+	}
+	CngKey r;
+	if (EC_KEY *ecKey = ParsePubKey(pubKey)) {			// invalid points are cached as empty keys
+		EVP_PKEY *impl = ::EVP_PKEY_new();
+		r = CngKey(impl);
+		SslCheck(impl && ::EVP_PKEY_assign_EC_KEY(impl, ecKey));
+	}
+	EXT_LOCK (shard.Mtx) {
+		shard.Map.insert(make_pair(key, r));
+	}
+	return r;
+}
+
+ECDsaVerifier::ECDsaVerifier(size_t cacheSize, int nThreads)
+	: m_cache((max)(cacheSize, size_t(2)))
+	, m_job(0)
+	, m_jobSize(0)
+	, m_nBusy(0)
+	, m_next(0)
+	, m_generation(0)
+	, m_bStop(false)
+{
+	Random().NextBytes(span<uint8_t>((uint8_t*)m_sipKey, sizeof m_sipKey));
+	ClearCache();
+	if (nThreads <= 0)
+		nThreads = (max)(int(thread::hardware_concurrency()), 1);
+	for (int i = 1; i < nThreads; ++i)							// the calling thread is a worker too
+		m_threads.push_back(thread(&ECDsaVerifier::WorkerLoop, this));
+}
+
+ECDsaVerifier::~ECDsaVerifier() {
+	EXT_LOCK (m_mtx) {
+		m_bStop = true;
+	}
+	m_cvWork.notify_all();
+	for (size_t i = 0; i < m_threads.size(); ++i)
+		m_threads[i].join();
+}
+
+void ECDsaVerifier::ClearCache() {
+	for (size_t i = 0; i < m_cache.size(); ++i) {
+		m_cache[i].Hash.store(0, memory_order_relaxed);
+		m_cache[i].Check.store(0, memory_order_relaxed);
+	}
+}
+
+ECDsaVerifier::CacheFingerprint ECDsaVerifier::Fingerprint(const Item& item) const {
+	uint32_t lens[2] = { htole(uint32_t(item.PubKey.size())), htole(uint32_t(item.Hash.size())) };
+	Blob buf = Span((const uint8_t*)lens, sizeof lens) + item.PubKey + item.Hash + item.Signature;
+	SipHash2_4 sipHash(m_sipKey[0], m_sipKey[1]), sipCheck(m_sipKey[2], m_sipKey[3]);
+	return CacheFingerprint(sipHash.Hash(buf) | 1, sipCheck.Hash(buf));			// Hash == 0 marks an empty slot
+}
+
+bool ECDsaVerifier::CacheLookup(const CacheFingerprint& fp) const {
+	size_t n = m_cache.size();
+	for (int k = 0; k < 2; ++k) {
+		const CacheSlot& slot = m_cache[size_t((k ? fp.first >> 32 : fp.first) % n)];
+		if (slot.Hash.load(memory_order_relaxed) == fp.first && slot.Check.load(memory_order_relaxed) == fp.second)		// a torn slot holds halves of two verified fingerprints, matching it is still a 128-bit collision
+			return true;
+	}
+	return false;
+}
+
+void ECDsaVerifier::CacheInsert(const CacheFingerprint& fp) {
+	size_t n = m_cache.size(), i = size_t(fp.first % n);
+	if (m_cache[i].Hash.load(memory_order_relaxed))
+		i = size_t((fp.first >> 32) % n);
+	m_cache[i].Hash.store(fp.first, memory_order_relaxed);
+	m_cache[i].Check.store(fp.second, memory_order_relaxed);
+}
+
+bool ECDsaVerifier::IsCached(const Item& item) const {
+	return CacheLookup(Fingerprint(item));
+}
+
+void ECDsaVerifier::RunJob(const function<void(size_t)>& f, size_t n) {
+	for (size_t i; (i = m_next++) < n;)
+		f(i);
+}
+
+void ECDsaVerifier::WorkerLoop() {
+	for (uint64_t gen = 0;;) {
+		const function<void(size_t)> *job;
+		size_t n;
+		{
+			unique_lock<mutex> lk(m_mtx);
+			m_cvWork.wait(lk, [this, gen] { return m_bStop || m_generation != gen; });
+			if (m_bStop)
+				return;
+			gen = m_generation;
+			job = m_job;
+			n = m_jobSize;
+		}
+		RunJob(*job, n);
+		EXT_LOCK (m_mtx) {
+			if (!--m_nBusy)
+				m_cvDone.notify_all();
+		}
+	}
+}
+
+void ECDsaVerifier::ParallelFor(size_t n, const function<void(size_t)>& f) {
+	if (m_threads.empty() || n < 2) {
+		for (size_t i = 0; i < n; ++i)
+			f(i);
+		return;
+	}
+	EXT_LOCK (m_mtxBatch) {
+		EXT_LOCK (m_mtx) {
+			m_job = &f;
+			m_jobSize = n;
+			m_next = 0;
+			m_nBusy = m_threads.size();
+			++m_generation;
+		}
+		m_cvWork.notify_all();
+		RunJob(f, n);
+		unique_lock<mutex> lk(m_mtx);
+		m_cvDone.wait(lk, [this] { return !m_nBusy; });
+	}
+}
+
+vector<bool> ECDsaVerifier::Verify(const vector<Item>& items, bool bCache) {
+	size_t n = items.size();
+	vector<CacheFingerprint> fingerprints(n);
+	vector<uint8_t> ok(n);
+	vector<size_t> todo;
+	for (size_t i = 0; i < n; ++i)
+		if (!(ok[i] = CacheLookup(fingerprints[i] = Fingerprint(items[i]))))
+			todo.push_back(i);
+
+	vector<size_t> order(todo), keyOf(n);				// distinct public keys, each parsed once
+	sort(order.begin(), order.end(), [&items](size_t a, size_t b) {
+		RCSpan x = items[a].PubKey, y = items[b].PubKey;
+		int c = memcmp(x.data(), y.data(), (min)(x.size(), y.size()));
+		return c ? c < 0 : x.size() < y.size();
+	});
+	vector<size_t> keyItems;
+	for (size_t j = 0; j < order.size(); ++j) {
+		size_t i = order[j];
+		if (keyItems.empty() || !Equal(items[keyItems.back()].PubKey, items[i].PubKey))
+			keyItems.push_back(i);
+		keyOf[i] = keyItems.size() - 1;
+	}
+	vector<CngKey> keys(keyItems.size());
+	ParallelFor(keys.size(), [&](size_t k) {
+		try {
+			keys[k] = PubKeyCache.Get(items[keyItems[k]].PubKey);
+		} catch (...) {
+		}
+	});
+	ParallelFor(todo.size(), [&](size_t j) {
+		size_t i = todo[j];
+		const Item& item = items[i];
+		const CngKey& key = keys[keyOf[i]];
+		if (key.m_pimpl)
+			ok[i] = ::ECDSA_verify(0, item.Hash.data(), int(item.Hash.size()), item.Signature.data(), int(item.Signature.size()), ToEcKey(key)) == 1;
+		if (ok[i] && bCache)
+			CacheInsert(fingerprints[i]);
+	});
+	return vector<bool>(ok.begin(), ok.end());
+}
+
+bool ECDsaVerifier::Verify(RCSpan pubKey, RCSpan hash, RCSpan signature, bool bCache) {
+	Item item = { pubKey, hash, signature };
+	return Verify(vector<Item>(1, item), bCache)[0];
+}
+
+
 
 
 }} // Ext::Crypto
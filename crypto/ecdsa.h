@@ -1,5 +1,7 @@
 #pragma once
 
+#include EXT_HEADER_CONDITION_VARIABLE
+
 #include "sign.h"
 
 namespace Ext { namespace Crypto {
@@ -22,8 +24,19 @@ public:
 	{}
 
 	CngKey(const CngKey& key);
+
+	CngKey(CngKey&& key) noexcept
+		:	m_pimpl(exchange(key.m_pimpl, nullptr))
+	{}
+
 	~CngKey();
 	CngKey& operator=(const CngKey& key);
+
+	CngKey& operator=(CngKey&& key) noexcept {
+		std::swap(m_pimpl, key.m_pimpl);
+		return *this;
+	}
+
 	Blob Export(CngKeyBlobFormat format) const;
 	static CngKey AFXAPI Import(RCSpan mb, CngKeyBlobFormat format);
 protected:
@@ -33,6 +46,7 @@ protected:
 
 	friend class Dsa;
 	friend class ECDsa;
+	friend class EcPubKeyCache;
 };
 
 class Dsa : public DsaBase {
@@ -64,6 +78,69 @@ public:
 
 ptr<Dsa> CreateECDsa();
 
+// Bounded cache of parsed secp256k1 public keys by their serialized bytes; the keys share the precomputed group.
+// Hands out shared keys which must not be modified. Threads lock only the shard of the key
+class EcPubKeyCache {
+public:
+	explicit EcPubKeyCache(size_t maxSize = 4096);
+	CngKey Get(RCSpan pubKey);						// empty CngKey (null m_pimpl) if the point is invalid
+	void Clear();
+private:
+	static const int SHARDS = 16;
+
+	struct Shard {
+		mutex Mtx;
+		LruMap<Blob, CngKey> Map;
+	} m_shards[SHARDS];
+};
+
+// Verifies secp256k1 signatures in batches on a pool of worker threads. Public keys come from PubKeyCache.
+// Successes are remembered in a fixed-size table of salted 128-bit fingerprints (two independently keyed SipHashes), so a triple already checked (e.g. on mempool acceptance) is not verified again.
+// A hit is trusted without verifying: forging one needs a 128-bit collision under keys unknown to the attacker
+class ECDsaVerifier {
+public:
+	struct Item {
+		Span PubKey;			// compressed or uncompressed point
+		Span Hash;
+		Span Signature;			// DER
+	};
+
+	EcPubKeyCache PubKeyCache;
+
+	ECDsaVerifier(size_t cacheSize = 1 << 18, int nThreads = 0);		// nThreads == 0: all cores
+	~ECDsaVerifier();
+
+	bool Verify(RCSpan pubKey, RCSpan hash, RCSpan signature, bool bCache = true);
+	vector<bool> Verify(const vector<Item>& items, bool bCache = true);
+	bool IsCached(const Item& item) const;
+	void ClearCache();
+private:
+	typedef pair<uint64_t, uint64_t> CacheFingerprint;		// slot hash, check
+
+	struct CacheSlot {
+		atomic<uint64_t> Hash, Check;
+	};
+	vector<CacheSlot> m_cache;
+	uint64_t m_sipKey[4];
+
+	vector<thread> m_threads;
+	mutex m_mtxBatch;									// one batch at a time
+	mutex m_mtx;
+	condition_variable m_cvWork, m_cvDone;
+	const function<void(size_t)> *m_job;
+	size_t m_jobSize, m_nBusy;
+	atomic<size_t> m_next;
+	uint64_t m_generation;
+	bool m_bStop;
+
+	CacheFingerprint Fingerprint(const Item& item) const;
+	bool CacheLookup(const CacheFingerprint& fp) const;
+	void CacheInsert(const CacheFingerprint& fp);
+	void ParallelFor(size_t n, const function<void(size_t)>& f);
+	void RunJob(const function<void(size_t)>& f, size_t n);
+	void WorkerLoop();
+};
+
 
 }} // Ext::Crypto::
 
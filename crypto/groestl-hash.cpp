@@ -99,6 +99,40 @@ struct GroestlPQParams {
 static GroestlPQParams<128> s_groestl_p1024_params;
 static GroestlPQParams<128> s_groestl_q1024_params;
 
+#if UCFG_CPU_X86_X64
+
+static bool s_bHasAvx2Aes = s_bHasAesAndSsse3 && CpuInfo().Features.AVX2;
+static bool s_bHasAvx512Vaes = s_bHasAvx2Aes && CpuInfo().Features.AVX512F && CpuInfo().Features.AVX512BW && CpuInfo().Features.VAES;
+
+static CpuDispatch::Registration
+	s_regGroestl512("Groestl-512", s_bHasAesAndSsse3 ? "aes-ni" : UCFG_USE_MASM && UCFG_PLATFORM_X64 && s_bHasSse2 ? "sse2-asm" : "generic"),
+	s_regGroestl512Batch("Groestl-512 batch", s_bHasAvx512Vaes ? "avx512-vaes" : s_bHasAvx2Aes ? "avx2-aes" : "serial");
+
+// Each 128-bit slot of V carries its own P or Q permutation, so one pass of the AES-NI rounds serves several states
+template <class V>
+struct GroestlLaneParams {
+	V AesRoundConstants[14][8];
+	V ShuffleMasksAfterAes[8];
+};
+
+static GroestlLaneParams<__m256i> s_groestl_pq256, s_groestl_pp256;
+static GroestlLaneParams<__m512i> s_groestl_pq512, s_groestl_pp512;
+
+template <class V>
+static void CombineLaneParams(GroestlLaneParams<V>& r, const GroestlPQParams<128>& even, const GroestlPQParams<128>& odd) {
+	const int slots = sizeof(V) / sizeof(__m128i);
+	for (int slot = 0; slot < slots; ++slot) {
+		const GroestlPQParams<128>& params = slot & 1 ? odd : even;
+		for (int row = 0; row < 8; ++row) {
+			for (int round = 0; round < 14; ++round)
+				((__m128i*)&r.AesRoundConstants[round][row])[slot] = params.AesRoundConstants[round][row];
+			((__m128i*)&r.ShuffleMasksAfterAes[row])[slot] = params.ShuffleMasksAfterAes[row];
+		}
+	}
+}
+
+#endif // UCFG_CPU_X86_X64
+
 BytePermutation<128> Aes8Permutation()
 {
 	static const uint8_t aesPerm[128] = {
@@ -209,6 +243,10 @@ void InitGroestlTables() {
 		transposion.Apply((uint8_t*)s_groestl_p1024_params.AesRoundConstants[i], (const uint8_t*)s_groestl_p1024_params.RoundConstants[i]);
 		transposion.Apply((uint8_t*)s_groestl_q1024_params.AesRoundConstants[i], (const uint8_t*)s_groestl_q1024_params.RoundConstants[i]);
 	}
+	CombineLaneParams(s_groestl_pq256, s_groestl_p1024_params, s_groestl_q1024_params);
+	CombineLaneParams(s_groestl_pp256, s_groestl_p1024_params, s_groestl_p1024_params);
+	CombineLaneParams(s_groestl_pq512, s_groestl_p1024_params, s_groestl_q1024_params);
+	CombineLaneParams(s_groestl_pp512, s_groestl_p1024_params, s_groestl_p1024_params);
 #endif // UCFG_CPU_X86_X64
 
 	s_b = true;
@@ -277,17 +315,6 @@ static uint64_t MulColumnAsLe(uint64_t col) {		// returns Little-endian.
 
 #if UCFG_CPU_X86_X64
 
-/* xmm[i] will be multiplied by 2
-* xmm[j] will be lost
-* xmm[k] has to be all 0x1b */
-#define MUL2(i, j, k){\
-  j = _mm_xor_si128(j, j);\
-  j = _mm_cmpgt_epi8(j, i);\
-  i = _mm_add_epi8(i, i);\
-  j = _mm_and_si128(j, k);\
-  i = _mm_xor_si128(i, j);\
-}/**/
-
 /* Yet another implementation of MixBytes.
 This time we use the formulae (3) from the paper "Byte Slicing Groestl".
 Input: a0, ..., a7
@@ -309,96 +336,95 @@ K. Matusiewicz, 2011/05/29 */
   /* t_i = a_i + a_{i+1} */\
   b6 = a0;\
   b7 = a1;\
-  a0 = _mm_xor_si128(a0, a1);\
+  a0 = VXor(a0, a1);\
   b0 = a2;\
-  a1 = _mm_xor_si128(a1, a2);\
+  a1 = VXor(a1, a2);\
   b1 = a3;\
-  a2 = _mm_xor_si128(a2, a3);\
+  a2 = VXor(a2, a3);\
   b2 = a4;\
-  a3 = _mm_xor_si128(a3, a4);\
+  a3 = VXor(a3, a4);\
   b3 = a5;\
-  a4 = _mm_xor_si128(a4, a5);\
+  a4 = VXor(a4, a5);\
   b4 = a6;\
-  a5 = _mm_xor_si128(a5, a6);\
+  a5 = VXor(a5, a6);\
   b5 = a7;\
-  a6 = _mm_xor_si128(a6, a7);\
-  a7 = _mm_xor_si128(a7, b6);\
+  a6 = VXor(a6, a7);\
+  a7 = VXor(a7, b6);\
   \
   /* build y4 y5 y6 ... in regs xmm8, xmm9, xmm10 by adding t_i*/\
-  b0 = _mm_xor_si128(b0, a4);\
-  b6 = _mm_xor_si128(b6, a4);\
-  b1 = _mm_xor_si128(b1, a5);\
-  b7 = _mm_xor_si128(b7, a5);\
-  b2 = _mm_xor_si128(b2, a6);\
-  b0 = _mm_xor_si128(b0, a6);\
+  b0 = VXor(b0, a4);\
+  b6 = VXor(b6, a4);\
+  b1 = VXor(b1, a5);\
+  b7 = VXor(b7, a5);\
+  b2 = VXor(b2, a6);\
+  b0 = VXor(b0, a6);\
   /* spill values y_4, y_5 to memory */\
   TEMP0 = b0;\
-  b3 = _mm_xor_si128(b3, a7);\
-  b1 = _mm_xor_si128(b1, a7);\
+  b3 = VXor(b3, a7);\
+  b1 = VXor(b1, a7);\
   TEMP1 = b1;\
-  b4 = _mm_xor_si128(b4, a0);\
-  b2 = _mm_xor_si128(b2, a0);\
+  b4 = VXor(b4, a0);\
+  b2 = VXor(b2, a0);\
   /* save values t0, t1, t2 to xmm8, xmm9 and memory */\
   b0 = a0;\
-  b5 = _mm_xor_si128(b5, a1);\
-  b3 = _mm_xor_si128(b3, a1);\
+  b5 = VXor(b5, a1);\
+  b3 = VXor(b3, a1);\
   b1 = a1;\
-  b6 = _mm_xor_si128(b6, a2);\
-  b4 = _mm_xor_si128(b4, a2);\
+  b6 = VXor(b6, a2);\
+  b4 = VXor(b4, a2);\
   TEMP2 = a2;\
-  b7 = _mm_xor_si128(b7, a3);\
-  b5 = _mm_xor_si128(b5, a3);\
+  b7 = VXor(b7, a3);\
+  b5 = VXor(b5, a3);\
   \
   /* compute x_i = t_i + t_{i+3} */\
-  a0 = _mm_xor_si128(a0, a3);\
-  a1 = _mm_xor_si128(a1, a4);\
-  a2 = _mm_xor_si128(a2, a5);\
-  a3 = _mm_xor_si128(a3, a6);\
-  a4 = _mm_xor_si128(a4, a7);\
-  a5 = _mm_xor_si128(a5, b0);\
-  a6 = _mm_xor_si128(a6, b1);\
-  a7 = _mm_xor_si128(a7, TEMP2);\
+  a0 = VXor(a0, a3);\
+  a1 = VXor(a1, a4);\
+  a2 = VXor(a2, a5);\
+  a3 = VXor(a3, a6);\
+  a4 = VXor(a4, a7);\
+  a5 = VXor(a5, b0);\
+  a6 = VXor(a6, b1);\
+  a7 = VXor(a7, TEMP2);\
   \
-  /* compute z_i : double x_i using temp xmm8 and 1B xmm9 */\
+  /* compute z_i : double x_i */\
   /* compute w_i : add y_{i+4} */\
-  b1 = ALL_1B;\
-  MUL2(a0, b0, b1);\
-  a0 = _mm_xor_si128(a0, TEMP0);\
-  MUL2(a1, b0, b1);\
-  a1 = _mm_xor_si128(a1, TEMP1);\
-  MUL2(a2, b0, b1);\
-  a2 = _mm_xor_si128(a2, b2);\
-  MUL2(a3, b0, b1);\
-  a3 = _mm_xor_si128(a3, b3);\
-  MUL2(a4, b0, b1);\
-  a4 = _mm_xor_si128(a4, b4);\
-  MUL2(a5, b0, b1);\
-  a5 = _mm_xor_si128(a5, b5);\
-  MUL2(a6, b0, b1);\
-  a6 = _mm_xor_si128(a6, b6);\
-  MUL2(a7, b0, b1);\
-  a7 = _mm_xor_si128(a7, b7);\
+  a0 = VMul2(a0);\
+  a0 = VXor(a0, TEMP0);\
+  a1 = VMul2(a1);\
+  a1 = VXor(a1, TEMP1);\
+  a2 = VMul2(a2);\
+  a2 = VXor(a2, b2);\
+  a3 = VMul2(a3);\
+  a3 = VXor(a3, b3);\
+  a4 = VMul2(a4);\
+  a4 = VXor(a4, b4);\
+  a5 = VMul2(a5);\
+  a5 = VXor(a5, b5);\
+  a6 = VMul2(a6);\
+  a6 = VXor(a6, b6);\
+  a7 = VMul2(a7);\
+  a7 = VXor(a7, b7);\
   \
   /* compute v_i : double w_i      */\
   /* add to y_4 y_5 .. v3, v4, ... */\
-  MUL2(a0, b0, b1);\
-  b5 = _mm_xor_si128(b5, a0);\
-  MUL2(a1, b0, b1);\
-  b6 = _mm_xor_si128(b6, a1);\
-  MUL2(a2, b0, b1);\
-  b7 = _mm_xor_si128(b7, a2);\
-  MUL2(a5, b0, b1);\
-  b2 = _mm_xor_si128(b2, a5);\
-  MUL2(a6, b0, b1);\
-  b3 = _mm_xor_si128(b3, a6);\
-  MUL2(a7, b0, b1);\
-  b4 = _mm_xor_si128(b4, a7);\
-  MUL2(a3, b0, b1);\
-  MUL2(a4, b0, b1);\
+  a0 = VMul2(a0);\
+  b5 = VXor(b5, a0);\
+  a1 = VMul2(a1);\
+  b6 = VXor(b6, a1);\
+  a2 = VMul2(a2);\
+  b7 = VXor(b7, a2);\
+  a5 = VMul2(a5);\
+  b2 = VXor(b2, a5);\
+  a6 = VMul2(a6);\
+  b3 = VXor(b3, a6);\
+  a7 = VMul2(a7);\
+  b4 = VXor(b4, a7);\
+  a3 = VMul2(a3);\
+  a4 = VMul2(a4);\
   b0 = TEMP0;\
   b1 = TEMP1;\
-  b0 = _mm_xor_si128(b0, a3);\
-  b1 = _mm_xor_si128(b1, a4);\
+  b0 = VXor(b0, a3);\
+  b1 = VXor(b1, a4);\
 }/*MixBytes*/
 
 
@@ -407,9 +433,24 @@ static const __m128i
 	ALL_FF = _mm_set_epi32(0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff),
 	ALL_1B = _mm_set_epi32(0x1b1b1b1b, 0x1b1b1b1b, 0x1b1b1b1b, 0x1b1b1b1b);
 
-static const BytePermutation<128>
-	g_groestlTransposion128 = Transposition128bytesBy8(),
-	g_groestlReverseTransposion128 = !g_groestlTransposion128;
+// MixBytes() is instantiated for 128, 256 and 512-bit registers through these overloads
+
+static __forceinline __m128i VXor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+static __forceinline __m256i VXor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+static __forceinline __m512i VXor(__m512i a, __m512i b) { return _mm512_xor_si512(a, b); }
+
+// Multiplication of each byte by 2 in GF(2^8)
+static __forceinline __m128i VMul2(__m128i a) {
+	return _mm_xor_si128(_mm_add_epi8(a, a), _mm_and_si128(_mm_cmpgt_epi8(s_zeroM128i, a), ALL_1B));
+}
+
+static __forceinline __m256i VMul2(__m256i a) {
+	return _mm256_xor_si256(_mm256_add_epi8(a, a), _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_setzero_si256(), a), _mm256_set1_epi8(0x1B)));
+}
+
+static __forceinline __m512i VMul2(__m512i a) {
+	return _mm512_xor_si512(_mm512_add_epi8(a, a), _mm512_maskz_mov_epi8(_mm512_movepi8_mask(a), _mm512_set1_epi8(0x1B)));
+}
 
 void _cdecl Groestl512_x86x64Aes(__m128i dst[8], const __m128i s[8], const GroestlPQParams<128>& params)
 {
@@ -437,6 +478,88 @@ void _cdecl Groestl512_x86x64Aes(__m128i dst[8], const __m128i s[8], const Groes
 	VectorXor8(dst, x);
 }
 
+static __forceinline __m256i AesSubShiftRow(__m256i x, __m256i key, __m256i mask) {
+	__m256i v = _mm256_xor_si256(x, key);
+	__m128i lo = _mm_aesenclast_si128(_mm256_castsi256_si128(v), s_zeroM128i),
+		hi = _mm_aesenclast_si128(_mm256_extracti128_si256(v, 1), s_zeroM128i);
+	return _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), mask);
+}
+
+static __forceinline __m512i AesSubShiftRow(__m512i x, __m512i key, __m512i mask) {
+	return _mm512_shuffle_epi8(_mm512_aesenclast_epi128(_mm512_xor_si512(x, key), _mm512_setzero_si512()), mask);
+}
+
+// x[] = P/Q(x[]) for all the states packed in x[]. The row keys are equal for rows 1..6, so keys[n] is the same as in Groestl512_x86x64Aes()
+template <class V>
+static void GroestlPermuteLanes(V x[8], const GroestlLaneParams<V>& params) {
+	V TEMP0, TEMP1, TEMP2;
+	for (int round = 0; round < 14; ++round) {
+		const V *keys = params.AesRoundConstants[round],
+			*masks = params.ShuffleMasksAfterAes;
+		V a = AesSubShiftRow(x[0], keys[0], masks[0]),
+			b = AesSubShiftRow(x[1], keys[1], masks[1]),
+			c = AesSubShiftRow(x[2], keys[2], masks[2]),
+			d = AesSubShiftRow(x[3], keys[3], masks[3]),
+			e = AesSubShiftRow(x[4], keys[4], masks[4]),
+			f = AesSubShiftRow(x[5], keys[5], masks[5]),
+			g = AesSubShiftRow(x[6], keys[6], masks[6]),
+			h = AesSubShiftRow(x[7], keys[7], masks[7]);
+
+		MixBytes(a, b, c, d, e, f, g, h, x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7]);
+	}
+}
+
+// V holds sizeof(V)/16 permutations. During compression they are P(h^m), Q(m) pairs of sizeof(V)/32 messages, in the output transform P(h) of sizeof(V)/16 messages.
+template <class V>
+static void Groestl512HashLanes(uint8_t (*dst)[64], const uint8_t *const *messages, size_t len, size_t n, const __m128i iv[8], const GroestlLaneParams<V>& pq, const GroestlLaneParams<V>& pp) {
+	const size_t slots = sizeof(V) / sizeof(__m128i), pairs = slots / 2,
+		nBlocks = (len + 8 + 128) / 128, nFull = len / 128, cbTail = len % 128;
+	DECLSPEC_ALIGN(64) __m128i h[slots][8];
+	DECLSPEC_ALIGN(64) uint8_t tail[slots][2][128];
+	V v[8];
+	__m128i *pv = (__m128i*)v;
+	for (size_t i = 0; i < n; i += slots) {
+		const uint8_t *msgs[slots];
+		for (size_t j = 0; j < slots; ++j) {
+			msgs[j] = messages[(min)(i + j, n - 1)];				// missing lanes repeat the last message
+			memcpy(h[j], iv, sizeof h[j]);
+			uint8_t *t = tail[j][0];
+			memset(t, 0, sizeof tail[j]);
+			memcpy(t, msgs[j] + nFull * 128, cbTail);
+			t[cbTail] = 0x80;
+			*(uint64_t*)(t + (nBlocks - nFull) * 128 - 8) = htobe(uint64_t(nBlocks));
+		}
+		for (size_t b = 0; b < nBlocks; ++b) {
+			for (size_t first = 0; first < slots; first += pairs) {
+				for (size_t k = 0; k < pairs; ++k) {
+					size_t j = first + k;
+					__m128i s[8];
+					Transpose16x8bytes(s, (const __m128i*)(b < nFull ? msgs[j] + b * 128 : tail[j][b - nFull]));
+					for (int row = 0; row < 8; ++row) {
+						pv[row * slots + k * 2] = _mm_xor_si128(h[j][row], s[row]);
+						pv[row * slots + k * 2 + 1] = s[row];
+					}
+				}
+				GroestlPermuteLanes(v, pq);
+				for (size_t k = 0; k < pairs; ++k)
+					for (int row = 0; row < 8; ++row)
+						h[first + k][row] = _mm_xor_si128(h[first + k][row], _mm_xor_si128(pv[row * slots + k * 2], pv[row * slots + k * 2 + 1]));
+			}
+		}
+		for (size_t j = 0; j < slots; ++j)
+			for (int row = 0; row < 8; ++row)
+				pv[row * slots + j] = h[j][row];
+		GroestlPermuteLanes(v, pp);
+		for (size_t j = 0; j < slots && i + j < n; ++j) {
+			__m128i d[8], r[8];
+			for (int row = 0; row < 8; ++row)
+				d[row] = _mm_xor_si128(h[j][row], pv[row * slots + j]);
+			Transpose8x16bytes(r, d);
+			memcpy(dst[i + j], r + 4, 64);
+		}
+	}
+}
+
 #endif // UCFG_CPU_X86_X64
 
 static void TransformBlock1024(uint64_t d[], const uint64_t s[], const GroestlPQParams<128>& params) {
@@ -495,7 +618,7 @@ void Groestl512Hash::InitHash(void *dst) noexcept {
 #if UCFG_CPU_X86_X64
 	if (s_bHasAesAndSsse3) {
 		__m128i d[8];
-		g_groestlTransposion128.Apply((uint8_t*)d, (const uint8_t*)dst);
+		Transpose16x8bytes(d, (const __m128i*)dst);
 		memcpy(dst, d, 128);
 	}
 #endif
@@ -506,7 +629,7 @@ void Groestl512Hash::HashBlock(void *dst, uint8_t src[256], uint64_t counter) no
 	if (s_bHasAesAndSsse3) {
 		__m128i hm[8],
 			s[8];
-		g_groestlTransposion128.Apply((uint8_t*)s, (const uint8_t*)src);
+		Transpose16x8bytes(s, (const __m128i*)src);
 		VectorXor8(hm, (__m128i*)dst, s);
 		Groestl512_x86x64Aes((__m128i*)dst, hm, s_groestl_p1024_params);
 		Groestl512_x86x64Aes((__m128i*)dst, s, s_groestl_q1024_params);
@@ -523,12 +646,48 @@ void Groestl512Hash::HashBlock(void *dst, uint8_t src[256], uint64_t counter) no
 	}
 }
 
+void Groestl512Hash::ComputeHashes(uint8_t (*dst)[64], const uint8_t *const *messages, size_t len, size_t n) {
+#if UCFG_CPU_X86_X64
+	if (s_bHasAvx2Aes) {
+		__m128i iv[8];
+		InitHash(iv);
+		if (s_bHasAvx512Vaes)
+			Groestl512HashLanes(dst, messages, len, n, iv, s_groestl_pq512, s_groestl_pp512);
+		else
+			Groestl512HashLanes(dst, messages, len, n, iv, s_groestl_pq256, s_groestl_pp256);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < n; ++i) {
+		hashval hv = ComputeHash(Span(messages[i], len));
+		memcpy(dst[i], hv.constData(), 64);
+	}
+}
+
+vector<hashval> Groestl512Hash::ComputeHashes(const vector<Span>& messages) {
+	vector<hashval> r(messages.size());
+	if (!messages.empty()) {
+		size_t len = messages[0].size();
+		vector<const uint8_t*> ptrs(messages.size());
+		for (size_t i = 0; i < messages.size(); ++i) {
+			if (messages[i].size() != len)
+				Throw(E_INVALIDARG);
+			ptrs[i] = messages[i].data();
+		}
+		vector<array<uint8_t, 64>> digests(messages.size());
+		ComputeHashes((uint8_t(*)[64])digests.data(), ptrs.data(), len, ptrs.size());
+		for (size_t i = 0; i < digests.size(); ++i)
+			r[i] = hashval(digests[i].data(), 64);
+	}
+	return r;
+}
+
 void Groestl512Hash::OutTransform(void *dst) noexcept {
 #if UCFG_CPU_X86_X64
 	if (s_bHasAesAndSsse3) {
 		__m128i d[8];
 		Groestl512_x86x64Aes((__m128i*)dst, (const __m128i*)dst, s_groestl_p1024_params);
-		g_groestlReverseTransposion128.Apply((uint8_t*)d, (const uint8_t*)dst);
+		Transpose8x16bytes(d, (const __m128i*)dst);
 		memcpy((__m128i*)dst, d + 4, 64);
 	} else
 #endif
@@ -538,4 +697,131 @@ void Groestl512Hash::OutTransform(void *dst) noexcept {
 	}
 }
 
+// Single-block messages: 80-byte header or 64-byte digest, padded with 0x80 and the big-endian block count 1
+static struct GroestlPaddedBlocks {
+	DECLSPEC_ALIGN(16) uint8_t Iv[128], Pad80[128], Pad64[128];
+#if UCFG_CPU_X86_X64
+	__m128i IvAes[8], Pad64Aes[8];			// transposed, the 64-byte digest goes to the low halves of Pad64Aes[]
+#endif
+
+	GroestlPaddedBlocks() {
+		ZeroStruct(_self);
+		Pad80[80] = Pad64[64] = 0x80;
+		Pad80[127] = Pad64[127] = 1;
+		Iv[126] = 512 >> 8;											// big-endian hash size in bits
+#if UCFG_CPU_X86_X64
+		if (s_bHasAesAndSsse3) {
+			Transpose16x8bytes(IvAes, (const __m128i*)Iv);
+			Transpose16x8bytes(Pad64Aes, (const __m128i*)Pad64);
+		}
+#endif
+	}
+} s_groestlPaddedBlocks;
+
+#if UCFG_CPU_X86_X64
+
+// h = Groestl-512 state after compressing the padded single block s[] and the output transform
+static void Groestl512SingleBlockAes(__m128i h[8], const __m128i s[8]) {
+	__m128i hm[8];
+	memcpy(h, s_groestlPaddedBlocks.IvAes, 128);
+	VectorXor8(hm, h, s);
+	Groestl512_x86x64Aes(h, hm, s_groestl_p1024_params);
+	Groestl512_x86x64Aes(h, s, s_groestl_q1024_params);
+	Groestl512_x86x64Aes(h, h, s_groestl_p1024_params);
+}
+
+// Both rounds stay in the transposed representation: the 512-bit digest is columns 8..15 of the state, i.e. the high halves of the rows
+static void GroestlDoubleHashAes(uint8_t dst[32], const __m128i s[8]) {
+	__m128i h[8], m[8];
+	Groestl512SingleBlockAes(h, s);
+	for (int row = 0; row < 8; ++row)
+		m[row] = _mm_or_si128(_mm_srli_si128(h[row], 8), s_groestlPaddedBlocks.Pad64Aes[row]);
+	Groestl512SingleBlockAes(h, m);
+	for (int col = 0; col < 4; ++col)
+		for (int row = 0; row < 8; ++row)
+			dst[col * 8 + row] = ((const uint8_t*)&h[row])[8 + col];
+}
+
+#endif // UCFG_CPU_X86_X64
+
+static void Groestl512SingleBlock(uint64_t h[16], const uint64_t m[16]) {
+	uint64_t hm[16];
+	memcpy(h, s_groestlPaddedBlocks.Iv, 128);
+	memcpy(hm, h, 128);
+	VectorXor(hm, m, 16);
+	P1024(h, hm);
+	Q1024(h, m);
+	P1024(h, h);
+}
+
+static void GroestlDoubleHash(uint8_t dst[32], const uint64_t m[16]) {
+	uint64_t h[16], m2[16];
+	Groestl512SingleBlock(h, m);
+	memcpy(m2, h + 8, 64);
+	memcpy(m2 + 8, s_groestlPaddedBlocks.Pad64 + 64, 64);
+	Groestl512SingleBlock(h, m2);
+	memcpy(dst, h + 8, 32);
+}
+
+static void GroestlDoubleHashPadded(uint8_t dst[32], const uint8_t block[128]) {
+	InitGroestlTables();
+#if UCFG_CPU_X86_X64
+	if (s_bHasAesAndSsse3) {
+		__m128i s[8];
+		Transpose16x8bytes(s, (const __m128i*)block);
+		GroestlDoubleHashAes(dst, s);
+	} else
+#endif
+		GroestlDoubleHash(dst, (const uint64_t*)block);
+}
+
+void GroestlDoubleHasher::Hash80(uint8_t dst[32], const uint8_t data[80]) {
+	DECLSPEC_ALIGN(16) uint8_t block[128];
+	memcpy(block, data, 80);
+	memcpy(block + 80, s_groestlPaddedBlocks.Pad80 + 80, 48);
+	GroestlDoubleHashPadded(dst, block);
+}
+
+void GroestlDoubleHasher::Hash64(uint8_t dst[32], const uint8_t data[64]) {
+	DECLSPEC_ALIGN(16) uint8_t block[128];
+	memcpy(block, data, 64);
+	memcpy(block + 64, s_groestlPaddedBlocks.Pad64 + 64, 64);
+	GroestlDoubleHashPadded(dst, block);
+}
+
+GroestlHeaderScanner::GroestlHeaderScanner(const uint8_t header[80]) {
+	InitGroestlTables();
+	DECLSPEC_ALIGN(16) uint8_t block[128];
+	memcpy(block, header, 76);
+	memset(block + 76, 0, 4);
+	memcpy(block + 80, s_groestlPaddedBlocks.Pad80 + 80, 48);
+#if UCFG_CPU_X86_X64
+	if (s_bHasAesAndSsse3)
+		Transpose16x8bytes((__m128i*)m_block, (const __m128i*)block);
+	else
+#endif
+		memcpy(m_block, block, 128);
+}
+
+// The nonce occupies rows 4..7 of column 9, the rest of the prepared block is reused
+void GroestlHeaderScanner::Hash(uint8_t dst[32], uint32_t nonce) const {
+	nonce = htole(nonce);
+	const uint8_t *pNonce = (const uint8_t*)&nonce;
+#if UCFG_CPU_X86_X64
+	if (s_bHasAesAndSsse3) {
+		__m128i s[8];
+		memcpy(s, m_block, 128);
+		for (int i = 0; i < 4; ++i)
+			((uint8_t*)&s[4 + i])[9] = pNonce[i];
+		GroestlDoubleHashAes(dst, s);
+	} else
+#endif
+	{
+		uint64_t m[16];
+		memcpy(m, m_block, 128);
+		memcpy((uint8_t*)m + 76, pNonce, 4);
+		GroestlDoubleHash(dst, m);
+	}
+}
+
 }} // Ext::Crypto::
@@ -64,6 +64,15 @@ class SHA256 : public HashAlgorithm {
 public:
 	static void Init4Way(uint32_t state[8][4]);
 
+	// N-way layer: state[8][lanes] and data[16][lanes] interleave independent streams word by word, data words are host-endian
+	static int NWayLanes() noexcept;					// widest kernel available: 16 (AVX-512), 8 (AVX2) or 4 (SSE2)
+	static void InitNWay(uint32_t *state, int lanes);
+	static void UpdateNWay(uint32_t *state, const uint32_t *data, int lanes);	// lanes is 4, 8 or 16, not above NWayLanes()
+	static void HashNWay(uint32_t *state, const uint8_t *const *messages, size_t len, int cnt, int lanes);	// padded messages through the N-way kernel, unused lanes repeat the last message
+
+	// n equal-length messages, the per-message digests written to dst[i]; bDoubleHash gives SHA256(SHA256(m))
+	static void ComputeHashes(uint8_t (*dst)[32], const uint8_t *const *messages, size_t len, size_t n, bool bDoubleHash = false);
+
 	SHA256() {
 		BlockSize = 64;
 		HashSize = 32;
@@ -99,12 +108,23 @@ public:
 		BlockSize = 128;
 		HashSize = 8;
 		Is64Bit = true;
+		IsBigEndian = false;
 	}
 
     hashval ComputeHash(Stream& stm) override;
-    hashval ComputeHash(RCSpan s) override { return base::ComputeHash(s); }
+    hashval ComputeHash(RCSpan s) override;
+
+	// Non-virtual paths for hash-table keys: no stream, no hashval, the 64-bit result in host order
+	uint64_t Hash(RCSpan s) const noexcept;
+	uint64_t HashUInt256(const uint8_t p[32]) const noexcept;						// txid
+	uint64_t HashUInt256Extra(const uint8_t p[32], uint32_t extra) const noexcept;	// outpoint, same as Hash() of txid || LE32(extra)
+
+	// n equal-length keys, dst[i] = Hash(Span(keys[i], len)); 8 keys per step with AVX-512, 4 with AVX2
+	void HashMany(uint64_t *dst, const uint8_t *const *keys, size_t len, size_t n) const noexcept;
 protected:
 	void InitHash(void *dst) noexcept override;
+	void HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept override;
+	hashval Finalize(void *hash, Stream& stm, uint64_t processedLen) override;
 private:
     static void Round(uint64_t v[4]);
     static void TwoRounds(uint64_t v[4]) { Round(v); Round(v); }
@@ -150,11 +170,17 @@ public:
 	uint32_t Salt[4];
 
 	Blake256() {
-		BlockSize = 128;	//!!!?
-		HashSize = 64;	//!!!?
+		BlockSize = 64;
+		HashSize = 32;
 		IsHaifa = true;
 		ZeroStruct(Salt);
 	}
+
+	// One compression of host-endian message words; counter is the number of message bits up to the end of the block, 0 for a padding-only block
+	static void Compress(uint32_t h[8], const uint32_t m[16], const uint32_t salt[4], uint64_t counter) noexcept;
+
+	// n equal-length messages, 16 per step with AVX-512, 8 with AVX2, 4 with SSE2
+	void ComputeHashes(uint8_t (*dst)[32], const uint8_t *const *messages, size_t len, size_t n);
 protected:
 	void InitHash(void *dst) noexcept override;
 	void HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept override;
@@ -183,12 +209,30 @@ public:
 #endif
 	}
 
+	// Batch API: n independent messages of the same length are hashed in SIMD lanes (AVX2 / AVX-512 VAES when available)
+	void ComputeHashes(uint8_t (*dst)[64], const uint8_t *const *messages, size_t len, size_t n);
+	vector<hashval> ComputeHashes(const vector<Span>& messages);
+
 protected:
 	void InitHash(void *dst) noexcept override;
 	void HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept override;
 	void OutTransform(void *dst) noexcept override;
 };
 
+// Groestlcoin double hash: the first 256 bits of Groestl-512(Groestl-512(data)) for inputs which fit into one block
+class GroestlDoubleHasher {
+public:
+	static void Hash80(uint8_t dst[32], const uint8_t data[80]);		// block header
+	static void Hash64(uint8_t dst[32], const uint8_t data[64]);
+};
+
+// Nonce scanning over a block header: the padded and transposed block is prepared once, only the nonce (bytes 76..79) changes per call
+class GroestlHeaderScanner {
+	DECLSPEC_ALIGN(16) uint64_t m_block[16];
+public:
+	GroestlHeaderScanner(const uint8_t header[80]);
+	void Hash(uint8_t dst[32], uint32_t nonce) const;
+};
 
 class Blake512 : public HashAlgorithm {
 public:
@@ -201,14 +245,21 @@ public:
 		Is64Bit = true;
 		ZeroStruct(Salt);
 	}
+
+	// n equal-length messages, 8 per step with AVX-512, 4 with AVX2
+	void ComputeHashes(uint8_t (*dst)[64], const uint8_t *const *messages, size_t len, size_t n);
 protected:
 	void InitHash(void *dst) noexcept override;
 	void HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept override;
-	void OutTransform(void *dst) noexcept override;
 };
 
 class RIPEMD160 : public HashAlgorithm {
 public:
+	// N-way layer with the same layout as SHA256's: state[5][lanes], data[16][lanes], data words are host-endian
+	static int NWayLanes() noexcept;					// 16 (AVX-512), 8 (AVX2) or 4 (SSE2)
+	static void InitNWay(uint32_t *state, int lanes);
+	static void UpdateNWay(uint32_t *state, const uint32_t *data, int lanes);	// lanes is 4, 8 or 16, not above NWayLanes()
+
 	RIPEMD160() {
 		BlockSize = 64;
 		HashSize = 20;
@@ -224,6 +275,12 @@ protected:
 	void HashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept override;
 };
 
+// Hash160 = RIPEMD160(SHA256(m)); the SHA-256 state becomes the RIPEMD-160 block directly, without an intermediate hashval or stream
+void Hash160(uint8_t dst[20], RCSpan s);
+
+// n equal-length messages (33/65-byte pubkeys, 20/32-byte scripts) through the N-way kernels of both hashes
+void Hash160Many(uint8_t (*dst)[20], const uint8_t *const *messages, size_t len, size_t n);
+
 
 class Random : public Ext::Random {
 public:
@@ -235,6 +292,7 @@ class PseudoRandomFunction {
 public:
 	virtual size_t HashSize() const =0;
 	virtual hashval operator()(RCSpan key, RCSpan text) =0;
+	virtual HashAlgorithm *HmacAlgorithm() { return nullptr; }		// non-null if the PRF is HMAC usable through HmacContext
 };
 
 template <class H>
@@ -244,6 +302,7 @@ public:
 
 	size_t HashSize() const override { return HAlgo.HashSize; }
 	hashval operator()(RCSpan key, RCSpan text) override { return HMAC(HAlgo, key, text); }
+	HashAlgorithm *HmacAlgorithm() override { return HAlgo.IsHaifa || HAlgo.IsBlockCounted ? nullptr : &HAlgo; }		// HmacContext pads as Merkle-Damgard
 };
 
 Blob PBKDF2(PseudoRandomFunction& prf, RCSpan password, RCSpan salt, uint32_t c, size_t dkLen);
@@ -264,9 +323,35 @@ void ScryptCore(uint32_t x[32], uint32_t alignedScratch[1024*32+32]) noexcept;
 CArray8UInt32 CalcSCryptHash(RCSpan password);
 std::array<CArray8UInt32, 3> CalcSCryptHash_80_3way(const uint32_t input[20]);
 CArray8UInt32 CalcNeoSCryptHash(RCSpan password, int profile = 0);
+vector<CArray8UInt32> CalcNeoSCryptHashes(const vector<Span>& passwords, int profile = 0);		// profile 0 runs 8 (AVX2) or 4 inputs per pass
 
+// Keeps the engines of the last 4 (n, r, p) sets for the life of the process, each retaining up to ScryptEngine::MAX_RETAINED_SCRATCHPAD bytes of scratchpads per kind;
+// use a ScryptEngine of your own for large n*r
 Blob Scrypt(RCSpan password, RCSpan salt, int n, int r, int p, size_t dkLen);
 
+// scrypt(N, r, p) evaluator: the SMix blocks of all inputs go SCRYPT_LANES at a time through a SIMD Salsa20/8 kernel,
+// spread over worker threads, each with a scratchpad kept for later calls; fewer blocks than lanes run one at a time
+class ScryptEngine {
+public:
+	static const int SCRYPT_LANES = 4;
+	static const size_t MAX_RETAINED_SCRATCHPAD = 32 << 20;		// bytes of free scratchpads kept for reuse per kind, larger ones are freed after use
+
+	const int N, R, P;
+
+	ScryptEngine(int n, int r, int p, int nThreads = 0);
+	~ScryptEngine();
+	Blob Compute(RCSpan password, RCSpan salt, size_t dkLen);
+	vector<Blob> Compute(const vector<Span>& passwords, const vector<Span>& salts, size_t dkLen);
+private:
+	std::mutex m_mtx;
+	vector<AlignedMem*> m_freeScratchpads[2];				// single-block, SCRYPT_LANES blocks
+	int m_nThreads;
+
+	AlignedMem *AcquireScratchpad(int lanes);
+	void ReleaseScratchpad(AlignedMem *p, int lanes);
+	void SMixGroups(uint32_t *const *blocks, size_t nBlocks, int first, int step, void *scratchpad, int lanes);
+};
+
 #if UCFG_CPU_X86_X64
 extern "C" void _cdecl ScryptCore_x86x64(uint32_t x[32], uint32_t alignedScratch[1024*32+32]);
 #endif
@@ -291,38 +376,138 @@ public:
 	}
 };
 
+// Hashes the parent level of n nodes: dst[i/2] = h2(src[i], src[min(i+1, n-1)]). Overloaded for hashers with a batched implementation
+template <class T, class H2>
+void HashMerkleLevel(const H2& h2, T *dst, const T *src, size_t n) {
+	for (size_t i = 0; i < n; i += 2)
+		dst[i / 2] = h2(src[i], src[(min)(i + 1, n - 1)]);
+}
+
+void HashMerkleLevelSha256d(uint8_t (*dst)[32], const uint8_t (*src)[32], size_t n);
+
+// SHA256(SHA256(left || right)) over 32-byte nodes, as in Bitcoin block Merkle trees
+struct MerkleSha256dHasher {
+	template <class T>
+	T operator()(const T& a, const T& b) const {
+		static_assert(sizeof(T) == 32, "32-byte node expected");
+		uint8_t buf[64];
+		memcpy(buf, &a, 32);
+		memcpy(buf + 32, &b, 32);
+		const uint8_t *p = buf;
+		T r;
+		SHA256::ComputeHashes((uint8_t(*)[32])&r, &p, 64, 1, true);
+		return r;
+	}
+};
+
+template <class T>
+void HashMerkleLevel(const MerkleSha256dHasher&, T *dst, const T *src, size_t n) {
+	static_assert(sizeof(T) == 32, "32-byte node expected");
+	HashMerkleLevelSha256d((uint8_t(*)[32])dst, (const uint8_t(*)[32])src, n);
+}
+
+// All levels stored consecutively, leaves first and the root last
 template <class T, class H2>
 class MerkleTree : public vector<T> {
 	typedef vector<T> base;
 public:
 	H2 m_h2;
 	int SourceSize;
+	vector<size_t> LevelOffsets;
 
 	MerkleTree()
 		: SourceSize(-1)
 	{}
 
+	explicit MerkleTree(H2 h2)
+		: m_h2(h2)
+		, SourceSize(0)
+	{}
+
 	template <class U, class H1>
 	MerkleTree(const vector<U>& ar, H1 h1, H2 h2)
-		: base(ar.size())
+		: m_h2(h2)
 		, SourceSize(int(ar.size()))
-		, m_h2(h2)
 	{
+		Layout(ar.size());
 		for (int i = 0; i < ar.size(); ++i)
 			(*this)[i] = h1(ar[i], i);
-		for (int j = 0, nSize = ar.size(); nSize > 1; j += exchange(nSize, (nSize + 1) / 2))
-			for (int i = 0; i < nSize; i += 2)
-				base::push_back(h2((*this)[j + i], (*this)[j + std::min(i + 1, nSize - 1)]));
+		RehashFrom(0);
+	}
+
+	size_t LeafCount() const { return SourceSize > 0 ? SourceSize : 0; }
+
+	// Appends leaf hashes; only the nodes right of the old leaf count are rehashed
+	void Append(const T *leaves, size_t count) {
+		if (!count)
+			return;
+		size_t oldSize = LeafCount();
+		vector<size_t> oldOffsets = LevelOffsets;
+		base old;
+		old.swap(*this);
+		Layout(oldSize + count);
+		for (size_t j = 0, n = oldSize; n && j < oldOffsets.size(); ++j, n = (n + 1) / 2)
+			std::copy(old.begin() + oldOffsets[j], old.begin() + oldOffsets[j] + n, base::begin() + LevelOffsets[j]);
+		std::copy(leaves, leaves + count, base::begin() + oldSize);
+		SourceSize = int(oldSize + count);
+		RehashFrom(oldSize);
 	}
 
-	MerkleBranch<T, H2> GetBranch(int idx) {
+	void Append(const T& leaf) {
+		Append(&leaf, 1);
+	}
+
+	// Replaces one leaf hash and rehashes its path to the root
+	void Update(size_t idx, const T& leaf) {
+		if (idx >= LeafCount())
+			Throw(E_INVALIDARG);
+		T *p = base::data();
+		p[idx] = leaf;
+		for (size_t j = 0, n = LeafCount(); n > 1; ++j, idx /= 2, n = (n + 1) / 2)
+			p[LevelOffsets[j + 1] + idx / 2] = m_h2(p[LevelOffsets[j] + (idx & ~size_t(1))], p[LevelOffsets[j] + (min)(idx | 1, n - 1)]);
+	}
+
+	MerkleBranch<T, H2> GetBranch(int idx) const {
 		MerkleBranch<T, H2> r;
 		r.m_h2 = m_h2;
 		r.Index = idx;
-		for (int j = 0, n = SourceSize; n > 1; j += n, n = (n + 1) / 2, idx >>= 1)
-			r.Vec.push_back((*this)[j + std::min(idx^1, n-1)]);
+		if (LevelOffsets.size() > 1)
+			r.Vec.reserve(LevelOffsets.size() - 1);
+		for (size_t j = 0, n = LeafCount(); n > 1; ++j, n = (n + 1) / 2, idx >>= 1)
+			r.Vec.push_back((*this)[LevelOffsets[j] + (min)(size_t(idx ^ 1), n - 1)]);
 		return r;
 	}
+
+	// Branches of all leaves, filled level by level
+	vector<MerkleBranch<T, H2>> GetBranches() const {
+		vector<MerkleBranch<T, H2>> r(LeafCount());
+		for (size_t i = 0; i < r.size(); ++i) {
+			r[i].m_h2 = m_h2;
+			r[i].Index = int(i);
+			r[i].Vec.resize(LevelOffsets.size() - 1);
+		}
+		for (size_t j = 0, n = LeafCount(); n > 1; ++j, n = (n + 1) / 2) {
+			const T *level = base::data() + LevelOffsets[j];
+			for (size_t i = 0; i < r.size(); ++i)
+				r[i].Vec[j] = level[(min)((i >> j) ^ 1, n - 1)];
+		}
+		return r;
+	}
+private:
+	void Layout(size_t n) {
+		LevelOffsets.assign(1, 0);
+		for (size_t off = 0; n > 1; n = (n + 1) / 2)
+			LevelOffsets.push_back(off += n);
+		base::resize(n ? LevelOffsets.back() + 1 : 0);
+	}
+
+	void RehashFrom(size_t from) {
+		T *p = base::data();
+		for (size_t j = 0, n = LeafCount(); n > 1; ++j, from /= 2, n = (n + 1) / 2) {
+			size_t first = from & ~size_t(1);
+			HashMerkleLevel(m_h2, p + LevelOffsets[j + 1] + first / 2, p + LevelOffsets[j] + first, n - first);
+		}
+	}
 };
 
 template <class T, class U, class H1, class H2>
@@ -342,6 +527,7 @@ public:
 	int CalcTreeHeight() const;
 	virtual void AddHash(int height, size_t pos, const void *ar) =0;
 protected:
+	virtual void CacheLevels(const void *ar) {}		// called with the leaves before AddHash() calls and with nullptr after them
 	void TraverseAndBuild(int height, size_t pos, const void* ar, const dynamic_bitset<uint8_t>& vMatch);
 };
 
@@ -356,6 +542,15 @@ public:
 		: m_h2(h2)
 	{}
 
+	void Build(const T *ar, const dynamic_bitset<uint8_t>& vMatch) {
+		NItems = vMatch.size();
+		if (!NItems)
+			Throw(E_INVALIDARG);
+		Bitset.clear();
+		Items.clear();
+		TraverseAndBuild(CalcTreeHeight(), 0, ar, vMatch);
+	}
+
 	T CalcHash(int height, size_t pos, const T *ar) const {
 		if (0 == height)
 			return ar[pos];
@@ -365,9 +560,61 @@ public:
 	}
 
 	void AddHash(int height, size_t pos, const void *ar) override {
-		Items.push_back(CalcHash(height, pos, (const T*)ar));
+		Items.push_back(m_levels.LeafCount() ? m_levels[m_levels.LevelOffsets[height] + pos] : CalcHash(height, pos, (const T*)ar));
 	}
 
+	struct DecodedNode {
+		int Height;
+		size_t Left, Right;			// child nodes, Right == Left if the right subtree is absent; size_t(-1) for a hash taken from Items
+	};
+
+	// Walks Bitset and Items in traversal order without hashing; false if the proof is malformed
+	bool Decode(vector<DecodedNode>& nodes, vector<T>& vals, vector<T>& vMatch) const {
+		if (!NItems || Items.size() > NItems)
+			return false;
+		struct Pending {
+			int Height;
+			size_t Pos, Parent;
+			bool IsRight;
+		};
+		size_t nBitsUsed = 0, nHashUsed = 0;
+		Pending root = { CalcTreeHeight(), 0, size_t(-1), false };
+		vector<Pending> stack(1, root);
+		while (!stack.empty()) {
+			Pending e = stack.back();
+			stack.pop_back();
+			if (nBitsUsed >= Bitset.size())
+				return false;
+			bool fParentOfMatch = Bitset[nBitsUsed++];
+			size_t idx = nodes.size();
+			DecodedNode node = { e.Height, size_t(-1), size_t(-1) };
+			nodes.push_back(node);
+			vals.push_back(T());
+			if (e.Parent != size_t(-1)) {
+				nodes[e.Parent].Right = idx;
+				if (!e.IsRight)
+					nodes[e.Parent].Left = idx;
+			}
+			if (e.Height == 0 || !fParentOfMatch) {
+				if (nHashUsed >= Items.size())
+					return false;
+				vals[idx] = Items[nHashUsed++];
+				if (e.Height == 0 && fParentOfMatch)
+					vMatch.push_back(vals[idx]);
+			} else {
+				if (e.Pos*2+1 < CalcTreeWidth(e.Height-1)) {
+					Pending right = { e.Height-1, e.Pos*2+1, idx, true };
+					stack.push_back(right);
+				}
+				Pending left = { e.Height-1, e.Pos*2, idx, false };
+				stack.push_back(left);
+			}
+		}
+		return nHashUsed == Items.size() && (nBitsUsed+7)/8 == (Bitset.size()+7)/8;
+	}
+
+	T ExtractMatches(vector<T>& vMatch) const;
+
 	T TraverseAndExtract(int height, size_t pos, size_t& nBitsUsed, int& nHashUsed, vector<T>& vMatch) const {
 		if (nBitsUsed >= Bitset.size())
 			Throw(E_FAIL);
@@ -385,8 +632,82 @@ public:
 			return m_h2(left, right);
 		}
 	}
+protected:
+	void CacheLevels(const void *ar) override {
+		m_levels = MerkleTree<T, H2>(m_h2);
+		if (ar)
+			m_levels.Append((const T*)ar, NItems);
+	}
+private:
+	MerkleTree<T, H2> m_levels;
 };
 
+// Decodes a batch of proofs, hashing each tree height across the whole batch at once.
+// r[i] is false for a malformed proof, otherwise roots[i] is its Merkle root and (*pMatches)[i] its matched leaves
+template <class T, class H2>
+vector<bool> DecodePartialMerkleTrees(const vector<const PartialMerkleTree<T, H2>*>& trees, vector<T>& roots, vector<vector<T>> *pMatches = nullptr) {
+	typedef typename PartialMerkleTree<T, H2>::DecodedNode Node;
+	size_t n = trees.size();
+	vector<bool> r(n);
+	vector<vector<Node>> nodes(n);
+	vector<vector<T>> vals(n), matches(n);
+	vector<vector<pair<size_t, size_t>>> byHeight;				// (tree, node) of the inner nodes
+	for (size_t i = 0; i < n; ++i) {
+		if (!(r[i] = trees[i]->Decode(nodes[i], vals[i], matches[i]))) {
+			matches[i].clear();
+			continue;
+		}
+		for (size_t k = 0; k < nodes[i].size(); ++k)
+			if (nodes[i][k].Left != size_t(-1)) {
+				size_t h = nodes[i][k].Height;
+				if (byHeight.size() <= h)
+					byHeight.resize(h + 1);
+				byHeight[h].push_back(make_pair(i, k));
+			}
+	}
+	vector<T> src, dst;
+	for (size_t h = 1; h < byHeight.size(); ++h) {
+		const vector<pair<size_t, size_t>>& level = byHeight[h];
+		src.resize(level.size() * 2);
+		dst.resize(level.size());
+		for (size_t k = 0; k < level.size(); ++k) {
+			const Node& node = nodes[level[k].first][level[k].second];
+			src[k * 2] = vals[level[k].first][node.Left];
+			src[k * 2 + 1] = vals[level[k].first][node.Right];
+		}
+		HashMerkleLevel(trees[0]->m_h2, dst.data(), src.data(), src.size());
+		for (size_t k = 0; k < level.size(); ++k)
+			vals[level[k].first][level[k].second] = dst[k];
+	}
+	roots.assign(n, T());
+	for (size_t i = 0; i < n; ++i)
+		if (r[i])
+			roots[i] = vals[i][0];
+	if (pMatches)
+		pMatches->swap(matches);
+	return r;
+}
+
+template <class T, class H2>
+vector<bool> VerifyPartialMerkleTrees(const vector<const PartialMerkleTree<T, H2>*>& trees, const vector<T>& expectedRoots, vector<vector<T>> *pMatches = nullptr) {
+	vector<T> roots;
+	vector<bool> r = DecodePartialMerkleTrees(trees, roots, pMatches);
+	for (size_t i = 0; i < r.size(); ++i)
+		r[i] = r[i] && roots[i] == expectedRoots[i];
+	return r;
+}
+
+template <class T, class H2>
+T PartialMerkleTree<T, H2>::ExtractMatches(vector<T>& vMatch) const {
+	vector<const PartialMerkleTree*> trees(1, this);
+	vector<T> roots;
+	vector<vector<T>> matches;
+	if (!DecodePartialMerkleTrees(trees, roots, &matches)[0])
+		Throw(E_FAIL);
+	vMatch.insert(vMatch.end(), matches[0].begin(), matches[0].end());
+	return roots[0];
+}
+
 
 
 /*!!!R
@@ -409,6 +730,9 @@ extern "C" {
 
 #if UCFG_CPU_X86_X64
 	void _cdecl Sha256Update_4way_x86x64Sse2(uint32_t state[8][4], const uint32_t data[16][4]);
+	void _cdecl Sha256Update_8way_x86x64Avx2(uint32_t state[8][8], const uint32_t data[16][8]);
+	void _cdecl Sha256Update_16way_x86x64Avx512(uint32_t state[8][16], const uint32_t data[16][16]);
+	void _cdecl Sha256Update_x86x64ShaNi(const void *input_data, uint32_t digest[8], uint64_t num_blks);
 	void _cdecl Sha256Update_x86x64(uint32_t state[8], const uint32_t data[16]);
 	void _cdecl Blake512Round(int sigma0, int sigma1, uint64_t& pa, uint64_t& pb, uint64_t& pc, uint64_t& pd, const uint64_t m[16], const uint64_t blakeC[]);
 #endif
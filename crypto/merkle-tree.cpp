@@ -5,10 +5,124 @@
 
 #include <el/ext.h>
 
+#include EXT_HEADER_CONDITION_VARIABLE
+
 #include "hash.h"
 
 namespace Ext { namespace Crypto {
 
+static void HashMerklePairsSha256d(uint8_t (*dst)[32], const uint8_t (*src)[32], size_t nPairs) {
+	const size_t BATCH = 64;
+	const uint8_t *messages[BATCH];
+	for (size_t i = 0; i < nPairs; i += BATCH) {
+		size_t cnt = (min)(BATCH, nPairs - i);
+		for (size_t k = 0; k < cnt; ++k)
+			messages[k] = src[(i + k) * 2];			// left and right siblings are adjacent
+		SHA256::ComputeHashes(dst + i, messages, 64, cnt, true);
+	}
+}
+
+// Workers started once and shared by all Merkle level hashing; the calling thread takes a chunk too
+class MerkleWorkers {
+public:
+	MerkleWorkers()
+		: m_dst(0)
+		, m_src(0)
+		, m_nPairs(0)
+		, m_chunk(0)
+		, m_nBusy(0)
+		, m_next(0)
+		, m_generation(0)
+		, m_bStop(false)
+	{
+		for (int i = 1, n = (max)(int(thread::hardware_concurrency()), 1); i < n; ++i)
+			m_threads.push_back(thread(&MerkleWorkers::WorkerLoop, this));
+	}
+
+	~MerkleWorkers() {
+		EXT_LOCK (m_mtx) {
+			m_bStop = true;
+		}
+		m_cvWork.notify_all();
+		for (size_t i = 0; i < m_threads.size(); ++i)
+			m_threads[i].join();
+	}
+
+	size_t ThreadCount() const { return m_threads.size() + 1; }
+
+	void Run(uint8_t (*dst)[32], const uint8_t (*src)[32], size_t nPairs, size_t chunk) {
+		EXT_LOCK (m_mtxBatch) {
+			EXT_LOCK (m_mtx) {
+				m_dst = dst;
+				m_src = src;
+				m_nPairs = nPairs;
+				m_chunk = chunk;
+				m_next = 0;
+				m_nBusy = m_threads.size();
+				++m_generation;
+			}
+			m_cvWork.notify_all();
+			RunJob();
+			unique_lock<mutex> lk(m_mtx);
+			m_cvDone.wait(lk, [this] { return !m_nBusy; });
+		}
+	}
+private:
+	vector<thread> m_threads;
+	mutex m_mtxBatch;									// one level at a time
+	mutex m_mtx;
+	condition_variable m_cvWork, m_cvDone;
+	uint8_t (*m_dst)[32];
+	const uint8_t (*m_src)[32];
+	size_t m_nPairs, m_chunk, m_nBusy;
+	atomic<size_t> m_next;
+	uint64_t m_generation;
+	bool m_bStop;
+
+	void RunJob() {
+		for (size_t beg; (beg = m_chunk * m_next++) < m_nPairs;)
+			HashMerklePairsSha256d(m_dst + beg, m_src + beg * 2, (min)(m_chunk, m_nPairs - beg));
+	}
+
+	void WorkerLoop() {
+		for (uint64_t gen = 0;;) {
+			{
+				unique_lock<mutex> lk(m_mtx);
+				m_cvWork.wait(lk, [this, gen] { return m_bStop || m_generation != gen; });
+				if (m_bStop)
+					return;
+				gen = m_generation;
+			}
+			RunJob();
+			EXT_LOCK (m_mtx) {
+				if (!--m_nBusy)
+					m_cvDone.notify_all();
+			}
+		}
+	}
+};
+
+void HashMerkleLevelSha256d(uint8_t (*dst)[32], const uint8_t (*src)[32], size_t n) {
+	const size_t PAIRS_PER_THREAD = 4096;				// below this, waking the workers costs more than it saves
+	size_t nPairs = n / 2;
+	if (nPairs >= PAIRS_PER_THREAD * 2) {
+		static MerkleWorkers s_workers;
+		size_t nThreads = (min)(s_workers.ThreadCount(), nPairs / PAIRS_PER_THREAD);
+		if (nThreads > 1)
+			s_workers.Run(dst, src, nPairs, (nPairs + nThreads - 1) / nThreads);
+		else
+			HashMerklePairsSha256d(dst, src, nPairs);
+	} else
+		HashMerklePairsSha256d(dst, src, nPairs);
+	if (n & 1) {
+		uint8_t buf[64];
+		memcpy(buf, src[n - 1], 32);
+		memcpy(buf + 32, src[n - 1], 32);
+		const uint8_t *p = buf;
+		SHA256::ComputeHashes(dst + nPairs, &p, 64, 1, true);
+	}
+}
+
 int PartialMerkleTreeBase::CalcTreeHeight() const {
 	for (int r=0;; ++r)
 		if (CalcTreeWidth(r) <= 1)
@@ -16,20 +130,36 @@ int PartialMerkleTreeBase::CalcTreeHeight() const {
 }
 
 void PartialMerkleTreeBase::TraverseAndBuild(int height, size_t pos, const void *ar, const dynamic_bitset<uint8_t>& vMatch) {
-    // determine whether this node is the parent of at least one matched txid
-    bool fParentOfMatch = false;
-    for (size_t p=pos<<height; p < (pos+1)<<height && p<NItems; p++)
-        fParentOfMatch |= vMatch[p];
-	Bitset.push_back(fParentOfMatch);
-    if (height==0 || !fParentOfMatch) {
-		AddHash(height, pos, ar);
-    } else {
-        // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height-1, pos*2, ar, vMatch);
-        if (pos*2+1 < CalcTreeWidth(height-1))
-            TraverseAndBuild(height-1, pos*2+1, ar, vMatch);
-    }
+	// whether a node is the parent of at least one matched txid, computed bottom-up once for every level
+	vector<vector<bool>> parentOfMatch(height + 1);
+	parentOfMatch[0].resize(NItems);
+	for (size_t p = 0; p < NItems; ++p)
+		parentOfMatch[0][p] = vMatch[p];
+	for (int h = 1; h <= height; ++h) {
+		const vector<bool>& below = parentOfMatch[h - 1];
+		vector<bool>& level = parentOfMatch[h];
+		level.resize(CalcTreeWidth(h));
+		for (size_t p = 0; p < level.size(); ++p)
+			level[p] = below[p * 2] || (p * 2 + 1 < below.size() && below[p * 2 + 1]);
+	}
 
+	CacheLevels(ar);
+	vector<pair<int, size_t>> stack(1, make_pair(height, pos));		// depth-first, left subtree first
+	while (!stack.empty()) {
+		int h = stack.back().first;
+		size_t p = stack.back().second;
+		stack.pop_back();
+		bool fParentOfMatch = parentOfMatch[h][p];
+		Bitset.push_back(fParentOfMatch);
+		if (h == 0 || !fParentOfMatch)
+			AddHash(h, p, ar);
+		else {
+			if (p * 2 + 1 < CalcTreeWidth(h - 1))
+				stack.push_back(make_pair(h - 1, p * 2 + 1));
+			stack.push_back(make_pair(h - 1, p * 2));
+		}
+	}
+	CacheLevels(nullptr);
 }
 
 }} // Ext::Crypto
@@ -568,60 +568,17 @@ static void neoscrypt_pbkdf2_blake256(const uint8_t *password, size_t password_l
 
 
 
-/* 32-bit / 64-bit optimised memcpy() */
-static void neoscrypt_copy(void *dstp, const void *srcp, uint len) {
-    ulong *dst = (ulong *) dstp;
-    ulong *src = (ulong *) srcp;
-    uint i, tail;
-
-    for(i = 0; i < (len / sizeof(ulong)); i++)
-      dst[i] = src[i];
-
-    tail = len & (sizeof(ulong) - 1);
-    if(tail) {
-        uchar *dstb = (uchar *) dstp;
-        uchar *srcb = (uchar *) srcp;
-
-        for(i = len - tail; i < len; i++)
-          dstb[i] = srcb[i];
-    }
+static __forceinline void neoscrypt_copy(void *dstp, const void *srcp, uint len) {
+	memcpy(dstp, srcp, len);
 }
 
-/* 32-bit / 64-bit optimised memory erase aka memset() to zero */
-static void neoscrypt_erase(void *dstp, uint len) {
-    const ulong null = 0;
-    ulong *dst = (ulong *) dstp;
-    uint i, tail;
-
-    for(i = 0; i < (len / sizeof(ulong)); i++)
-      dst[i] = null;
-
-    tail = len & (sizeof(ulong) - 1);
-    if(tail) {
-        uchar *dstb = (uchar *) dstp;
-
-        for(i = len - tail; i < len; i++)
-          dstb[i] = (uchar)null;
-    }
+static __forceinline void neoscrypt_erase(void *dstp, uint len) {
+	memset(dstp, 0, len);
 }
 
-/* 32-bit / 64-bit optimised XOR engine */
-static void neoscrypt_xor(void *dstp, const void *srcp, uint len) {
-    ulong *dst = (ulong *) dstp;
-    ulong *src = (ulong *) srcp;
-    uint i, tail;
-
-    for(i = 0; i < (len / sizeof(ulong)); i++)
-      dst[i] ^= src[i];
-
-    tail = len & (sizeof(ulong) - 1);
-    if(tail) {
-        uchar *dstb = (uchar *) dstp;
-        uchar *srcb = (uchar *) srcp;
-
-        for(i = len - tail; i < len; i++)
-          dstb[i] ^= srcb[i];
-    }
+static __forceinline void neoscrypt_xor(void *dstp, const void *srcp, uint len) {
+	VectorXor((uint64_t*)dstp, (const uint64_t*)srcp, len / 8);
+	VectorXor((uint8_t*)dstp + (len & ~7), (const uint8_t*)srcp + (len & ~7), len & 7);
 }
 
 
@@ -1030,6 +987,241 @@ CArray8UInt32 CalcNeoSCryptHash(RCSpan password, int profile) {
 }
 
 
+#if UCFG_CPU_X86_X64
+
+// Batched NeoScrypt profile 0: every stage runs over 4 (SSE2) or 8 (AVX2) word-sliced lanes
+
+static const int s_neoscryptLanes = CpuDispatch::Select<int>("NeoScrypt batch", {
+	{ "avx2 x8", CpuInfo().Features.AVX2, 8 },
+	{ "sse2 x4", true, 4 },
+});
+
+static const int NEOSCRYPT_MAX_LANES = 8,
+	NEOSCRYPT_N = 128,
+	NEOSCRYPT_R = 2,
+	NEOSCRYPT_X_SIZE = NEOSCRYPT_R * 2 * SCRYPT_BLOCK_SIZE;
+
+struct FastKdfLaneBuffers {
+	uchar A[FASTKDF_BUFFER_SIZE + BLAKE2S_BLOCK_SIZE],
+		B[FASTKDF_BUFFER_SIZE + BLAKE2S_KEY_SIZE];
+	uint Bufptr;
+};
+
+struct NeoScryptLaneScratch {
+	FastKdfLaneBuffers Kdf[NEOSCRYPT_MAX_LANES];
+	DECLSPEC_ALIGN(32) uint32_t X[NEOSCRYPT_MAX_LANES][NEOSCRYPT_X_SIZE / 4];
+	DECLSPEC_ALIGN(32) uint32_t Msg[2][16][NEOSCRYPT_MAX_LANES], Out[8][NEOSCRYPT_MAX_LANES];
+	DECLSPEC_ALIGN(32) uint8_t Lanes[(3 + NEOSCRYPT_N) * NEOSCRYPT_X_SIZE * NEOSCRYPT_MAX_LANES];	// x, z, tmp and V
+};
+
+static thread_specific_ptr<AlignedMem> t_neoscryptScratch;
+
+static NeoScryptLaneScratch& GetNeoScryptScratch() {
+	if (!t_neoscryptScratch)
+		t_neoscryptScratch.reset(new AlignedMem(sizeof(NeoScryptLaneScratch), 64));
+	return *(NeoScryptLaneScratch*)t_neoscryptScratch->get();
+}
+
+template <class V>
+static __forceinline V VLoadLanes(const uint32_t *p) { return *(const V*)p; }
+
+template <int n, class V>
+static __forceinline V VRotr32(V a) { return VRotl32<32 - n>(a); }
+
+template <class V>
+static void Blake2sCompressLanes(V h[8], const uint32_t m[16][NEOSCRYPT_MAX_LANES], uint32_t t, uint32_t f) {
+	V v[16], w[16];
+	for (int i = 0; i < 16; ++i)
+		w[i] = VLoadLanes<V>(m[i]);
+	for (int i = 0; i < 8; ++i) {
+		v[i] = h[i];
+		v[i + 8] = VSet1(blake2s_IV[i], V());
+	}
+	v[12] = VSet1(blake2s_IV[4] ^ t, V());
+	v[14] = VSet1(blake2s_IV[6] ^ f, V());
+#define G(r,i,a,b,c,d)										\
+	a = VAdd32(VAdd32(a, b), w[blake2s_sigma[r][2*i+0]]);	\
+	d = VRotr32<16>(VXor(d, a));							\
+	c = VAdd32(c, d);										\
+	b = VRotr32<12>(VXor(b, c));							\
+	a = VAdd32(VAdd32(a, b), w[blake2s_sigma[r][2*i+1]]);	\
+	d = VRotr32<8>(VXor(d, a));								\
+	c = VAdd32(c, d);										\
+	b = VRotr32<7>(VXor(b, c));
+	for (int r = 0; r < 10; ++r) {
+		G(r, 0, v[ 0], v[ 4], v[ 8], v[12]);
+		G(r, 1, v[ 1], v[ 5], v[ 9], v[13]);
+		G(r, 2, v[ 2], v[ 6], v[10], v[14]);
+		G(r, 3, v[ 3], v[ 7], v[11], v[15]);
+		G(r, 4, v[ 0], v[ 5], v[10], v[15]);
+		G(r, 5, v[ 1], v[ 6], v[11], v[12]);
+		G(r, 6, v[ 2], v[ 7], v[ 8], v[13]);
+		G(r, 7, v[ 3], v[ 4], v[ 9], v[14]);
+	}
+#undef G
+	for (int i = 0; i < 8; ++i)
+		h[i] = VXor(h[i], VXor(v[i], v[i + 8]));
+}
+
+static void FastKdfFill(uchar *buf, const uchar *src, uint len, uint tail) {
+	if (len > FASTKDF_BUFFER_SIZE)
+		len = FASTKDF_BUFFER_SIZE;
+	for (uint i = 0; i < FASTKDF_BUFFER_SIZE; i += len)
+		neoscrypt_copy(&buf[i], src, MIN(len, FASTKDF_BUFFER_SIZE - i));
+	neoscrypt_copy(&buf[FASTKDF_BUFFER_SIZE], src, tail);
+}
+
+// neoscrypt_fastkdf() with N = 32 over all lanes at once: the keyed BLAKE2s PRF is two compressions, key block then input block
+template <class V>
+static void FastKdfLanes(NeoScryptLaneScratch& scratch, const uchar *const password[], const uchar *const salt[], uint saltLen, uchar *const output[], uint outputLen) {
+	const int L = sizeof(V) / 4;
+	const uint prf_output_size = BLAKE2S_OUT_SIZE;
+	for (int l = 0; l < L; ++l) {
+		FastKdfLaneBuffers& b = scratch.Kdf[l];
+		FastKdfFill(b.A, password[l], 80, BLAKE2S_BLOCK_SIZE);
+		FastKdfFill(b.B, salt[l], saltLen, BLAKE2S_KEY_SIZE);
+		b.Bufptr = 0;
+	}
+	memset(scratch.Msg[0][8], 0, sizeof(scratch.Msg[0]) / 2);
+	for (int i = 0; i < 32; ++i) {
+		for (int l = 0; l < L; ++l) {
+			const FastKdfLaneBuffers& b = scratch.Kdf[l];
+			const uint32_t *key = (const uint32_t*)&b.B[b.Bufptr], *in = (const uint32_t*)&b.A[b.Bufptr];
+			for (int k = 0; k < 8; ++k)
+				scratch.Msg[0][k][l] = key[k];
+			for (int k = 0; k < 16; ++k)
+				scratch.Msg[1][k][l] = in[k];
+		}
+		V h[8];
+		for (int k = 0; k < 8; ++k)
+			h[k] = VSet1(blake2s_IV[k] ^ (k ? 0 : 0x01010000 | BLAKE2S_KEY_SIZE << 8 | BLAKE2S_OUT_SIZE), V());		// fanout 1, depth 1
+		Blake2sCompressLanes(h, scratch.Msg[0], BLAKE2S_BLOCK_SIZE, 0);
+		Blake2sCompressLanes(h, scratch.Msg[1], 2 * BLAKE2S_BLOCK_SIZE, ~0U);
+		for (int k = 0; k < 8; ++k)
+			*(V*)scratch.Out[k] = h[k];
+
+		for (int l = 0; l < L; ++l) {
+			FastKdfLaneBuffers& b = scratch.Kdf[l];
+			uint32_t prf_output[8];
+			for (int k = 0; k < 8; ++k)
+				prf_output[k] = scratch.Out[k][l];
+			const uchar *po = (const uchar*)prf_output;
+			uint bufptr = 0;
+			for (uint j = 0; j < prf_output_size; j++)
+				bufptr += po[j];
+			b.Bufptr = bufptr &= FASTKDF_BUFFER_SIZE - 1;
+			neoscrypt_xor(&b.B[bufptr], po, prf_output_size);
+			if (bufptr < BLAKE2S_KEY_SIZE)
+				neoscrypt_copy(&b.B[FASTKDF_BUFFER_SIZE + bufptr], &b.B[bufptr], MIN(prf_output_size, BLAKE2S_KEY_SIZE - bufptr));
+			if (FASTKDF_BUFFER_SIZE - bufptr < prf_output_size)
+				neoscrypt_copy(&b.B[0], &b.B[FASTKDF_BUFFER_SIZE], prf_output_size - (FASTKDF_BUFFER_SIZE - bufptr));
+		}
+	}
+	for (int l = 0; l < L; ++l) {
+		FastKdfLaneBuffers& b = scratch.Kdf[l];
+		uint bufptr = b.Bufptr, a = FASTKDF_BUFFER_SIZE - bufptr;
+		if (a >= outputLen) {
+			neoscrypt_xor(&b.B[bufptr], &b.A[0], outputLen);
+			neoscrypt_copy(&output[l][0], &b.B[bufptr], outputLen);
+		} else {
+			neoscrypt_xor(&b.B[bufptr], &b.A[0], a);
+			neoscrypt_xor(&b.B[0], &b.A[a], outputLen - a);
+			neoscrypt_copy(&output[l][0], &b.B[bufptr], a);
+			neoscrypt_copy(&output[l][a], &b.B[0], outputLen - a);
+		}
+	}
+}
+
+// x ^= V[j] where j comes from the last block of each lane separately
+template <class V>
+static void XorIntegerifiedLanes(V x[][16], const V *v, int r, int n) {
+	const int L = sizeof(V) / 4, words = 32 * r;
+	uint32_t *px = (uint32_t*)x[0];
+	for (int l = 0; l < L; ++l) {
+		const uint32_t *pv = (const uint32_t*)(v + (((const uint32_t*)x[2*r - 1])[l] & (n - 1)) * words) + l;
+		for (int k = 0; k < words; ++k)
+			px[k * L + l] ^= pv[k * L];
+	}
+}
+
+template <class V>
+static void NeoScryptCoreLanes(V x[][16], V z[][16], V tmp[][16], V *v, int r, int rounds, int n) {
+	const int words = 32 * r;
+	memcpy(z, x, 2*r * sizeof(x[0]));
+	for (int i = 0; i < n; ++i) {
+		memcpy(v + i * words, z, 2*r * sizeof(x[0]));
+		VectorMixLanes(ChaChaCoreLanes<V>, z, tmp, r, rounds);
+	}
+	for (int i = 0; i < n; ++i) {
+		XorIntegerifiedLanes(z, v, r, n);
+		VectorMixLanes(ChaChaCoreLanes<V>, z, tmp, r, rounds);
+	}
+
+	for (int i = 0; i < n; ++i) {
+		memcpy(v + i * words, x, 2*r * sizeof(x[0]));
+		VectorMixLanes(SalsaCoreLanes<V>, x, tmp, r, rounds);
+	}
+	for (int i = 0; i < n; ++i) {
+		XorIntegerifiedLanes(x, v, r, n);
+		VectorMixLanes(SalsaCoreLanes<V>, x, tmp, r, rounds);
+	}
+	for (int i = 0; i < 2*r; ++i)
+		for (int k = 0; k < 16; ++k)
+			x[i][k] = VXor(x[i][k], z[i][k]);
+}
+
+template <class V>
+static void NeoScryptLanes(const uchar *const password[], uchar *const output[]) {
+	const int L = sizeof(V) / 4, words = NEOSCRYPT_X_SIZE / 4;
+	NeoScryptLaneScratch& scratch = GetNeoScryptScratch();
+	typedef V (*LaneBlockPtr)[16];
+	LaneBlockPtr x = (LaneBlockPtr)scratch.Lanes, z = x + 2*NEOSCRYPT_R, tmp = z + 2*NEOSCRYPT_R;
+	uchar *xs[NEOSCRYPT_MAX_LANES];
+	for (int l = 0; l < L; ++l)
+		xs[l] = (uchar*)scratch.X[l];
+
+	FastKdfLanes<V>(scratch, password, password, 80, xs, NEOSCRYPT_X_SIZE);
+	uint32_t *px = (uint32_t*)x[0];
+	for (int l = 0; l < L; ++l)
+		for (int k = 0; k < words; ++k)
+			px[k * L + l] = scratch.X[l][k];
+	NeoScryptCoreLanes(x, z, tmp, (V*)(tmp + 2*NEOSCRYPT_R), NEOSCRYPT_R, 20, NEOSCRYPT_N);
+	for (int l = 0; l < L; ++l)
+		for (int k = 0; k < words; ++k)
+			scratch.X[l][k] = px[k * L + l];
+	FastKdfLanes<V>(scratch, password, xs, NEOSCRYPT_X_SIZE, output, 32);
+}
+
+#endif // UCFG_CPU_X86_X64
+
+vector<CArray8UInt32> CalcNeoSCryptHashes(const vector<Span>& passwords, int profile) {
+	vector<CArray8UInt32> r(passwords.size());
+	size_t i = 0;
+#if UCFG_CPU_X86_X64
+	if (profile == 0) {
+		const int lanes = s_neoscryptLanes;
+		for (; i < passwords.size(); i += lanes) {
+			const uchar *pw[NEOSCRYPT_MAX_LANES];
+			uchar *out[NEOSCRYPT_MAX_LANES];
+			uint32_t dummy[8];
+			for (int l = 0; l < lanes; ++l) {
+				size_t j = (min)(i + l, passwords.size() - 1);
+				ASSERT(passwords[j].size() == 80);
+				pw[l] = passwords[j].data();
+				out[l] = i + l < passwords.size() ? (uchar*)r[i + l].data() : (uchar*)dummy;
+			}
+			if (lanes == 8)
+				NeoScryptLanes<__m256i>(pw, out);
+			else
+				NeoScryptLanes<__m128i>(pw, out);
+		}
+	}
+#endif
+	for (; i < passwords.size(); ++i)
+		r[i] = CalcNeoSCryptHash(passwords[i], profile);
+	return r;
+}
+
 }} // Ext::Crypto::
 
 
@@ -13,20 +13,52 @@
 
 namespace Ext { namespace Crypto {
 
+static const uint64_t PBKDF2_ITERATIONS_PER_THREAD = 4096;		// don't spawn threads for short derivations
+
+static void Pbkdf2Blocks(const HmacContext& hmac, RCSpan salt, uint32_t c, size_t hlen, uint8_t *dst, uint32_t beg, uint32_t end) {
+	uint32_t iBe = 0;
+	Blob salt_i = salt + ConstBuf(&iBe, 4);
+	for (uint32_t i = beg; i < end; ++i) {
+		memcpy(salt_i.data() + salt.size(), &(iBe = htobe(i + 1)), 4);
+		hashval u = hmac.Compute(salt_i);
+		uint8_t *p = dst + i * hlen;
+		memcpy(p, u.constData(), hlen);
+		hmac.Iterate(u.data(), p, (max)(c, 1U) - 1);
+	}
+}
+
 Blob PBKDF2(PseudoRandomFunction& prf, RCSpan password, RCSpan salt, uint32_t c, size_t dkLen) {
 	size_t hlen = prf.HashSize();
 	if (dkLen > uint64_t(hlen) * uint32_t(0xFFFFFFFF))
 		Throw(ExtErr::DerivedKeyTooLong);
-	uint32_t iBe = 0;
-	Blob salt_i = salt + ConstBuf(&iBe, 4);
-	Blob r(nullptr, dkLen);
-	for (uint32_t i = 1, n = uint32_t((dkLen + hlen - 1) / hlen); i <= n; ++i) {
-		memcpy(salt_i.data() + salt.size(), &(iBe = htobe(i)), 4);
-		hashval u = prf(password, salt_i), rh = u;
-		for (uint32_t j = 1; j < c; ++j)
-			VectorXor(rh.data(), Span(u = prf(password, Span(u))).data(), hlen);
-		memcpy(r.data() + (i - 1) * hlen, rh.data(), (min)(hlen, r.size() - (i - 1) * hlen));
+	uint32_t n = uint32_t((dkLen + hlen - 1) / hlen);
+	Blob r(nullptr, n * hlen);
+	if (HashAlgorithm *algo = prf.HmacAlgorithm()) {
+		HmacContext hmac(*algo, password);
+		size_t nThreads = (min)(size_t((max)(thread::hardware_concurrency(), 1U)), size_t((max)(uint64_t(c) * n / PBKDF2_ITERATIONS_PER_THREAD, uint64_t(1))));
+		if ((nThreads = (min)(nThreads, size_t(n))) <= 1)
+			Pbkdf2Blocks(hmac, salt, c, hlen, r.data(), 0, n);
+		else {
+			uint32_t chunk = uint32_t((n + nThreads - 1) / nThreads);
+			vector<thread> threads;
+			for (uint32_t beg = chunk; beg < n; beg += chunk)
+				threads.push_back(thread(Pbkdf2Blocks, cref(hmac), salt, c, hlen, r.data(), beg, (min)(beg + chunk, n)));
+			Pbkdf2Blocks(hmac, salt, c, hlen, r.data(), 0, chunk);
+			for (size_t i = 0; i < threads.size(); ++i)
+				threads[i].join();
+		}
+	} else {
+		uint32_t iBe = 0;
+		Blob salt_i = salt + ConstBuf(&iBe, 4);
+		for (uint32_t i = 1; i <= n; ++i) {
+			memcpy(salt_i.data() + salt.size(), &(iBe = htobe(i)), 4);
+			hashval u = prf(password, salt_i), rh = u;
+			for (uint32_t j = 1; j < c; ++j)
+				VectorXor(rh.data(), Span(u = prf(password, Span(u))).data(), hlen);
+			memcpy(r.data() + (i - 1) * hlen, rh.data(), hlen);
+		}
 	}
+	r.resize(dkLen);
 	return r;
 }
 
@@ -62,41 +62,224 @@ static const uint8_t RR[80] = {
 static const uint32_t KL[5] = { 0,			0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E },
 					KR[5] = { 0x50A28BE6,	0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0 };
 
-static uint32_t F1(uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; }
-static uint32_t F2(uint32_t x, uint32_t y, uint32_t z) { return x & y | ~x & z; }
-static uint32_t F3(uint32_t x, uint32_t y, uint32_t z) { return (x | ~y) ^ z; }
-static uint32_t F4(uint32_t x, uint32_t y, uint32_t z) { return z & x | ~z & y; }
-static uint32_t F5(uint32_t x, uint32_t y, uint32_t z) { return (y | ~z) ^ x; }
+// Lane-parallel kernels: state[5][N] and data[16][N] hold word i of every lane in one vector; uint32_t is the 1-lane case used by HashBlock()
 
-typedef uint32_t (*PFN_F)(uint32_t, uint32_t, uint32_t);
+static __forceinline uint32_t VLoad(const uint32_t *p) { return *p; }
+static __forceinline void VStore(uint32_t *p, uint32_t a) { *p = a; }
+static __forceinline uint32_t VSet1(uint32_t v, uint32_t) { return v; }
+static __forceinline uint32_t VAdd(uint32_t a, uint32_t b) { return a + b; }
+static __forceinline uint32_t VXor(uint32_t a, uint32_t b) { return a ^ b; }
+static __forceinline uint32_t VAnd(uint32_t a, uint32_t b) { return a & b; }
+static __forceinline uint32_t VOrNot(uint32_t a, uint32_t b) { return a | ~b; }
+static __forceinline uint32_t VRotl(uint32_t a, int n) { return _rotl(a, n); }
 
-static const PFN_F s_leftFs[] = { F1, F2, F3, F4, F5 },
-	s_rightFs[] = { F5, F4, F3, F2, F1 };
+#if UCFG_CPU_X86_X64
 
-struct Tuple5 {
-	uint32_t A, B, C, D, E;
-};
+static const int s_ripemd160NWayLanes = CpuDispatch::Select<int>("RIPEMD-160 N-way", {
+	{ "avx512 x16", CpuInfo().Features.AVX512F, 16 },
+	{ "avx2 x8", CpuInfo().Features.AVX2, 8 },
+	{ "sse2 x4", true, 4 },
+});
+
+static __forceinline __m128i VLoad(const __m128i *p) { return _mm_loadu_si128(p); }
+static __forceinline void VStore(__m128i *p, __m128i a) { _mm_storeu_si128(p, a); }
+static __forceinline __m128i VSet1(uint32_t v, __m128i) { return _mm_set1_epi32(v); }
+static __forceinline __m128i VAdd(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+static __forceinline __m128i VXor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+static __forceinline __m128i VAnd(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+static __forceinline __m128i VOrNot(__m128i a, __m128i b) { return _mm_or_si128(a, _mm_xor_si128(b, _mm_set1_epi32(-1))); }		// a | ~b
+static __forceinline __m128i VRotl(__m128i a, int n) { return _mm_or_si128(_mm_sll_epi32(a, _mm_cvtsi32_si128(n)), _mm_srl_epi32(a, _mm_cvtsi32_si128(32 - n))); }
+
+static __forceinline __m256i VLoad(const __m256i *p) { return _mm256_loadu_si256(p); }
+static __forceinline void VStore(__m256i *p, __m256i a) { _mm256_storeu_si256(p, a); }
+static __forceinline __m256i VSet1(uint32_t v, __m256i) { return _mm256_set1_epi32(v); }
+static __forceinline __m256i VAdd(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+static __forceinline __m256i VXor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+static __forceinline __m256i VAnd(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+static __forceinline __m256i VOrNot(__m256i a, __m256i b) { return _mm256_or_si256(a, _mm256_xor_si256(b, _mm256_set1_epi32(-1))); }
+static __forceinline __m256i VRotl(__m256i a, int n) { return _mm256_or_si256(_mm256_sll_epi32(a, _mm_cvtsi32_si128(n)), _mm256_srl_epi32(a, _mm_cvtsi32_si128(32 - n))); }
+
+static __forceinline __m512i VLoad(const __m512i *p) { return _mm512_loadu_si512(p); }
+static __forceinline void VStore(__m512i *p, __m512i a) { _mm512_storeu_si512(p, a); }
+static __forceinline __m512i VSet1(uint32_t v, __m512i) { return _mm512_set1_epi32(v); }
+static __forceinline __m512i VAdd(__m512i a, __m512i b) { return _mm512_add_epi32(a, b); }
+static __forceinline __m512i VXor(__m512i a, __m512i b) { return _mm512_xor_si512(a, b); }
+static __forceinline __m512i VAnd(__m512i a, __m512i b) { return _mm512_and_si512(a, b); }
+static __forceinline __m512i VOrNot(__m512i a, __m512i b) { return _mm512_ternarylogic_epi32(a, b, b, 0xF3); }
+static __forceinline __m512i VRotl(__m512i a, int n) { return _mm512_rolv_epi32(a, _mm512_set1_epi32(n)); }
+
+#endif // UCFG_CPU_X86_X64
 
-static Tuple5 CalcBranch(uint32_t *p, const uint32_t w[], const uint8_t tableR[], const uint8_t tableS[], const uint32_t tableK[], const PFN_F tableF[]) {
-	uint32_t a = p[0], b = p[1], c = p[2], d = p[3], e = p[4];
-	for (int i = 0; i < 80; ++i) {
-		uint32_t t = e + _rotl(a + tableF[i>>4](b, c, d) + w[tableR[i]] + tableK[i>>4] , tableS[i]);
-		a = exchange(e, exchange(d, _rotl(exchange(c, exchange(b, t)), 10)));
+// F1..F5 in forms using only and/xor/or-not
+template <int F, class V> static __forceinline V RipemdF(V x, V y, V z) {
+	switch (F) {
+	case 1: return VXor(VXor(x, y), z);
+	case 2: return VXor(VAnd(VXor(y, z), x), z);
+	case 3: return VXor(VOrNot(x, y), z);
+	case 4: return VXor(VAnd(VXor(x, y), z), y);
+	default: return VXor(VOrNot(y, z), x);
 	}
-	Tuple5 r = { a, b, c, d, e };
-	return r;
+}
+
+// 16 steps unrolled by recursion, so the message index and rotation count of every step are constants
+template <int F, int I> struct RipemdSteps {
+	template <class V> static __forceinline void Run(V& a, V& b, V& c, V& d, V& e, const V *w, const uint8_t *tableR, const uint8_t *tableS, V vk) {
+		RipemdSteps<F, I - 1>::Run(a, b, c, d, e, w, tableR, tableS, vk);
+		V t = VAdd(VRotl(VAdd(VAdd(a, RipemdF<F>(b, c, d)), VAdd(w[tableR[I - 1]], vk)), tableS[I - 1]), e);
+		a = e;
+		e = d;
+		d = VRotl(c, 10);
+		c = b;
+		b = t;
+	}
+};
+
+template <int F> struct RipemdSteps<F, 0> {
+	template <class V> static __forceinline void Run(V&, V&, V&, V&, V&, const V*, const uint8_t*, const uint8_t*, V) {}
+};
+
+template <int F, class V> static __forceinline void RipemdRounds16(V& a, V& b, V& c, V& d, V& e, const V *w, const uint8_t *tableR, const uint8_t *tableS, uint32_t k) {
+	RipemdSteps<F, 16>::Run(a, b, c, d, e, w, tableR, tableS, VSet1(k, a));
+}
+
+template <class V>
+static __forceinline void Ripemd160UpdateLanes(void *pState, const void *pData) {
+	V *state = (V*)pState;
+	V w[16];
+	for (int i = 0; i < 16; ++i)
+		w[i] = VLoad((const V*)pData + i);
+	V al = VLoad(state), bl = VLoad(state + 1), cl = VLoad(state + 2), dl = VLoad(state + 3), el = VLoad(state + 4),
+		ar = al, br = bl, cr = cl, dr = dl, er = el;
+	RipemdRounds16<1>(al, bl, cl, dl, el, w, RL, SL, KL[0]);
+	RipemdRounds16<5>(ar, br, cr, dr, er, w, RR, SR, KR[0]);
+	RipemdRounds16<2>(al, bl, cl, dl, el, w, RL + 16, SL + 16, KL[1]);
+	RipemdRounds16<4>(ar, br, cr, dr, er, w, RR + 16, SR + 16, KR[1]);
+	RipemdRounds16<3>(al, bl, cl, dl, el, w, RL + 32, SL + 32, KL[2]);
+	RipemdRounds16<3>(ar, br, cr, dr, er, w, RR + 32, SR + 32, KR[2]);
+	RipemdRounds16<4>(al, bl, cl, dl, el, w, RL + 48, SL + 48, KL[3]);
+	RipemdRounds16<2>(ar, br, cr, dr, er, w, RR + 48, SR + 48, KR[3]);
+	RipemdRounds16<5>(al, bl, cl, dl, el, w, RL + 64, SL + 64, KL[4]);
+	RipemdRounds16<1>(ar, br, cr, dr, er, w, RR + 64, SR + 64, KR[4]);
+	V t = VAdd(VLoad(state + 1), VAdd(cl, dr));
+	VStore(state + 1, VAdd(VLoad(state + 2), VAdd(dl, er)));
+	VStore(state + 2, VAdd(VLoad(state + 3), VAdd(el, ar)));
+	VStore(state + 3, VAdd(VLoad(state + 4), VAdd(al, br)));
+	VStore(state + 4, VAdd(VLoad(state), VAdd(bl, cr)));
+	VStore(state, t);
 }
 
 void RIPEMD160::HashBlock(void *dst, uint8_t src[256], uint64_t counter) noexcept {
-	uint32_t *p = (uint32_t*)dst;
-	Tuple5  ll = CalcBranch(p, (const uint32_t*)src, RL, SL, KL, s_leftFs),
-			rr = CalcBranch(p, (const uint32_t*)src, RR, SR, KR, s_rightFs);
-	p[0] += ll.B + rr.C;
-	p[1] += ll.C + rr.D;
-	p[2] += ll.D + rr.E;
-	p[3] += ll.E + rr.A;
-	p[4] += ll.A + rr.B;
-	p[0] = exchange(p[1], exchange(p[2], exchange(p[3], exchange(p[4], p[0]))));
+	Ripemd160UpdateLanes<uint32_t>(dst, src);
+}
+
+int RIPEMD160::NWayLanes() noexcept {
+#if UCFG_CPU_X86_X64
+	return s_ripemd160NWayLanes;
+#else
+	return 4;
+#endif
+}
+
+void RIPEMD160::InitNWay(uint32_t *state, int lanes) {
+	for (int i = 0; i < 5; ++i)
+		for (int j = 0; j < lanes; ++j)
+			state[i * lanes + j] = g_repemd160_hinit[i];
+}
+
+void RIPEMD160::UpdateNWay(uint32_t *state, const uint32_t *data, int lanes) {
+#if UCFG_CPU_X86_X64
+	if (lanes > s_ripemd160NWayLanes)
+		Throw(E_INVALIDARG);
+	switch (lanes) {
+	case 4:
+		Ripemd160UpdateLanes<__m128i>(state, data);
+		return;
+	case 8:
+		Ripemd160UpdateLanes<__m256i>(state, data);
+		return;
+	case 16:
+		Ripemd160UpdateLanes<__m512i>(state, data);
+		return;
+	}
+#endif
+	RIPEMD160 rmd;
+	uint32_t p[5], q[16];
+	for (int i = 0; i < lanes; ++i) {
+		for (int j = 0; j < 5; ++j)
+			p[j] = state[j * lanes + i];
+		for (int j = 0; j < 16; ++j)
+			q[j] = data[j * lanes + i];
+		rmd.HashBlock(p, (uint8_t*)q, 0);
+		for (int j = 0; j < 5; ++j)
+			state[j * lanes + i] = p[j];
+	}
+}
+
+// RIPEMD-160 block of a 32-byte message: the SHA-256 state words byte-swapped, then padding and the bit length 256
+static __forceinline uint32_t Sha256WordToRipemd(uint32_t v) {
+	return letoh(htobe(v));
+}
+
+void Hash160(uint8_t dst[20], RCSpan s) {
+	SHA256 sha;
+	DECLSPEC_ALIGN(32) uint32_t h[8];
+	DECLSPEC_ALIGN(32) uint8_t buf[256];
+	sha.InitHash(h);
+	const uint8_t *p = s.data();
+	size_t len = s.size(), cbTail = len % 64;
+	for (const uint8_t *e = p + len - cbTail; p != e; p += 64) {
+		memcpy(buf, p, 64);
+		sha.PrepareEndiannessAndHashBlock(h, buf, 0);
+	}
+	memset(buf, 0, 128);
+	memcpy(buf, p, cbTail);
+	buf[cbTail] = 0x80;
+	int nTail = cbTail + 9 <= 64 ? 1 : 2;
+	*(uint64_t*)(buf + nTail * 64 - 8) = htobe64(uint64_t(len) << 3);
+	sha.PrepareEndiannessAndHashBlock(h, buf, 0);
+	if (nTail == 2)
+		sha.PrepareEndiannessAndHashBlock(h, buf + 64, 0);
+
+	DECLSPEC_ALIGN(32) uint32_t w[64] = { 0 };
+	for (int i = 0; i < 8; ++i)
+		w[i] = Sha256WordToRipemd(h[i]);
+	w[8] = 0x80;
+	w[14] = 256;
+	RIPEMD160 rmd;
+	HashAlgorithm& ralgo = rmd;
+	uint32_t r[5];
+	ralgo.InitHash(r);
+	ralgo.HashBlock(r, (uint8_t*)w, 0);
+	for (int i = 0; i < 5; ++i)
+		*(uint32_t*)(dst + i * 4) = htole(r[i]);
+}
+
+void Hash160Many(uint8_t (*dst)[20], const uint8_t *const *messages, size_t len, size_t n) {
+	const int maxLanes = (min)(SHA256::NWayLanes(), RIPEMD160::NWayLanes());
+	DECLSPEC_ALIGN(64) uint32_t state[8 * 16], data[16 * 16];
+	for (size_t i = 0; i < n;) {
+		size_t rest = n - i;
+		if (rest == 1) {
+			Hash160(dst[i], Span(messages[i], len));
+			break;
+		}
+		int lanes = (min)(maxLanes, rest > 8 ? 16 : rest > 4 ? 8 : 4),
+			cnt = (int)(min)(rest, size_t(lanes));
+		SHA256::HashNWay(state, messages + i, len, cnt, lanes);
+		memset(data, 0, 16 * lanes * sizeof(uint32_t));
+		for (int k = 0; k < lanes; ++k) {
+			for (int j = 0; j < 8; ++j)
+				data[j * lanes + k] = Sha256WordToRipemd(state[j * lanes + k]);
+			data[8 * lanes + k] = 0x80;
+			data[14 * lanes + k] = 256;
+		}
+		RIPEMD160::InitNWay(state, lanes);
+		RIPEMD160::UpdateNWay(state, data, lanes);
+		for (int k = 0; k < cnt; ++k)
+			for (int j = 0; j < 5; ++j)
+				*(uint32_t*)(dst[i + k] + j * 4) = htole(state[j * lanes + k]);
+		i += cnt;
+	}
 }
 
 #if UCFG_USE_OPENSSL
@@ -14,6 +14,7 @@ extern "C" {
 
 #if UCFG_CPU_X86_X64
 	bool s_bHasSse2 = CpuInfo().Features.SSE2;
+	static CpuDispatch::Registration s_regSalsa("Salsa20 core", UCFG_USE_MASM && s_bHasSse2 ? "sse2-asm" : "generic");
 
 	void __cdecl SalsaCore_SSE2(uint32_t w[16], int rounds);
 #endif
@@ -7,6 +7,106 @@ namespace Ext { namespace Crypto {
 void Salsa20Core(uint32_t dst[16], const uint32_t src[16], int rounds = 20) noexcept;
 void ChaCha20Core(uint32_t dst[16], const uint32_t src[16], int rounds = 20) noexcept;
 
+#if UCFG_CPU_X86_X64
+
+// Word-sliced lanes: x[i] holds word i of 4 (__m128i) or 8 (__m256i) independent blocks, so rounds need no shuffles
+
+__forceinline __m128i VAdd32(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+__forceinline __m128i VXor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+__forceinline __m128i VSet1(uint32_t v, __m128i) { return _mm_set1_epi32(v); }
+template <int n> __forceinline __m128i VRotl32(__m128i a) { return _mm_or_si128(_mm_slli_epi32(a, n), _mm_srli_epi32(a, 32 - n)); }
+
+__forceinline __m256i VAdd32(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+__forceinline __m256i VXor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+__forceinline __m256i VSet1(uint32_t v, __m256i) { return _mm256_set1_epi32(v); }
+template <int n> __forceinline __m256i VRotl32(__m256i a) { return _mm256_or_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - n)); }
+
+__forceinline __m512i VAdd32(__m512i a, __m512i b) { return _mm512_add_epi32(a, b); }
+__forceinline __m512i VXor(__m512i a, __m512i b) { return _mm512_xor_si512(a, b); }
+__forceinline __m512i VSet1(uint32_t v, __m512i) { return _mm512_set1_epi32(v); }
+template <int n> __forceinline __m512i VRotl32(__m512i a) { return _mm512_rol_epi32(a, n); }
+
+// Byte-multiple rotations of ChaCha and Blake-256 as shuffles
+template <> __forceinline __m128i VRotl32<16>(__m128i a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xB1), 0xB1); }
+template <> __forceinline __m256i VRotl32<16>(__m256i a) {
+	return _mm256_shuffle_epi8(a, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+}
+template <> __forceinline __m256i VRotl32<8>(__m256i a) {
+	return _mm256_shuffle_epi8(a, _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14));
+}
+template <> __forceinline __m256i VRotl32<24>(__m256i a) {
+	return _mm256_shuffle_epi8(a, _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12, 1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12));
+}
+
+#define SALSA_QUARTER_LANES(a, b, c, d)					\
+	b = VXor(b, VRotl32<7>(VAdd32(a, d)));				\
+	c = VXor(c, VRotl32<9>(VAdd32(b, a)));				\
+	d = VXor(d, VRotl32<13>(VAdd32(c, b)));				\
+	a = VXor(a, VRotl32<18>(VAdd32(d, c)));
+
+#define CHACHA_QUARTER_LANES(a, b, c, d)				\
+	d = VRotl32<16>(VXor(d, a = VAdd32(a, b)));			\
+	b = VRotl32<12>(VXor(b, c = VAdd32(c, d)));			\
+	d = VRotl32<8>(VXor(d, a = VAdd32(a, b)));			\
+	b = VRotl32<7>(VXor(b, c = VAdd32(c, d)));
+
+template <class V>
+void SalsaCoreLanes(V dst[16], const V src[16], int rounds) {
+	V x[16];
+	memcpy(x, src, sizeof x);
+	for (; rounds; rounds -= 2) {
+		SALSA_QUARTER_LANES(x[0], x[4], x[8], x[12]);
+		SALSA_QUARTER_LANES(x[5], x[9], x[13], x[1]);
+		SALSA_QUARTER_LANES(x[10], x[14], x[2], x[6]);
+		SALSA_QUARTER_LANES(x[15], x[3], x[7], x[11]);
+
+		SALSA_QUARTER_LANES(x[0], x[1], x[2], x[3]);
+		SALSA_QUARTER_LANES(x[5], x[6], x[7], x[4]);
+		SALSA_QUARTER_LANES(x[10], x[11], x[8], x[9]);
+		SALSA_QUARTER_LANES(x[15], x[12], x[13], x[14]);
+	}
+	for (int i=0; i<16; ++i)
+		dst[i] = VAdd32(src[i], x[i]);
+}
+
+template <class V>
+void ChaChaCoreLanes(V dst[16], const V src[16], int rounds) {
+	V x[16];
+	memcpy(x, src, sizeof x);
+	for (; rounds; rounds -= 2) {
+		CHACHA_QUARTER_LANES(x[0], x[4], x[8], x[12]);
+		CHACHA_QUARTER_LANES(x[1], x[5], x[9], x[13]);
+		CHACHA_QUARTER_LANES(x[2], x[6], x[10], x[14]);
+		CHACHA_QUARTER_LANES(x[3], x[7], x[11], x[15]);
+		CHACHA_QUARTER_LANES(x[0], x[5], x[10], x[15]);
+		CHACHA_QUARTER_LANES(x[1], x[6], x[11], x[12]);
+		CHACHA_QUARTER_LANES(x[2], x[7], x[8], x[13]);
+		CHACHA_QUARTER_LANES(x[3], x[4], x[9], x[14]);
+	}
+	for (int i=0; i<16; ++i)
+		dst[i] = VAdd32(src[i], x[i]);
+}
+
+#undef SALSA_QUARTER_LANES
+#undef CHACHA_QUARTER_LANES
+
+// Lane counterpart of VectorMix(): BlockMix over 2*r blocks
+template <class V>
+void VectorMixLanes(void (*pfn)(V dst[16], const V src[16], int rounds), V x[][16], V tmp[][16], int r, int rounds) {
+	int mask = 2*r - 1;
+	const V *prev = x[mask];
+	for (int i=0; i<=mask; ++i) {
+		for (int k=0; k<16; ++k)
+			x[i][k] = VXor(x[i][k], prev[k]);
+		V *y = tmp[(i & 1)*r + i/2];
+		pfn(y, x[i], rounds);
+		prev = y;
+	}
+	memcpy(x, tmp, 2*r*sizeof(x[0]));
+}
+
+#endif // UCFG_CPU_X86_X64
+
 
 
 }} // Ext::Crypto::
@@ -109,26 +109,195 @@ hashval CalcPbkdf2Hash(const uint32_t *pIhash, RCSpan data, int idx) {
 }
 
 
-Blob Scrypt(RCSpan password, RCSpan salt, int n, int r, int p, size_t dkLen) {
+static void ScryptSMix(SalsaBlockPtr x, uint32_t *v, SalsaBlockPtr tmp, int n, int r) {
+	for (int i=0; i<n; ++i) {
+		memcpy(&v[i * 32 * r], x, 2*r * sizeof(x[0]));
+		VectorMix(Salsa20Core, x, tmp, r, 8);
+	}
+	for (int i=0; i<n; ++i) {
+		int j = 32*r * (x[2 * r - 1][0] & (n - 1));
+		VectorXor(x[0], &v[j], 2*r*16);
+		VectorMix(Salsa20Core, x, tmp, r, 8);
+	}
+}
+
+#if UCFG_CPU_X86_X64
+
+typedef __m128i (*SalsaLaneBlockPtr)[16];
+
+// SMix of 4 blocks at once; scratchpad holds V (n * 2r lane blocks), X and the BlockMix temporary
+static void ScryptSMixLanes(uint32_t *const blocks[4], int cnt, __m128i *scratchpad, int n, int r) {
+	const int words = 32*r;
+	SalsaLaneBlockPtr v = (SalsaLaneBlockPtr)scratchpad, x = v + 2*r*n, tmp = x + 2*r;
+	__m128i *px = x[0];
+	for (int k=0; k<words; ++k)
+		px[k] = _mm_setr_epi32(blocks[0][k], blocks[1][k], blocks[2][k], blocks[3][k]);
+	for (int i=0; i<n; ++i) {
+		memcpy(v + i*2*r, x, 2*r*sizeof(x[0]));
+		VectorMixLanes(SalsaCoreLanes<__m128i>, x, tmp, r, 8);
+	}
+	DECLSPEC_ALIGN(16) uint32_t j[4];
+	for (int i=0; i<n; ++i) {
+		_mm_store_si128((__m128i*)j, x[2*r - 1][0]);
+		const uint32_t *p0 = (const uint32_t*)(v + (j[0] & (n - 1))*2*r),
+			*p1 = (const uint32_t*)(v + (j[1] & (n - 1))*2*r) + 1,
+			*p2 = (const uint32_t*)(v + (j[2] & (n - 1))*2*r) + 2,
+			*p3 = (const uint32_t*)(v + (j[3] & (n - 1))*2*r) + 3;
+		for (int k=0; k<words; ++k)
+			px[k] = _mm_xor_si128(px[k], _mm_setr_epi32(p0[k*4], p1[k*4], p2[k*4], p3[k*4]));
+		VectorMixLanes(SalsaCoreLanes<__m128i>, x, tmp, r, 8);
+	}
+	for (int k=0; k<words; ++k) {
+		_mm_store_si128((__m128i*)j, px[k]);
+		for (int l=0; l<cnt; ++l)
+			blocks[l][k] = j[l];
+	}
+}
+
+static const int s_scryptLanes = CpuDispatch::Select<int>("scrypt SMix", {
+	{ "sse2 x4", CpuInfo().Features.SSE2, ScryptEngine::SCRYPT_LANES },
+	{ "generic", true, 1 },
+});
+
+#endif // UCFG_CPU_X86_X64
+
+ScryptEngine::ScryptEngine(int n, int r, int p, int nThreads)
+	: N(n)
+	, R(r)
+	, P(p)
+	, m_nThreads(nThreads > 0 ? nThreads : (max)(int(thread::hardware_concurrency()), 1))
+{
+	if (n < 2 || (n & (n - 1)) || r < 1 || p < 1)
+		Throw(E_INVALIDARG);
+}
+
+ScryptEngine::~ScryptEngine() {
+	for (int k = 0; k < 2; ++k)
+		for (size_t i = 0; i < m_freeScratchpads[k].size(); ++i)
+			delete m_freeScratchpads[k][i];
+}
+
+AlignedMem *ScryptEngine::AcquireScratchpad(int lanes) {
+	vector<AlignedMem*>& freeList = m_freeScratchpads[lanes > 1];
+	EXT_LOCK (m_mtx) {
+		if (!freeList.empty()) {
+			AlignedMem *r = freeList.back();
+			freeList.pop_back();
+			return r;
+		}
+	}
+	return new AlignedMem(size_t(N + 2) * R * 128 * lanes, 128);
+}
+
+void ScryptEngine::ReleaseScratchpad(AlignedMem *p, int lanes) {
+	size_t size = size_t(N + 2) * R * 128 * lanes;
+	EXT_LOCK (m_mtx) {
+		vector<AlignedMem*>& freeList = m_freeScratchpads[lanes > 1];
+		if ((freeList.size() + 1) * size <= MAX_RETAINED_SCRATCHPAD) {
+			freeList.push_back(p);
+			return;
+		}
+	}
+	delete p;
+}
+
+void ScryptEngine::SMixGroups(uint32_t *const *blocks, size_t nBlocks, int first, int step, void *scratchpad, int lanes) {
+	for (size_t i = size_t(first) * lanes; i < nBlocks; i += size_t(step) * lanes) {
+		int cnt = int((min)(nBlocks - i, size_t(lanes)));
+#if UCFG_CPU_X86_X64
+		if (cnt > 1) {
+			uint32_t *laneBlocks[SCRYPT_LANES];
+			for (int l = 0; l < SCRYPT_LANES; ++l)
+				laneBlocks[l] = blocks[i + (min)(l, cnt - 1)];
+			ScryptSMixLanes(laneBlocks, cnt, (__m128i*)scratchpad, N, R);
+			continue;
+		}
+#endif
+		SalsaBlockPtr tmp = (SalsaBlockPtr)((uint8_t*)scratchpad + size_t(N + 1) * R * 128);
+		for (int l = 0; l < cnt; ++l)
+			ScryptSMix((SalsaBlockPtr)blocks[i + l], (uint32_t*)scratchpad, tmp, N, R);
+	}
+}
+
+vector<Blob> ScryptEngine::Compute(const vector<Span>& passwords, const vector<Span>& salts, size_t dkLen) {
+	if (passwords.size() != salts.size())
+		Throw(E_INVALIDARG);
 	HmacPseudoRandomFunction<SHA256> prf;
-	const size_t mfLen = r*128;
-	Blob bb = PBKDF2(prf, password, salt, 1, p*mfLen);
-	AlignedMem am((n+1)*r*128, 128);
-	uint32_t *v = (uint32_t*)am.get();
-	SalsaBlockPtr tmp = (SalsaBlockPtr)alloca(r*128);
-	for (int i=0; i<p; ++i) {
-		SalsaBlockPtr x = (SalsaBlockPtr)(bb.data()+i*mfLen);
-		for (int i=0; i<n; ++i) {
-			memcpy(&v[i * 32 * r], x, 2*r * sizeof(x[0]));
-			VectorMix(Salsa20Core, x, tmp, r, 8);
+	const size_t mfLen = R*128;
+	vector<Blob> bbs(passwords.size());
+	vector<uint32_t*> blocks;
+	blocks.reserve(passwords.size() * P);
+	for (size_t i = 0; i < passwords.size(); ++i) {
+		bbs[i] = PBKDF2(prf, passwords[i], salts[i], 1, P*mfLen);
+		for (int k = 0; k < P; ++k)
+			blocks.push_back((uint32_t*)(bbs[i].data() + k*mfLen));
+	}
+
+	int lanes = 1;										// fewer blocks than lanes go one at a time with a single-block scratchpad
+#if UCFG_CPU_X86_X64
+	if (blocks.size() >= SCRYPT_LANES)
+		lanes = s_scryptLanes;
+#endif
+	int nGroups = int((blocks.size() + lanes - 1) / lanes),
+		nWorkers = (min)(m_nThreads, nGroups);
+	struct SMixWork {									// joins the started workers and returns the scratchpads on unwind too
+		ScryptEngine& Engine;
+		int Lanes;
+		vector<AlignedMem*> Scratchpads;
+		vector<thread> Threads;
+
+		SMixWork(ScryptEngine& engine, int lanes, int nWorkers)
+			: Engine(engine)
+			, Lanes(lanes)
+		{
+			Scratchpads.reserve(nWorkers);
+			Threads.reserve(nWorkers);
 		}
-		for (int i=0; i<n; ++i) {
-			int j = 32*r * (x[2 * r - 1][0] & (n - 1));
-			VectorXor(x[0], &v[j], 2*r*16);
-			VectorMix(Salsa20Core, x, tmp, r, 8);
+
+		~SMixWork() {
+			for (size_t i = 0; i < Threads.size(); ++i)
+				Threads[i].join();
+			for (size_t i = 0; i < Scratchpads.size(); ++i)
+				Engine.ReleaseScratchpad(Scratchpads[i], Lanes);
+		}
+	} work(_self, lanes, nWorkers);
+	for (int w = 0; w < nWorkers; ++w)
+		work.Scratchpads.push_back(AcquireScratchpad(lanes));
+	for (int w = 1; w < nWorkers; ++w)					// a single worker runs inline without starting a thread
+		work.Threads.push_back(thread(&ScryptEngine::SMixGroups, this, blocks.data(), blocks.size(), w, nWorkers, work.Scratchpads[w]->get(), lanes));
+	if (nWorkers)
+		SMixGroups(blocks.data(), blocks.size(), 0, nWorkers, work.Scratchpads[0]->get(), lanes);
+
+	vector<Blob> r(passwords.size());
+	for (size_t i = 0; i < passwords.size(); ++i)
+		r[i] = PBKDF2(prf, passwords[i], bbs[i], 1, dkLen);
+	return r;
+}
+
+Blob ScryptEngine::Compute(RCSpan password, RCSpan salt, size_t dkLen) {
+	return Compute(vector<Span>(1, password), vector<Span>(1, salt), dkLen)[0];
+}
+
+Blob Scrypt(RCSpan password, RCSpan salt, int n, int r, int p, size_t dkLen) {
+	const size_t MAX_ENGINES = 4;
+	static mutex s_mtx;
+	static vector<shared_ptr<ScryptEngine>> s_engines;			// of the last parameter sets, most recent last; their scratchpads are reused
+	shared_ptr<ScryptEngine> engine;
+	EXT_LOCK (s_mtx) {
+		for (size_t i = 0; i < s_engines.size(); ++i)
+			if (s_engines[i]->N == n && s_engines[i]->R == r && s_engines[i]->P == p) {
+				engine = s_engines[i];
+				s_engines.erase(s_engines.begin() + i);
+				break;
+			}
+		if (!engine) {
+			engine = make_shared<ScryptEngine>(n, r, p);
+			if (s_engines.size() >= MAX_ENGINES)
+				s_engines.erase(s_engines.begin());
 		}
+		s_engines.push_back(engine);
 	}
-	return PBKDF2(prf, password, bb, 1, dkLen);
+	return engine->Compute(password, salt, dkLen);
 }
 
 CArray8UInt32 CalcSCryptHash(RCSpan password) {
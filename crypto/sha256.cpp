@@ -51,19 +51,31 @@ namespace Ext { namespace Crypto {
 	static const CpuInfo::FeatureInfo& s_features = CpuInfo().Features;
 #endif
 
-#if UCFG_USE_MASM && UCFG_PLATFORM_X64
+#if UCFG_CPU_X86_X64
 	typedef void (_cdecl *PFN_HashBlocks)(const void *input_data, uint32_t digest[8], uint64_t num_blks);
 
+#	if UCFG_USE_MASM && UCFG_PLATFORM_X64
 	extern "C" {
 		void _cdecl Sha256Update_x64_SSE2_BMI2(const void *input_data, uint32_t digest[8], uint64_t num_blks);
 		void _cdecl Sha256Update_x64_AVX2_BMI2(const void *input_data, uint32_t digest[8], uint64_t num_blks);
 	}
+#	endif
+
+	static PFN_HashBlocks s_pfnSha256Blocks = CpuDispatch::Select<PFN_HashBlocks>("SHA-256", {
+		{ "sha-ni", s_features.SHA && s_features.SSE41, Sha256Update_x86x64ShaNi },
+#	if UCFG_USE_MASM && UCFG_PLATFORM_X64
+		{ "avx2-bmi2", s_features.AVX2 && s_features.BMI2, Sha256Update_x64_AVX2_BMI2 },
+		{ "sse2-bmi2", s_features.SSE2 && s_features.BMI2, Sha256Update_x64_SSE2_BMI2 },
+#	endif
+		{ "generic", true, nullptr },
+	});
 
-	static PFN_HashBlocks s_pfnSha256Blocks =
-		s_features.AVX2 && s_features.BMI2 ? Sha256Update_x64_AVX2_BMI2
-		: s_features.SSE2 && s_features.BMI2 ? Sha256Update_x64_SSE2_BMI2
-		: nullptr;
-#endif // UCFG_USE_MASM && UCFG_PLATFORM_X64
+	static const int s_sha256NWayLanes = CpuDispatch::Select<int>("SHA-256 N-way", {
+		{ "avx512 x16", s_features.AVX512F, 16 },
+		{ "avx2 x8", s_features.AVX2, 8 },
+		{ "sse2 x4", true, 4 },
+	});
+#endif // UCFG_CPU_X86_X64
 
 
 static struct Sha256SSEInit {
@@ -121,38 +133,232 @@ void SHA256::HashBlock(void *dst, uint8_t src[256], uint64_t counter) noexcept {
 }
 
 void SHA256::PrepareEndiannessAndHashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept {
-#if UCFG_USE_MASM
-#	if UCFG_PLATFORM_X64
+#if UCFG_CPU_X86_X64
 	if (s_pfnSha256Blocks)
 		s_pfnSha256Blocks(src, (uint32_t*)dst, 1);
 	else
-#	endif	// UCFG_PLATFORM_X64
+#endif
+	{
+#if UCFG_USE_MASM
 		Sha256Update_x86x64((uint32_t*)dst, (const uint32_t*)src);
-#else	// UCFG_USE_MASM
-	PrepareEndianness(src, 16);
-	HashBlock(dst, src, counter);
-#endif	// UCFG_USE_MASM
+#else
+		PrepareEndianness(src, 16);
+		HashBlock(dst, src, counter);
+#endif
+	}
+}
+
+#if UCFG_CPU_X86_X64
+
+extern "C" void _cdecl Sha256Update_x86x64ShaNi(const void *input_data, uint32_t digest[8], uint64_t num_blks) {
+	const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)digest), 0xB1),					// CDAB
+		state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(digest + 4)), 0x1B),				// HGFE
+		state0 = _mm_alignr_epi8(tmp, state1, 8);														// ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);														// CDGH
+
+	for (const __m128i *p = (const __m128i*)input_data; num_blks--; p += 4) {
+		__m128i abef = state0, cdgh = state1, msg[4];
+		for (int i = 0; i < 4; ++i)
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(p + i), mask);
+		for (int i = 0; i < 16; ++i) {
+			__m128i wk = _mm_add_epi32(msg[i & 3], _mm_load_si128((const __m128i*)(g_sha256_k + i * 4)));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+			if (i < 12)
+				msg[i & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]), _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4)), msg[(i + 3) & 3]);
+		}
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);																// FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);															// DCHG
+	_mm_storeu_si128((__m128i*)digest, _mm_blend_epi16(tmp, state1, 0xF0));							// DCBA
+	_mm_storeu_si128((__m128i*)(digest + 4), _mm_alignr_epi8(state1, tmp, 8));							// HGFE
+}
+
+// Lane-parallel kernels: state[8][N] and data[16][N] hold word i of every lane in one vector
+
+static __forceinline __m128i VLoad(const __m128i *p) { return _mm_loadu_si128(p); }
+static __forceinline void VStore(__m128i *p, __m128i a) { _mm_storeu_si128(p, a); }
+static __forceinline __m128i VSet1(uint32_t v, __m128i) { return _mm_set1_epi32(v); }
+static __forceinline __m128i VAdd(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+static __forceinline __m128i VXor(__m128i a, __m128i b, __m128i c) { return _mm_xor_si128(_mm_xor_si128(a, b), c); }
+static __forceinline __m128i VCh(__m128i e, __m128i f, __m128i g) { return _mm_xor_si128(_mm_and_si128(e, _mm_xor_si128(f, g)), g); }
+static __forceinline __m128i VMaj(__m128i a, __m128i b, __m128i c) { return _mm_or_si128(_mm_and_si128(a, b), _mm_and_si128(c, _mm_or_si128(a, b))); }
+template <int n> __forceinline __m128i VShr(__m128i a) { return _mm_srli_epi32(a, n); }
+template <int n> __forceinline __m128i VRotr(__m128i a) { return _mm_or_si128(_mm_srli_epi32(a, n), _mm_slli_epi32(a, 32 - n)); }
+
+static __forceinline __m256i VLoad(const __m256i *p) { return _mm256_loadu_si256(p); }
+static __forceinline void VStore(__m256i *p, __m256i a) { _mm256_storeu_si256(p, a); }
+static __forceinline __m256i VSet1(uint32_t v, __m256i) { return _mm256_set1_epi32(v); }
+static __forceinline __m256i VAdd(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+static __forceinline __m256i VXor(__m256i a, __m256i b, __m256i c) { return _mm256_xor_si256(_mm256_xor_si256(a, b), c); }
+static __forceinline __m256i VCh(__m256i e, __m256i f, __m256i g) { return _mm256_xor_si256(_mm256_and_si256(e, _mm256_xor_si256(f, g)), g); }
+static __forceinline __m256i VMaj(__m256i a, __m256i b, __m256i c) { return _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b))); }
+template <int n> __forceinline __m256i VShr(__m256i a) { return _mm256_srli_epi32(a, n); }
+template <int n> __forceinline __m256i VRotr(__m256i a) { return _mm256_or_si256(_mm256_srli_epi32(a, n), _mm256_slli_epi32(a, 32 - n)); }
+
+static __forceinline __m512i VLoad(const __m512i *p) { return _mm512_loadu_si512(p); }
+static __forceinline void VStore(__m512i *p, __m512i a) { _mm512_storeu_si512(p, a); }
+static __forceinline __m512i VSet1(uint32_t v, __m512i) { return _mm512_set1_epi32(v); }
+static __forceinline __m512i VAdd(__m512i a, __m512i b) { return _mm512_add_epi32(a, b); }
+static __forceinline __m512i VXor(__m512i a, __m512i b, __m512i c) { return _mm512_ternarylogic_epi32(a, b, c, 0x96); }
+static __forceinline __m512i VCh(__m512i e, __m512i f, __m512i g) { return _mm512_ternarylogic_epi32(e, f, g, 0xCA); }
+static __forceinline __m512i VMaj(__m512i a, __m512i b, __m512i c) { return _mm512_ternarylogic_epi32(a, b, c, 0xE8); }
+template <int n> __forceinline __m512i VShr(__m512i a) { return _mm512_srli_epi32(a, n); }
+template <int n> __forceinline __m512i VRotr(__m512i a) { return _mm512_ror_epi32(a, n); }
+
+template <class V>
+static __forceinline void Sha256UpdateLanes(void *pState, const void *pData) {
+	V *state = (V*)pState;
+	const V *data = (const V*)pData;
+	V w[16],
+		a = VLoad(state), b = VLoad(state + 1), c = VLoad(state + 2), d = VLoad(state + 3),
+		e = VLoad(state + 4), f = VLoad(state + 5), g = VLoad(state + 6), h = VLoad(state + 7);
+	for (int i = 0; i < 64; ++i) {
+		if (i < 16)
+			w[i] = VLoad(data + i);
+		else {
+			V w_15 = w[(i-15) & 15], w_2 = w[(i-2) & 15];
+			w[i & 15] = VAdd(VAdd(w[i & 15], VXor(VRotr<7>(w_15), VRotr<18>(w_15), VShr<3>(w_15))), VAdd(w[(i-7) & 15], VXor(VRotr<17>(w_2), VRotr<19>(w_2), VShr<10>(w_2))));
+		}
+		V t1 = VAdd(VAdd(VAdd(h, VXor(VRotr<6>(e), VRotr<11>(e), VRotr<25>(e))), VAdd(VCh(e, f, g), VSet1(g_sha256_k[i], a))), w[i & 15]);
+		h = g; g = f; f = e;
+		e = VAdd(d, t1);
+		d = c; c = b; b = a;
+		a = VAdd(t1, VAdd(VXor(VRotr<2>(b), VRotr<13>(b), VRotr<22>(b)), VMaj(b, c, d)));
+	}
+	VStore(state, VAdd(VLoad(state), a)); VStore(state + 1, VAdd(VLoad(state + 1), b));
+	VStore(state + 2, VAdd(VLoad(state + 2), c)); VStore(state + 3, VAdd(VLoad(state + 3), d));
+	VStore(state + 4, VAdd(VLoad(state + 4), e)); VStore(state + 5, VAdd(VLoad(state + 5), f));
+	VStore(state + 6, VAdd(VLoad(state + 6), g)); VStore(state + 7, VAdd(VLoad(state + 7), h));
 }
 
-#if UCFG_CPU_X86_X64 && !UCFG_USE_MASM
+#	if !UCFG_USE_MASM
 extern "C" void _cdecl Sha256Update_4way_x86x64Sse2(uint32_t state[8][4], const uint32_t data[16][4]) {
+	Sha256UpdateLanes<__m128i>(state, data);
+}
+#	endif
+
+extern "C" void _cdecl Sha256Update_8way_x86x64Avx2(uint32_t state[8][8], const uint32_t data[16][8]) {
+	Sha256UpdateLanes<__m256i>(state, data);
+}
+
+extern "C" void _cdecl Sha256Update_16way_x86x64Avx512(uint32_t state[8][16], const uint32_t data[16][16]) {
+	Sha256UpdateLanes<__m512i>(state, data);
+}
+
+#endif // UCFG_CPU_X86_X64
+
+int SHA256::NWayLanes() noexcept {
+#if UCFG_CPU_X86_X64
+	return s_sha256NWayLanes;
+#else
+	return 4;
+#endif
+}
+
+void SHA256::InitNWay(uint32_t *state, int lanes) {
+	for (int i = 0; i < 8; ++i)
+		for (int j = 0; j < lanes; ++j)
+			state[i * lanes + j] = g_sha256_hinit[i];
+}
+
+void SHA256::UpdateNWay(uint32_t *state, const uint32_t *data, int lanes) {
+#if UCFG_CPU_X86_X64
+	if (lanes > s_sha256NWayLanes)
+		Throw(E_INVALIDARG);
+	switch (lanes) {
+	case 4:
+		Sha256Update_4way_x86x64Sse2((uint32_t(*)[4])state, (const uint32_t(*)[4])data);
+		return;
+	case 8:
+		Sha256Update_8way_x86x64Avx2((uint32_t(*)[8])state, (const uint32_t(*)[8])data);
+		return;
+	case 16:
+		Sha256Update_16way_x86x64Avx512((uint32_t(*)[16])state, (const uint32_t(*)[16])data);
+		return;
+	}
+#endif
 	SHA256 sha;
 	uint32_t p[8], q[16];
-	for (int i=0; i<4; ++i) {
-		for (int j=0; j<8; ++j) {
-			p[j] = state[j][i];
-			q[j*2] = data[j*2][i];
-			q[j*2+1] = data[j*2+1][i];
+	for (int i = 0; i < lanes; ++i) {
+		for (int j = 0; j < 8; ++j)
+			p[j] = state[j * lanes + i];
+		for (int j = 0; j < 16; ++j)
+			q[j] = data[j * lanes + i];
+		sha.HashBlock(p, (uint8_t*)q, 0);
+		for (int j = 0; j < 8; ++j)
+			state[j * lanes + i] = p[j];
+	}
+}
+
+void SHA256::HashNWay(uint32_t *state, const uint8_t *const *messages, size_t len, int cnt, int lanes) {
+	DECLSPEC_ALIGN(64) uint32_t data[16 * 16];
+	uint8_t tails[16][128];
+	size_t nFull = len / 64, cbTail = len % 64;
+	int nTail = cbTail + 9 <= 64 ? 1 : 2;
+	for (int k = 0; k < cnt; ++k) {
+		uint8_t *tail = tails[k];
+		memset(tail, 0, sizeof tails[k]);
+		memcpy(tail, messages[k] + nFull * 64, cbTail);
+		tail[cbTail] = 0x80;
+		*(uint64_t*)(tail + nTail * 64 - 8) = htobe64(uint64_t(len) << 3);
+	}
+	SHA256::InitNWay(state, lanes);
+	for (size_t b = 0; b < nFull + nTail; ++b) {
+		for (int k = 0; k < lanes; ++k) {
+			int m = (min)(k, cnt - 1);
+			const uint32_t *p = (const uint32_t*)(b < nFull ? messages[m] + b * 64 : tails[m] + (b - nFull) * 64);
+			for (int j = 0; j < 16; ++j)
+				data[j * lanes + k] = be32toh(p[j]);
 		}
-		sha.HashBlock(p, (const uint8_t*)q, 0);
-		for (int j=0; j<8; ++j)
-			state[j][i] = p[j];
+		SHA256::UpdateNWay(state, data, lanes);
+	}
+}
+
+// Hashes up to 16 equal-length messages in one pass of the N-way kernel
+static void Sha256HashLanes(uint8_t (*dst)[32], const uint8_t *const *messages, size_t len, int cnt, int lanes, bool bDoubleHash) {
+	DECLSPEC_ALIGN(64) uint32_t state[8 * 16], data[16 * 16];
+	SHA256::HashNWay(state, messages, len, cnt, lanes);
+	if (bDoubleHash) {
+		memcpy(data, state, 8 * lanes * sizeof(uint32_t));
+		memset(data + 8 * lanes, 0, 8 * lanes * sizeof(uint32_t));
+		for (int k = 0; k < lanes; ++k) {
+			data[8 * lanes + k] = 0x80000000;
+			data[15 * lanes + k] = 256;
+		}
+		SHA256::InitNWay(state, lanes);
+		SHA256::UpdateNWay(state, data, lanes);
+	}
+	for (int k = 0; k < cnt; ++k)
+		for (int j = 0; j < 8; ++j)
+			*(uint32_t*)(dst[k] + j * 4) = htobe32(state[j * lanes + k]);
+}
+
+void SHA256::ComputeHashes(uint8_t (*dst)[32], const uint8_t *const *messages, size_t len, size_t n, bool bDoubleHash) {
+	const int maxLanes = NWayLanes();
+	for (size_t i = 0; i < n;) {
+		size_t rest = n - i;
+		if (rest == 1) {
+			SHA256 sha;
+			hashval hv = sha.ComputeHash(Span(messages[i], len));
+			if (bDoubleHash)
+				hv = sha.ComputeHash(Span(hv));
+			memcpy(dst[i], hv.constData(), 32);
+			break;
+		}
+		int lanes = (min)(maxLanes, rest > 8 ? 16 : rest > 4 ? 8 : 4),
+			cnt = (int)(min)(rest, size_t(lanes));
+		Sha256HashLanes(dst + i, messages + i, len, cnt, lanes, bDoubleHash);
+		i += cnt;
 	}
 }
-#endif // UCFG_CPU_X86_X64 && !UCFG_USE_MASM
 
 hashval SHA256::ComputeHash(RCSpan s) {
-#if UCFG_USE_MASM && UCFG_PLATFORM_X64
+#if UCFG_CPU_X86_X64
 	size_t len = s.size();
 	if (s_pfnSha256Blocks && len >= 128) {
 		DECLSPEC_ALIGN(32) uint32_t hash[8];
@@ -11,31 +11,91 @@ using namespace Ext;
 
 namespace Ext { namespace Crypto {
 
+static const uint64_t SIP_INIT[4] = { 0x736f6d6570736575ULL, 0x646f72616e646f6dULL, 0x6c7967656e657261ULL, 0x7465646279746573ULL };
+
 void SipHash2_4::InitHash(void *dst) noexcept {
     uint64_t *v = (uint64_t*)dst;
-    v[0] = 0x736f6d6570736575ULL ^ m_key[0];
-    v[1] = 0x646f72616e646f6dULL ^ m_key[1];
-    v[2] = 0x6c7967656e657261ULL ^ m_key[0];
-    v[3] = 0x7465646279746573ULL ^ m_key[1];
+    v[0] = SIP_INIT[0] ^ m_key[0];
+    v[1] = SIP_INIT[1] ^ m_key[1];
+    v[2] = SIP_INIT[2] ^ m_key[0];
+    v[3] = SIP_INIT[3] ^ m_key[1];
+}
+
+// The rounds are written once over a word type: uint64_t for single keys, SIMD registers holding one key per lane for HashMany()
+static __forceinline uint64_t SipAdd(uint64_t a, uint64_t b) { return a + b; }
+static __forceinline uint64_t SipXor(uint64_t a, uint64_t b) { return a ^ b; }
+template <int n> static __forceinline uint64_t SipRotl(uint64_t a) { return _rotl64(a, n); }
+
+#if UCFG_CPU_X86_X64
+static __forceinline __m256i SipAdd(__m256i a, __m256i b) { return _mm256_add_epi64(a, b); }
+static __forceinline __m256i SipXor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+template <int n> static __forceinline __m256i SipRotl(__m256i a) {
+    return n == 32 ? _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)) : _mm256_or_si256(_mm256_slli_epi64(a, n), _mm256_srli_epi64(a, 64 - n));
+}
+static __forceinline __m256i SipLoad(const __m256i *p, __m256i) { return _mm256_load_si256(p); }
+static __forceinline __m256i SipBroadcast(uint64_t x, __m256i) { return _mm256_set1_epi64x(x); }
+static __forceinline void SipStore(uint64_t *p, __m256i a) { _mm256_store_si256((__m256i*)p, a); }
+
+static __forceinline __m512i SipAdd(__m512i a, __m512i b) { return _mm512_add_epi64(a, b); }
+static __forceinline __m512i SipXor(__m512i a, __m512i b) { return _mm512_xor_si512(a, b); }
+template <int n> static __forceinline __m512i SipRotl(__m512i a) { return _mm512_rol_epi64(a, n); }
+static __forceinline __m512i SipLoad(const __m512i *p, __m512i) { return _mm512_load_si512(p); }
+static __forceinline __m512i SipBroadcast(uint64_t x, __m512i) { return _mm512_set1_epi64(x); }
+static __forceinline void SipStore(uint64_t *p, __m512i a) { _mm512_store_si512(p, a); }
+#endif
+
+template <typename V> static __forceinline void SipSubRound(V& a, V& b, V bRot) {
+    a = SipAdd(a, b);
+    b = SipXor(bRot, a);
+}
+
+template <typename V> static __forceinline void SipRound(V v[4]) {
+    SipSubRound(v[0], v[1], SipRotl<13>(v[1]));
+    v[0] = SipRotl<32>(v[0]);
+    SipSubRound(v[2], v[3], SipRotl<16>(v[3]));
+    SipSubRound(v[0], v[3], SipRotl<21>(v[3]));
+    SipSubRound(v[2], v[1], SipRotl<17>(v[1]));
+    v[2] = SipRotl<32>(v[2]);
 }
 
-static void SipSubRound(uint64_t& a, uint64_t& b, int off) {
-    b ^= a += exchange(b, _rotl64(b, off));
+template <typename V> static __forceinline void SipCompress(V v[4], V m) {
+    v[3] = SipXor(v[3], m);
+    SipRound(v);
+    SipRound(v);
+    v[0] = SipXor(v[0], m);
+}
+
+template <typename V> static __forceinline V SipFinish(V v[4], V ff) {
+    v[2] = SipXor(v[2], ff);
+    for (int i = 0; i < 4; ++i)
+        SipRound(v);
+    return SipXor(SipXor(v[0], v[1]), SipXor(v[2], v[3]));
+}
+
+// Final word: the 0..7 trailing bytes and the length in the top byte
+static __forceinline uint64_t SipLastWord(const uint8_t *p, size_t len) {
+    uint64_t t = 0;
+    memcpy(&t, p + (len & ~size_t(7)), len & 7);
+    return letoh(t) | (uint64_t(len) << 56);
 }
 
 void SipHash2_4::Round(uint64_t v[4]) {
-    SipSubRound(v[0], v[1], 13);
-    v[0] = _rotl64(v[0], 32);
-    SipSubRound(v[2], v[3], 16);
-    SipSubRound(v[0], v[3], 21);
-    SipSubRound(v[2], v[1], 17);
-    v[2] = _rotl64(v[2], 32);
+    SipRound(v);
 }
 
-hashval SipHash2_4::ComputeHash(Stream& stm) {
-    uint64_t v[4];
-    InitHash(v);
-    uint64_t cnt = 0;
+void SipHash2_4::HashBlock(void *dst, uint8_t src[256], uint64_t counter) noexcept {
+    uint64_t *v = (uint64_t*)dst;
+    const uint64_t *m = (const uint64_t*)src;
+    for (int i = 0; i < WordCount; ++i) {
+        v[3] ^= m[i];
+        TwoRounds(v);
+        v[0] ^= m[i];
+    }
+}
+
+hashval SipHash2_4::Finalize(void *hash, Stream& stm, uint64_t processedLen) {
+    uint64_t *v = (uint64_t*)hash;
+    uint64_t cnt = processedLen;
     uint64_t t;
     while (true) {
         t = 0;
@@ -58,4 +118,87 @@ hashval SipHash2_4::ComputeHash(Stream& stm) {
     return hashval((uint8_t*)&r, 8);
 }
 
+hashval SipHash2_4::ComputeHash(Stream& stm) {
+    uint64_t v[4];
+    InitHash(v);
+    return Finalize(v, stm, 0);
+}
+
+hashval SipHash2_4::ComputeHash(RCSpan s) {
+    uint64_t r = htole(Hash(s));
+    return hashval((uint8_t*)&r, 8);
+}
+
+uint64_t SipHash2_4::Hash(RCSpan s) const noexcept {
+    uint64_t v[4] = { SIP_INIT[0] ^ m_key[0], SIP_INIT[1] ^ m_key[1], SIP_INIT[2] ^ m_key[0], SIP_INIT[3] ^ m_key[1] };
+    const uint8_t *p = s.data();
+    size_t len = s.size();
+    for (size_t i = 0; i + 8 <= len; i += 8)
+        SipCompress(v, GetLeUInt64(p + i));
+    SipCompress(v, SipLastWord(p, len));
+    return SipFinish(v, uint64_t(0xFF));
+}
+
+uint64_t SipHash2_4::HashUInt256(const uint8_t p[32]) const noexcept {
+    uint64_t v[4] = { SIP_INIT[0] ^ m_key[0], SIP_INIT[1] ^ m_key[1], SIP_INIT[2] ^ m_key[0], SIP_INIT[3] ^ m_key[1] };
+    for (int i = 0; i < 4; ++i)
+        SipCompress(v, GetLeUInt64(p + i * 8));
+    SipCompress(v, uint64_t(32) << 56);
+    return SipFinish(v, uint64_t(0xFF));
+}
+
+uint64_t SipHash2_4::HashUInt256Extra(const uint8_t p[32], uint32_t extra) const noexcept {
+    uint64_t v[4] = { SIP_INIT[0] ^ m_key[0], SIP_INIT[1] ^ m_key[1], SIP_INIT[2] ^ m_key[0], SIP_INIT[3] ^ m_key[1] };
+    for (int i = 0; i < 4; ++i)
+        SipCompress(v, GetLeUInt64(p + i * 8));
+    SipCompress(v, (uint64_t(36) << 56) | extra);
+    return SipFinish(v, uint64_t(0xFF));
+}
+
+#if UCFG_CPU_X86_X64
+
+static bool s_bSipHasAvx2 = CpuInfo().Features.AVX2,
+    s_bSipHasAvx512 = CpuInfo().Features.AVX512F;
+
+static CpuDispatch::Registration s_regSipHashMany("SipHash-2-4 batch", s_bSipHasAvx512 ? "avx512 x8" : s_bSipHasAvx2 ? "avx2 x4" : "serial");
+
+// Up to N keys, one per lane; unused lanes repeat the first key
+template <typename V, int N> static void SipHashLanes(uint64_t *dst, const uint8_t *const *keys, size_t len, int cnt, const uint64_t key[2]) {
+    const V z = V();
+    V v[4];
+    for (int i = 0; i < 4; ++i)
+        v[i] = SipBroadcast(SIP_INIT[i] ^ key[i & 1], z);
+    DECLSPEC_ALIGN(64) uint64_t w[N];
+    for (size_t off = 0; off + 8 <= len; off += 8) {
+        for (int j = 0; j < N; ++j)
+            w[j] = GetLeUInt64(keys[j < cnt ? j : 0] + off);
+        SipCompress(v, SipLoad((const V*)w, z));
+    }
+    for (int j = 0; j < N; ++j)
+        w[j] = SipLastWord(keys[j < cnt ? j : 0], len);
+    SipCompress(v, SipLoad((const V*)w, z));
+    SipStore(w, SipFinish(v, SipBroadcast(0xFF, z)));
+    memcpy(dst, w, cnt * sizeof(uint64_t));
+}
+
+#endif // UCFG_CPU_X86_X64
+
+void SipHash2_4::HashMany(uint64_t *dst, const uint8_t *const *keys, size_t len, size_t n) const noexcept {
+    size_t i = 0;
+#if UCFG_CPU_X86_X64
+    for (size_t rest; (rest = n - i) > 1; ) {
+        int cnt;
+        if (s_bSipHasAvx512 && rest > 4)
+            SipHashLanes<__m512i, 8>(dst + i, keys + i, len, cnt = (int)(min)(rest, size_t(8)), m_key);
+        else if (s_bSipHasAvx2)
+            SipHashLanes<__m256i, 4>(dst + i, keys + i, len, cnt = (int)(min)(rest, size_t(4)), m_key);
+        else
+            break;
+        i += cnt;
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = Hash(Span(keys[i], len));
+}
+
 }} // Ext::Crypto::
@@ -0,0 +1,742 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Salsa20 / ChaCha20 stream ciphers, Poly1305 and the ChaCha20-Poly1305 AEAD of RFC 8439
+
+#include <el/ext.h>
+
+#include "cipher.h"
+#include "salsa20.h"
+
+namespace Ext { namespace Crypto {
+using namespace std;
+
+static const uint32_t
+	s_sigma[4] = { 0x61707865, 0x3320646E, 0x79622D32, 0x6B206574 },		// "expand 32-byte k"
+	s_tau[4] = { 0x61707865, 0x3120646E, 0x79622D36, 0x6B206574 };		// "expand 16-byte k"
+
+#if UCFG_CPU_X86_X64
+
+static bool s_bStreamHasAvx2 = CpuInfo().Features.AVX2,
+	s_bStreamHasAvx512 = CpuInfo().Features.AVX512F;
+static CpuDispatch::Registration s_regStreamCipher("Salsa20/ChaCha20 stream", s_bStreamHasAvx512 ? "avx512 x16" : s_bStreamHasAvx2 ? "avx2 x8" : "sse2 x4");
+
+// Counters of the blocks c, c+1, ... in the lanes: low words and, for 64-bit counters, high words
+static __forceinline void LaneCounters(__m128i& lo, __m128i& hi, uint64_t c) {
+	lo = _mm_setr_epi32(int(c), int(c + 1), int(c + 2), int(c + 3));
+	hi = _mm_setr_epi32(int((c) >> 32), int((c + 1) >> 32), int((c + 2) >> 32), int((c + 3) >> 32));
+}
+
+static __forceinline void LaneCounters(__m256i& lo, __m256i& hi, uint64_t c) {
+	lo = _mm256_setr_epi32(int(c), int(c + 1), int(c + 2), int(c + 3), int(c + 4), int(c + 5), int(c + 6), int(c + 7));
+	hi = _mm256_setr_epi32(int((c) >> 32), int((c + 1) >> 32), int((c + 2) >> 32), int((c + 3) >> 32),
+		int((c + 4) >> 32), int((c + 5) >> 32), int((c + 6) >> 32), int((c + 7) >> 32));
+}
+
+static __forceinline void LaneCounters(__m512i& lo, __m512i& hi, uint64_t c) {
+	lo = _mm512_add_epi32(_mm512_set1_epi32(int(c)), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	hi = _mm512_mask_add_epi32(_mm512_set1_epi32(int(c >> 32)), _mm512_cmplt_epu32_mask(lo, _mm512_set1_epi32(int(c))), _mm512_set1_epi32(int(c >> 32)), _mm512_set1_epi32(1));
+}
+
+// 4x4 transposes of the word-sliced output y[word][lane] into whole blocks, XORed into the data.
+// r[g][j] gets words 4g..4g+3 of block j in the 1st 128-bit slot, of block j+4 in the 2nd, ...
+template <class V>
+static __forceinline void TransposeLanes(V r[4][4], const V y[16]);
+
+template <> __forceinline void TransposeLanes(__m128i r[4][4], const __m128i y[16]) {
+	for (int g = 0; g < 4; ++g) {
+		const __m128i *x = y + g * 4;
+		__m128i t0 = _mm_unpacklo_epi32(x[0], x[1]), t1 = _mm_unpacklo_epi32(x[2], x[3]),
+			t2 = _mm_unpackhi_epi32(x[0], x[1]), t3 = _mm_unpackhi_epi32(x[2], x[3]);
+		r[g][0] = _mm_unpacklo_epi64(t0, t1);
+		r[g][1] = _mm_unpackhi_epi64(t0, t1);
+		r[g][2] = _mm_unpacklo_epi64(t2, t3);
+		r[g][3] = _mm_unpackhi_epi64(t2, t3);
+	}
+}
+
+template <> __forceinline void TransposeLanes(__m256i r[4][4], const __m256i y[16]) {
+	for (int g = 0; g < 4; ++g) {
+		const __m256i *x = y + g * 4;
+		__m256i t0 = _mm256_unpacklo_epi32(x[0], x[1]), t1 = _mm256_unpacklo_epi32(x[2], x[3]),
+			t2 = _mm256_unpackhi_epi32(x[0], x[1]), t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+		r[g][0] = _mm256_unpacklo_epi64(t0, t1);
+		r[g][1] = _mm256_unpackhi_epi64(t0, t1);
+		r[g][2] = _mm256_unpacklo_epi64(t2, t3);
+		r[g][3] = _mm256_unpackhi_epi64(t2, t3);
+	}
+}
+
+template <> __forceinline void TransposeLanes(__m512i r[4][4], const __m512i y[16]) {
+	for (int g = 0; g < 4; ++g) {
+		const __m512i *x = y + g * 4;
+		__m512i t0 = _mm512_unpacklo_epi32(x[0], x[1]), t1 = _mm512_unpacklo_epi32(x[2], x[3]),
+			t2 = _mm512_unpackhi_epi32(x[0], x[1]), t3 = _mm512_unpackhi_epi32(x[2], x[3]);
+		r[g][0] = _mm512_unpacklo_epi64(t0, t1);
+		r[g][1] = _mm512_unpackhi_epi64(t0, t1);
+		r[g][2] = _mm512_unpacklo_epi64(t2, t3);
+		r[g][3] = _mm512_unpackhi_epi64(t2, t3);
+	}
+}
+
+static __forceinline void XorStoreLanes(const uint8_t *src, uint8_t *dst, const __m128i y[16]) {
+	__m128i r[4][4];
+	TransposeLanes(r, y);
+	for (int j = 0; j < 4; ++j)
+		for (int g = 0; g < 4; ++g) {
+			size_t off = j * 64 + g * 16;
+			_mm_storeu_si128((__m128i*)(dst + off), _mm_xor_si128(r[g][j], _mm_loadu_si128((const __m128i*)(src + off))));
+		}
+}
+
+static __forceinline void XorStoreLanes(const uint8_t *src, uint8_t *dst, const __m256i y[16]) {
+	__m256i r[4][4];
+	TransposeLanes(r, y);
+	for (int j = 0; j < 4; ++j)
+		for (int h = 0; h < 2; ++h) {				// words 0..7, 8..15
+			__m256i a = r[h * 2][j], b = r[h * 2 + 1][j];
+			size_t off = j * 64 + h * 32;
+			_mm256_storeu_si256((__m256i*)(dst + off), _mm256_xor_si256(_mm256_permute2x128_si256(a, b, 0x20), _mm256_loadu_si256((const __m256i*)(src + off))));
+			off += 4 * 64;
+			_mm256_storeu_si256((__m256i*)(dst + off), _mm256_xor_si256(_mm256_permute2x128_si256(a, b, 0x31), _mm256_loadu_si256((const __m256i*)(src + off))));
+		}
+}
+
+static __forceinline void XorStoreLanes(const uint8_t *src, uint8_t *dst, const __m512i y[16]) {
+	__m512i r[4][4];
+	TransposeLanes(r, y);
+	for (int j = 0; j < 4; ++j)
+		for (int h = 0; h < 2; ++h) {				// slots 0-1: blocks j, j+4; slots 2-3: blocks j+8, j+12
+			__m512i a = _mm512_shuffle_i32x4(r[0][j], r[1][j], h ? 0xEE : 0x44),
+				b = _mm512_shuffle_i32x4(r[2][j], r[3][j], h ? 0xEE : 0x44);
+			size_t off = (j + h * 8) * 64;
+			_mm512_storeu_si512(dst + off, _mm512_xor_si512(_mm512_shuffle_i32x4(a, b, 0x88), _mm512_loadu_si512(src + off)));
+			off += 4 * 64;
+			_mm512_storeu_si512(dst + off, _mm512_xor_si512(_mm512_shuffle_i32x4(a, b, 0xDD), _mm512_loadu_si512(src + off)));
+		}
+}
+
+struct SalsaLanes {
+	template <class V> static __forceinline void Core(V dst[16], const V src[16], int rounds) { SalsaCoreLanes(dst, src, rounds); }
+};
+
+struct ChaChaLanes {
+	template <class V> static __forceinline void Core(V dst[16], const V src[16], int rounds) { ChaChaCoreLanes(dst, src, rounds); }
+};
+
+// Keystream of sizeof(V)/4 blocks per core call. Returns the number of blocks done, a multiple of the lane count
+template <class V, class C>
+static size_t XorBlocksLanes(const uint32_t state[16], int idxCounter, bool bCounter64, int rounds, uint64_t counter, const uint8_t *src, uint8_t *dst, size_t n) {
+	const size_t lanes = sizeof(V) / 4;
+	V x[16], y[16];
+	for (int i = 0; i < 16; ++i)
+		x[i] = VSet1(state[i], V());
+	size_t done = 0;
+	for (; n - done >= lanes; done += lanes, counter += lanes, src += lanes * 64, dst += lanes * 64) {
+		V hi;
+		LaneCounters(x[idxCounter], hi, counter);
+		if (bCounter64)
+			x[idxCounter + 1] = hi;
+		C::Core(y, x, rounds);
+		XorStoreLanes(src, dst, y);
+	}
+	return done;
+}
+
+template <class C>
+static size_t XorBlocksSimd(const uint32_t state[16], int idxCounter, bool bCounter64, int rounds, uint64_t counter, const uint8_t *src, uint8_t *dst, size_t n) {
+	size_t done = s_bStreamHasAvx512 ? XorBlocksLanes<__m512i, C>(state, idxCounter, bCounter64, rounds, counter, src, dst, n)
+		: s_bStreamHasAvx2 ? XorBlocksLanes<__m256i, C>(state, idxCounter, bCounter64, rounds, counter, src, dst, n)
+		: 0;
+	return done + XorBlocksLanes<__m128i, C>(state, idxCounter, bCounter64, rounds, counter + done, src + done * 64, dst + done * 64, n - done);
+}
+
+#endif // UCFG_CPU_X86_X64
+
+StreamCipher::StreamCipher(int idxCounter, bool bCounter64, int rounds)
+	: m_ksPos(64)
+	, m_counter0(0)
+	, m_rounds(rounds)
+	, m_idxCounter(idxCounter)
+	, m_bCounter64(bCounter64)
+{
+	if (rounds <= 0 || (rounds & 1))
+		Throw(errc::invalid_argument);
+	ZeroStruct(m_state);
+}
+
+uint64_t StreamCipher::GetCounter() const {
+	return m_bCounter64 ? (uint64_t(m_state[m_idxCounter + 1]) << 32) | m_state[m_idxCounter] : m_state[m_idxCounter];
+}
+
+void StreamCipher::SetCounter(uint64_t counter) {
+	m_state[m_idxCounter] = uint32_t(counter);
+	if (m_bCounter64)
+		m_state[m_idxCounter + 1] = uint32_t(counter >> 32);
+}
+
+void StreamCipher::Crypt(const uint8_t *src, uint8_t *dst, size_t size) {
+	for (; size && m_ksPos < 64; --size)
+		*dst++ = *src++ ^ m_ks[m_ksPos++];
+	if (size_t n = size / 64) {
+		XorBlocks(src, dst, n);
+		src += n * 64;
+		dst += n * 64;
+		size -= n * 64;
+	}
+	if (size) {
+		memset(m_ks, 0, sizeof m_ks);
+		XorBlocks(m_ks, m_ks, 1);
+		for (m_ksPos = 0; m_ksPos < size; ++m_ksPos)
+			dst[m_ksPos] = src[m_ksPos] ^ m_ks[m_ksPos];
+	}
+}
+
+Blob StreamCipher::Crypt(RCSpan cbuf) {
+	Blob r(0, cbuf.size());
+	Crypt(cbuf.data(), r.data(), cbuf.size());
+	return r;
+}
+
+void StreamCipher::Seek(uint64_t pos) {
+	SetCounter(m_counter0 + pos / 64);
+	m_ksPos = 64;
+	if (size_t off = size_t(pos % 64)) {
+		memset(m_ks, 0, sizeof m_ks);
+		XorBlocks(m_ks, m_ks, 1);
+		m_ksPos = off;
+	}
+}
+
+static void XorBlock(const uint32_t ks[16], const uint8_t *src, uint8_t *dst) {
+	for (int i = 0; i < 16; ++i)
+		PutLeUInt32(dst + i * 4, GetLeUInt32(src + i * 4) ^ ks[i]);
+}
+
+Salsa20::Salsa20(RCSpan key, RCSpan nonce, int rounds)
+	: StreamCipher(8, true, rounds)
+{
+	if (key.size() != 16 && key.size() != 32 || nonce.size() != 8)
+		Throw(errc::invalid_argument);
+	const uint32_t *c = key.size() == 32 ? s_sigma : s_tau;
+	const uint8_t *k = key.data(), *k2 = k + key.size() - 16;
+	m_state[0] = c[0];
+	m_state[5] = c[1];
+	m_state[10] = c[2];
+	m_state[15] = c[3];
+	for (int i = 0; i < 4; ++i) {
+		m_state[1 + i] = GetLeUInt32(k + i * 4);
+		m_state[11 + i] = GetLeUInt32(k2 + i * 4);
+	}
+	m_state[6] = GetLeUInt32(nonce.data());
+	m_state[7] = GetLeUInt32(nonce.data() + 4);
+}
+
+void Salsa20::XorBlocks(const uint8_t *src, uint8_t *dst, size_t n) {
+	uint64_t counter = GetCounter();
+#if UCFG_CPU_X86_X64
+	size_t done = XorBlocksSimd<SalsaLanes>(m_state, m_idxCounter, m_bCounter64, m_rounds, counter, src, dst, n);
+	counter += done;
+	src += done * 64;
+	dst += done * 64;
+	n -= done;
+#endif
+	uint32_t ks[16];
+	for (; n--; ++counter, src += 64, dst += 64) {
+		SetCounter(counter);
+		Salsa20Core(ks, m_state, m_rounds);
+		XorBlock(ks, src, dst);
+	}
+	SetCounter(counter);
+}
+
+ChaCha20::ChaCha20(RCSpan key, RCSpan nonce, uint32_t counter, int rounds)
+	: StreamCipher(12, nonce.size() == 8, rounds)
+{
+	if (key.size() != 32 || nonce.size() != 8 && nonce.size() != 12)
+		Throw(errc::invalid_argument);
+	memcpy(m_state, s_sigma, sizeof s_sigma);
+	for (int i = 0; i < 8; ++i)
+		m_state[4 + i] = GetLeUInt32(key.data() + i * 4);
+	for (size_t i = 0, cnt = nonce.size() / 4; i < cnt; ++i)
+		m_state[16 - cnt + i] = GetLeUInt32(nonce.data() + i * 4);
+	SetCounter(m_counter0 = counter);
+}
+
+void ChaCha20::XorBlocks(const uint8_t *src, uint8_t *dst, size_t n) {
+	uint64_t counter = GetCounter();
+#if UCFG_CPU_X86_X64
+	size_t done = XorBlocksSimd<ChaChaLanes>(m_state, m_idxCounter, m_bCounter64, m_rounds, counter, src, dst, n);
+	counter += done;
+	src += done * 64;
+	dst += done * 64;
+	n -= done;
+#endif
+	uint32_t ks[16];
+	for (; n--; ++counter, src += 64, dst += 64) {
+		SetCounter(counter);
+		ChaCha20Core(ks, m_state, m_rounds);
+		XorBlock(ks, src, dst);
+	}
+	SetCounter(counter);
+}
+
+static const uint32_t POLY1305_MASK26 = 0x3FFFFFF;
+
+#if UCFG_64
+
+// Poly1305 in limbs of 44, 44 and 42 bits (poly1305-donna-64): 9 multiplications per block
+
+#	ifdef _MSC_VER
+struct Poly1305UInt128 {
+	uint64_t Lo, Hi;
+};
+
+static __forceinline Poly1305UInt128 Mul64(uint64_t a, uint64_t b) {
+	Poly1305UInt128 r;
+	r.Lo = _umul128(a, b, &r.Hi);
+	return r;
+}
+
+static __forceinline void Add(Poly1305UInt128& r, Poly1305UInt128 a) {
+	r.Hi += a.Hi + _addcarry_u64(0, r.Lo, a.Lo, &r.Lo);
+}
+
+static __forceinline void Add(Poly1305UInt128& r, uint64_t a) {
+	r.Hi += _addcarry_u64(0, r.Lo, a, &r.Lo);
+}
+
+static __forceinline uint64_t Shr(Poly1305UInt128 a, int n) { return __shiftright128(a.Lo, a.Hi, (unsigned char)n); }
+static __forceinline uint64_t Lo(Poly1305UInt128 a) { return a.Lo; }
+#	else
+typedef unsigned __int128 Poly1305UInt128;
+
+static __forceinline Poly1305UInt128 Mul64(uint64_t a, uint64_t b) { return Poly1305UInt128(a) * b; }
+static __forceinline void Add(Poly1305UInt128& r, Poly1305UInt128 a) { r += a; }
+static __forceinline uint64_t Shr(Poly1305UInt128 a, int n) { return uint64_t(a >> n); }
+static __forceinline uint64_t Lo(Poly1305UInt128 a) { return uint64_t(a); }
+#	endif
+
+static const uint64_t POLY1305_MASK44 = 0xFFFFFFFFFFF,
+	POLY1305_MASK42 = 0x3FFFFFFFFFF;
+
+Poly1305::Poly1305(const uint8_t key[32])
+	: m_cbBuf(0)
+{
+	uint64_t t0 = GetLeUInt64(key), t1 = GetLeUInt64(key + 8);
+	m_r[0] = t0 & 0xFFC0FFFFFFF;					// clamped r
+	m_r[1] = ((t0 >> 44) | (t1 << 20)) & 0xFFFFFC0FFFF;
+	m_r[2] = (t1 >> 24) & 0x00FFFFFFC0F;
+	ZeroStruct(m_h);
+	m_pad[0] = GetLeUInt64(key + 16);
+	m_pad[1] = GetLeUInt64(key + 24);
+}
+
+static void Poly1305Blocks(uint64_t st[3], const uint64_t r[3], const uint8_t *p, size_t n, bool bFull) {
+	const uint64_t r0 = r[0], r1 = r[1], r2 = r[2],
+		s1 = r1 * (5 << 2), s2 = r2 * (5 << 2),
+		hibit = bFull ? uint64_t(1) << 40 : 0;
+	uint64_t h0 = st[0], h1 = st[1], h2 = st[2];
+	for (; n--; p += 16) {
+		uint64_t t0 = GetLeUInt64(p), t1 = GetLeUInt64(p + 8);
+		h0 += t0 & POLY1305_MASK44;
+		h1 += ((t0 >> 44) | (t1 << 20)) & POLY1305_MASK44;
+		h2 += ((t1 >> 24) & POLY1305_MASK42) | hibit;
+
+		Poly1305UInt128 d0 = Mul64(h0, r0), d1 = Mul64(h0, r1), d2 = Mul64(h0, r2);
+		Add(d0, Mul64(h1, s2));
+		Add(d0, Mul64(h2, s1));
+		Add(d1, Mul64(h1, r0));
+		Add(d1, Mul64(h2, s2));
+		Add(d2, Mul64(h1, r1));
+		Add(d2, Mul64(h2, r0));
+
+		h0 = Lo(d0) & POLY1305_MASK44;
+		Add(d1, Shr(d0, 44));
+		h1 = Lo(d1) & POLY1305_MASK44;
+		Add(d2, Shr(d1, 44));
+		h2 = Lo(d2) & POLY1305_MASK42;
+		h0 += Shr(d2, 42) * 5;
+		h1 += h0 >> 44;
+		h0 &= POLY1305_MASK44;
+	}
+	st[0] = h0;
+	st[1] = h1;
+	st[2] = h2;
+}
+
+// Between the 44-bit and the 26-bit limbs of the SIMD kernel; both sides may be partially reduced
+
+static void Poly1305ToLimbs26(uint32_t d[5], const uint64_t s[3]) {
+	uint64_t h0 = s[0], h1 = s[1], h2 = s[2];
+	h2 += h1 >> 44;
+	h1 &= POLY1305_MASK44;
+	uint64_t lo = h0 | (h1 << 44), hi = (h1 >> 20) | (h2 << 24);
+	d[0] = uint32_t(lo) & POLY1305_MASK26;
+	d[1] = uint32_t(lo >> 26) & POLY1305_MASK26;
+	d[2] = uint32_t((lo >> 52) | (hi << 12)) & POLY1305_MASK26;
+	d[3] = uint32_t(hi >> 14) & POLY1305_MASK26;
+	d[4] = uint32_t(hi >> 40) | uint32_t(h2 >> 40 << 24);
+}
+
+static void Poly1305FromLimbs26(uint64_t d[3], const uint32_t s[5]) {
+	uint64_t h0 = s[0] + (uint64_t(s[1]) << 26),
+		h1 = (uint64_t(s[2]) << 8) + (uint64_t(s[3]) << 34),
+		h2 = uint64_t(s[4]) << 16, c;
+	c = h0 >> 44; h0 &= POLY1305_MASK44; h1 += c;
+	c = h1 >> 44; h1 &= POLY1305_MASK44; h2 += c;
+	c = h2 >> 42; h2 &= POLY1305_MASK42; h0 += c * 5;
+	c = h0 >> 44; h0 &= POLY1305_MASK44; h1 += c;
+	d[0] = h0;
+	d[1] = h1;
+	d[2] = h2;
+}
+
+void Poly1305::Final(uint8_t tag[16]) {
+	if (m_cbBuf) {
+		m_buf[m_cbBuf] = 1;
+		memset(m_buf + m_cbBuf + 1, 0, 15 - m_cbBuf);
+		Blocks(m_buf, 1, false);
+		m_cbBuf = 0;
+	}
+	uint64_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], c;
+	for (int i = 0; i < 2; ++i) {
+		c = h1 >> 44; h1 &= POLY1305_MASK44; h2 += c;
+		c = h2 >> 42; h2 &= POLY1305_MASK42; h0 += c * 5;
+		c = h0 >> 44; h0 &= POLY1305_MASK44; h1 += c;
+	}
+
+	uint64_t g0 = h0 + 5, g1, g2;					// h - p = h + 5 - 2^130
+	c = g0 >> 44; g0 &= POLY1305_MASK44;
+	g1 = h1 + c; c = g1 >> 44; g1 &= POLY1305_MASK44;
+	g2 = h2 + c - (uint64_t(1) << 42);
+
+	uint64_t mask = (g2 >> 63) - 1;					// constant-time select of h - p when h >= p
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+
+	uint64_t t0 = m_pad[0], t1 = m_pad[1];
+	h0 += t0 & POLY1305_MASK44; c = h0 >> 44; h0 &= POLY1305_MASK44;
+	h1 += (((t0 >> 44) | (t1 << 20)) & POLY1305_MASK44) + c; c = h1 >> 44; h1 &= POLY1305_MASK44;
+	h2 += (t1 >> 24) + c; h2 &= POLY1305_MASK42;
+	PutLeUInt64(tag, h0 | (h1 << 44));
+	PutLeUInt64(tag + 8, (h1 >> 20) | (h2 << 24));
+}
+
+#else // UCFG_64
+
+// Poly1305 in 5 limbs of 26 bits (poly1305-donna-32), so all products fit into 64 bits
+Poly1305::Poly1305(const uint8_t key[32])
+	: m_cbBuf(0)
+{
+	m_r[0] = GetLeUInt32(key) & 0x3FFFFFF;			// clamped r
+	m_r[1] = (GetLeUInt32(key + 3) >> 2) & 0x3FFFF03;
+	m_r[2] = (GetLeUInt32(key + 6) >> 4) & 0x3FFC0FF;
+	m_r[3] = (GetLeUInt32(key + 9) >> 6) & 0x3F03FFF;
+	m_r[4] = (GetLeUInt32(key + 12) >> 8) & 0x00FFFFF;
+	ZeroStruct(m_h);
+	for (int i = 0; i < 4; ++i)
+		m_pad[i] = GetLeUInt32(key + 16 + i * 4);
+}
+
+static void Poly1305Blocks(uint32_t st[5], const uint32_t r[5], const uint8_t *p, size_t n, bool bFull) {
+	const uint32_t r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4],
+		s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5,
+		hibit = bFull ? 1 << 24 : 0;
+	uint32_t h0 = st[0], h1 = st[1], h2 = st[2], h3 = st[3], h4 = st[4];
+	for (; n--; p += 16) {
+		h0 += GetLeUInt32(p) & POLY1305_MASK26;
+		h1 += (GetLeUInt32(p + 3) >> 2) & POLY1305_MASK26;
+		h2 += (GetLeUInt32(p + 6) >> 4) & POLY1305_MASK26;
+		h3 += (GetLeUInt32(p + 9) >> 6) & POLY1305_MASK26;
+		h4 += (GetLeUInt32(p + 12) >> 8) | hibit;
+
+		uint64_t d0 = uint64_t(h0) * r0 + uint64_t(h1) * s4 + uint64_t(h2) * s3 + uint64_t(h3) * s2 + uint64_t(h4) * s1,
+			d1 = uint64_t(h0) * r1 + uint64_t(h1) * r0 + uint64_t(h2) * s4 + uint64_t(h3) * s3 + uint64_t(h4) * s2,
+			d2 = uint64_t(h0) * r2 + uint64_t(h1) * r1 + uint64_t(h2) * r0 + uint64_t(h3) * s4 + uint64_t(h4) * s3,
+			d3 = uint64_t(h0) * r3 + uint64_t(h1) * r2 + uint64_t(h2) * r1 + uint64_t(h3) * r0 + uint64_t(h4) * s4,
+			d4 = uint64_t(h0) * r4 + uint64_t(h1) * r3 + uint64_t(h2) * r2 + uint64_t(h3) * r1 + uint64_t(h4) * r0;
+
+		h0 = uint32_t(d0) & POLY1305_MASK26;
+		h1 = uint32_t(d1 += d0 >> 26) & POLY1305_MASK26;
+		h2 = uint32_t(d2 += d1 >> 26) & POLY1305_MASK26;
+		h3 = uint32_t(d3 += d2 >> 26) & POLY1305_MASK26;
+		h4 = uint32_t(d4 += d3 >> 26) & POLY1305_MASK26;
+		h0 += uint32_t(d4 >> 26) * 5;
+		h1 += h0 >> 26;
+		h0 &= POLY1305_MASK26;
+	}
+	st[0] = h0;
+	st[1] = h1;
+	st[2] = h2;
+	st[3] = h3;
+	st[4] = h4;
+}
+
+static __forceinline void Poly1305ToLimbs26(uint32_t d[5], const uint32_t s[5]) { memcpy(d, s, 5 * sizeof(uint32_t)); }
+static __forceinline void Poly1305FromLimbs26(uint32_t d[5], const uint32_t s[5]) { memcpy(d, s, 5 * sizeof(uint32_t)); }
+
+void Poly1305::Final(uint8_t tag[16]) {
+	if (m_cbBuf) {
+		m_buf[m_cbBuf] = 1;
+		memset(m_buf + m_cbBuf + 1, 0, 15 - m_cbBuf);
+		Blocks(m_buf, 1, false);
+		m_cbBuf = 0;
+	}
+	uint32_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], h3 = m_h[3], h4 = m_h[4], c;
+	c = h1 >> 26; h1 &= POLY1305_MASK26; h2 += c;
+	c = h2 >> 26; h2 &= POLY1305_MASK26; h3 += c;
+	c = h3 >> 26; h3 &= POLY1305_MASK26; h4 += c;
+	c = h4 >> 26; h4 &= POLY1305_MASK26; h0 += c * 5;
+	c = h0 >> 26; h0 &= POLY1305_MASK26; h1 += c;
+
+	uint32_t g0 = h0 + 5, g1, g2, g3, g4;			// h - p = h + 5 - 2^130
+	c = g0 >> 26; g0 &= POLY1305_MASK26;
+	g1 = h1 + c; c = g1 >> 26; g1 &= POLY1305_MASK26;
+	g2 = h2 + c; c = g2 >> 26; g2 &= POLY1305_MASK26;
+	g3 = h3 + c; c = g3 >> 26; g3 &= POLY1305_MASK26;
+	g4 = h4 + c - (1 << 26);
+
+	uint32_t mask = (g4 >> 31) - 1;					// constant-time select of h - p when h >= p
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+	h3 = (h3 & ~mask) | (g3 & mask);
+	h4 = (h4 & ~mask) | (g4 & mask);
+
+	uint32_t w[4] = {
+		h0 | (h1 << 26),
+		(h1 >> 6) | (h2 << 20),
+		(h2 >> 12) | (h3 << 14),
+		(h3 >> 18) | (h4 << 8)
+	};
+	uint64_t f = 0;
+	for (int i = 0; i < 4; ++i) {
+		f = uint64_t(w[i]) + m_pad[i] + (f >> 32);
+		PutLeUInt32(tag + i * 4, uint32_t(f));
+	}
+}
+
+#endif // UCFG_64
+
+#if UCFG_CPU_X86_X64
+
+// 4-way Poly1305: lane i accumulates the blocks 4k+i, multiplied by r^4 per step and by r^(4-i) after the last one
+
+static bool s_bPoly1305Avx2 = CpuInfo().Features.AVX2;
+static CpuDispatch::Registration s_regPoly1305("Poly1305", s_bPoly1305Avx2 ? "avx2 x4" : UCFG_64 ? "donna-64" : "donna-32");
+
+static const size_t POLY1305_SIMD_MIN_BLOCKS = 16;
+
+static void Poly1305MulMod26(uint32_t h[5], const uint32_t r[5]) {
+	const uint64_t s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+	uint64_t d0 = h[0] * uint64_t(r[0]) + h[1] * s4 + h[2] * s3 + h[3] * s2 + h[4] * s1,
+		d1 = h[0] * uint64_t(r[1]) + h[1] * uint64_t(r[0]) + h[2] * s4 + h[3] * s3 + h[4] * s2,
+		d2 = h[0] * uint64_t(r[2]) + h[1] * uint64_t(r[1]) + h[2] * uint64_t(r[0]) + h[3] * s4 + h[4] * s3,
+		d3 = h[0] * uint64_t(r[3]) + h[1] * uint64_t(r[2]) + h[2] * uint64_t(r[1]) + h[3] * uint64_t(r[0]) + h[4] * s4,
+		d4 = h[0] * uint64_t(r[4]) + h[1] * uint64_t(r[3]) + h[2] * uint64_t(r[2]) + h[3] * uint64_t(r[1]) + h[4] * uint64_t(r[0]);
+	h[0] = uint32_t(d0) & POLY1305_MASK26;
+	h[1] = uint32_t(d1 += d0 >> 26) & POLY1305_MASK26;
+	h[2] = uint32_t(d2 += d1 >> 26) & POLY1305_MASK26;
+	h[3] = uint32_t(d3 += d2 >> 26) & POLY1305_MASK26;
+	h[4] = uint32_t(d4 += d3 >> 26) & POLY1305_MASK26;
+	h[0] += uint32_t(d4 >> 26) * 5;
+	h[1] += h[0] >> 26;
+	h[0] &= POLY1305_MASK26;
+}
+
+// h = h * r mod 2^130-5 in the 64-bit lanes, s = 5*r
+static __forceinline void Poly1305MulAvx2(__m256i h[5], const __m256i r[5], const __m256i s[5]) {
+	__m256i d0 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[0]), _mm256_mul_epu32(h[1], s[4])), _mm256_add_epi64(_mm256_mul_epu32(h[2], s[3]), _mm256_mul_epu32(h[3], s[2]))), _mm256_mul_epu32(h[4], s[1])),
+		d1 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[1]), _mm256_mul_epu32(h[1], r[0])), _mm256_add_epi64(_mm256_mul_epu32(h[2], s[4]), _mm256_mul_epu32(h[3], s[3]))), _mm256_mul_epu32(h[4], s[2])),
+		d2 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[2]), _mm256_mul_epu32(h[1], r[1])), _mm256_add_epi64(_mm256_mul_epu32(h[2], r[0]), _mm256_mul_epu32(h[3], s[4]))), _mm256_mul_epu32(h[4], s[3])),
+		d3 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[3]), _mm256_mul_epu32(h[1], r[2])), _mm256_add_epi64(_mm256_mul_epu32(h[2], r[1]), _mm256_mul_epu32(h[3], r[0]))), _mm256_mul_epu32(h[4], s[4])),
+		d4 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[4]), _mm256_mul_epu32(h[1], r[3])), _mm256_add_epi64(_mm256_mul_epu32(h[2], r[2]), _mm256_mul_epu32(h[3], r[1]))), _mm256_mul_epu32(h[4], r[0]));
+	const __m256i mask = _mm256_set1_epi64x(POLY1305_MASK26);
+	d1 = _mm256_add_epi64(d1, _mm256_srli_epi64(d0, 26));
+	d2 = _mm256_add_epi64(d2, _mm256_srli_epi64(d1, 26));
+	d3 = _mm256_add_epi64(d3, _mm256_srli_epi64(d2, 26));
+	d4 = _mm256_add_epi64(d4, _mm256_srli_epi64(d3, 26));
+	__m256i c = _mm256_srli_epi64(d4, 26);
+	d0 = _mm256_add_epi64(_mm256_and_si256(d0, mask), _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+	h[0] = _mm256_and_si256(d0, mask);
+	h[1] = _mm256_add_epi64(_mm256_and_si256(d1, mask), _mm256_srli_epi64(d0, 26));
+	h[2] = _mm256_and_si256(d2, mask);
+	h[3] = _mm256_and_si256(d3, mask);
+	h[4] = _mm256_and_si256(d4, mask);
+}
+
+// n is a multiple of 4, all blocks are full
+static void Poly1305BlocksAvx2(uint32_t h[5], const uint32_t r[5], const uint8_t *p, size_t n) {
+	uint32_t rp[4][5];									// r^4, r^3, r^2, r
+	memcpy(rp[3], r, sizeof rp[3]);
+	for (int i = 2; i >= 0; --i) {
+		memcpy(rp[i], rp[i + 1], sizeof rp[i]);
+		Poly1305MulMod26(rp[i], r);
+	}
+	__m256i r4[5], s4[5], rl[5], sl[5], hv[5];
+	for (int j = 0; j < 5; ++j) {
+		r4[j] = _mm256_set1_epi64x(rp[0][j]);
+		rl[j] = _mm256_setr_epi64x(rp[0][j], rp[1][j], rp[2][j], rp[3][j]);
+		s4[j] = _mm256_add_epi64(r4[j], _mm256_slli_epi64(r4[j], 2));
+		sl[j] = _mm256_add_epi64(rl[j], _mm256_slli_epi64(rl[j], 2));
+		hv[j] = _mm256_setr_epi64x(h[j], 0, 0, 0);
+	}
+	const __m256i mask = _mm256_set1_epi64x(POLY1305_MASK26),
+		hibit = _mm256_set1_epi64x(1 << 24);
+	for (;; p += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)p), b = _mm256_loadu_si256((const __m256i*)(p + 32)),
+			t0 = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xD8),		// low qwords of the 4 blocks
+			t1 = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xD8);
+		hv[0] = _mm256_add_epi64(hv[0], _mm256_and_si256(t0, mask));
+		hv[1] = _mm256_add_epi64(hv[1], _mm256_and_si256(_mm256_srli_epi64(t0, 26), mask));
+		hv[2] = _mm256_add_epi64(hv[2], _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(t0, 52), _mm256_slli_epi64(t1, 12)), mask));
+		hv[3] = _mm256_add_epi64(hv[3], _mm256_and_si256(_mm256_srli_epi64(t1, 14), mask));
+		hv[4] = _mm256_add_epi64(hv[4], _mm256_or_si256(_mm256_srli_epi64(t1, 40), hibit));
+		if (!(n -= 4))
+			break;
+		Poly1305MulAvx2(hv, r4, s4);
+	}
+	Poly1305MulAvx2(hv, rl, sl);
+
+	DECLSPEC_ALIGN(32) uint64_t lanes[4];
+	uint64_t d[5];
+	for (int j = 0; j < 5; ++j) {
+		_mm256_store_si256((__m256i*)lanes, hv[j]);
+		d[j] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	d[1] += d[0] >> 26;
+	d[2] += d[1] >> 26;
+	d[3] += d[2] >> 26;
+	d[4] += d[3] >> 26;
+	d[0] = (d[0] & POLY1305_MASK26) + (d[4] >> 26) * 5;
+	h[0] = uint32_t(d[0]) & POLY1305_MASK26;
+	h[1] = uint32_t(d[1] & POLY1305_MASK26) + uint32_t(d[0] >> 26);
+	h[2] = uint32_t(d[2]) & POLY1305_MASK26;
+	h[3] = uint32_t(d[3]) & POLY1305_MASK26;
+	h[4] = uint32_t(d[4]) & POLY1305_MASK26;
+}
+
+#endif // UCFG_CPU_X86_X64
+
+void Poly1305::Blocks(const uint8_t *p, size_t n, bool bFull) {
+#if UCFG_CPU_X86_X64
+	if (bFull && n >= POLY1305_SIMD_MIN_BLOCKS && s_bPoly1305Avx2) {
+		uint32_t h[5], r[5];
+		Poly1305ToLimbs26(h, m_h);
+		Poly1305ToLimbs26(r, m_r);
+		size_t nv = n & ~size_t(3);
+		Poly1305BlocksAvx2(h, r, p, nv);
+		Poly1305FromLimbs26(m_h, h);
+		p += nv * 16;
+		n -= nv;
+	}
+#endif
+	Poly1305Blocks(m_h, m_r, p, n, bFull);
+}
+
+Poly1305& Poly1305::Update(RCSpan s) {
+	const uint8_t *p = s.data();
+	size_t size = s.size();
+	if (m_cbBuf) {
+		size_t n = (min)(size, 16 - m_cbBuf);
+		memcpy(m_buf + m_cbBuf, p, n);
+		p += n;
+		size -= n;
+		if ((m_cbBuf += n) < 16)
+			return *this;
+		Blocks(m_buf, 1, true);
+		m_cbBuf = 0;
+	}
+	if (size_t n = size / 16) {
+		Blocks(p, n, true);
+		p += n * 16;
+		size -= n * 16;
+	}
+	memcpy(m_buf, p, m_cbBuf = size);
+	return *this;
+}
+
+void Poly1305::PadTo16() {
+	if (m_cbBuf) {
+		memset(m_buf + m_cbBuf, 0, 16 - m_cbBuf);
+		Blocks(m_buf, 1, true);
+		m_cbBuf = 0;
+	}
+}
+
+static const size_t AEAD_CHUNK = 16384;				// encrypt and MAC each chunk while it's in the L1/L2 cache
+
+ChaCha20Poly1305::ChaCha20Poly1305(RCSpan key) {
+	if (key.size() != 32)
+		Throw(errc::invalid_argument);
+	memcpy(m_key, key.data(), sizeof m_key);
+}
+
+// Poly1305 key from keystream block 0; the payload is encrypted from block 1 on
+static Poly1305 AeadMac(ChaCha20& chacha, RCSpan aad) {
+	uint8_t polyKey[64] = { 0 };
+	chacha.Crypt(polyKey, polyKey, sizeof polyKey);
+	Poly1305 mac(polyKey);
+	memset(polyKey, 0, sizeof polyKey);
+	mac.Update(aad).PadTo16();
+	return mac;
+}
+
+static void AeadTag(Poly1305& mac, size_t cbAad, size_t cbText, uint8_t tag[16]) {
+	mac.PadTo16();
+	uint8_t lens[16];
+	PutLeUInt64(lens, cbAad);
+	PutLeUInt64(lens + 8, cbText);
+	mac.Update(Span(lens, sizeof lens)).Final(tag);
+}
+
+void ChaCha20Poly1305::Encrypt(RCSpan nonce, RCSpan aad, RCSpan plain, uint8_t *dst, uint8_t tag[16]) {
+	if (nonce.size() != 12)
+		Throw(errc::invalid_argument);
+	ChaCha20 chacha(Span(m_key, sizeof m_key), nonce);
+	Poly1305 mac = AeadMac(chacha, aad);
+	for (size_t off = 0; off < plain.size(); off += AEAD_CHUNK) {
+		size_t cb = (min)(AEAD_CHUNK, plain.size() - off);
+		chacha.Crypt(plain.data() + off, dst + off, cb);
+		mac.Update(Span(dst + off, cb));
+	}
+	AeadTag(mac, aad.size(), plain.size(), tag);
+}
+
+void ChaCha20Poly1305::Decrypt(RCSpan nonce, RCSpan aad, RCSpan cbuf, const uint8_t tag[16], uint8_t *dst) {
+	if (nonce.size() != 12)
+		Throw(errc::invalid_argument);
+	ChaCha20 chacha(Span(m_key, sizeof m_key), nonce);
+	Poly1305 mac = AeadMac(chacha, aad);
+	mac.Update(cbuf);
+	uint8_t t[16];
+	AeadTag(mac, aad.size(), cbuf.size(), t);
+	uint8_t diff = 0;
+	for (int i = 0; i < 16; ++i)
+		diff |= t[i] ^ tag[i];
+	if (diff)
+		Throw(ExtErr::Crypto);
+	chacha.Crypt(cbuf.data(), dst, cbuf.size());
+}
+
+Blob ChaCha20Poly1305::Encrypt(RCSpan nonce, RCSpan aad, RCSpan plain) {
+	Blob r(0, plain.size() + 16);
+	Encrypt(nonce, aad, plain, r.data(), r.data() + plain.size());
+	return r;
+}
+
+Blob ChaCha20Poly1305::Decrypt(RCSpan nonce, RCSpan aad, RCSpan cbuf) {
+	if (cbuf.size() < 16)
+		Throw(ExtErr::Crypto);
+	size_t size = cbuf.size() - 16;
+	Blob r(0, size);
+	Decrypt(nonce, aad, Span(cbuf.data(), size), cbuf.data() + size, r.data());
+	return r;
+}
+
+
+}} // Ext::Crypto::
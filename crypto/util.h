@@ -28,8 +28,6 @@ inline void VectorXor(T *d, const T *s, size_t c) {
 
 #if UCFG_CPU_X86_X64
 
-void Transpose16x8bytes(__m128i to[8], __m128i from[8]);
-
 inline void VectorXor8(__m128i *d, const __m128i *s) {
 	d[0] = _mm_xor_si128(d[0], s[0]);
 	d[1] = _mm_xor_si128(d[1], s[1]);
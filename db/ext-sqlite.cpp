@@ -170,6 +170,10 @@ String SqliteReader::GetString(int i) {
 	return (const Char16*)sqlite_(column_text16)(m_cmd, i);
 }
 
+std::string_view SqliteReader::GetStringView(int i) {
+	return SqliteRow(m_cmd).GetStringView(i);
+}
+
 Span SqliteReader::GetBytes(int i) {
 	sqlite_(value) *value = sqlite_(column_value)(m_cmd, i);
 	return Span((const uint8_t*)sqlite_(value_blob)(value), sqlite_(value_bytes)(value));
@@ -195,6 +199,49 @@ String SqliteReader::GetName(int idx) {
 	return (const Char16*)::sqlite_(column_name16)(m_cmd, idx);
 }
 
+int SqliteReader::GetOrdinal(RCString name) {
+	Blob utf = Encoding::UTF8.GetBytes(name);				// column names are UTF-8, String's const char* is in the default codepage
+	return m_cmd.GetOrdinal(string((const char*)utf.constData(), utf.size()).c_str());
+}
+
+int32_t SqliteRow::GetInt32(int i) const {
+	return ::sqlite_(column_int)(m_stmt, i);
+}
+
+int64_t SqliteRow::GetInt64(int i) const {
+	return ::sqlite_(column_int64)(m_stmt, i);
+}
+
+double SqliteRow::GetDouble(int i) const {
+	return ::sqlite_(column_double)(m_stmt, i);
+}
+
+std::string_view SqliteRow::GetStringView(int i) const {
+	const char *p = (const char*)::sqlite_(column_text)(m_stmt, i);			// column_bytes() after column_text() is the UTF-8 length
+	return p ? std::string_view(p, ::sqlite_(column_bytes)(m_stmt, i)) : std::string_view();
+}
+
+String SqliteRow::GetString(int i) const {
+	return (const Char16*)::sqlite_(column_text16)(m_stmt, i);
+}
+
+Span SqliteRow::GetBytes(int i) const {
+	const uint8_t *p = (const uint8_t*)::sqlite_(column_blob)(m_stmt, i);
+	return Span(p, ::sqlite_(column_bytes)(m_stmt, i));
+}
+
+DbType SqliteRow::GetFieldType(int i) const {
+	switch (::sqlite_(column_type)(m_stmt, i)) {
+	case SQLITE_(NULL): return DbType::Null;
+	case SQLITE_(INTEGER): return DbType::Int;
+	case SQLITE_(FLOAT): return DbType::Float;
+	case SQLITE_(BLOB): return DbType::Blob;
+	case SQLITE_(TEXT): return DbType::String;
+	default:
+		Throw(E_FAIL);
+	}
+}
+
 SqliteCommand::SqliteCommand(SqliteConnection& con)
 	:	m_con(con)
 {
@@ -215,25 +262,40 @@ SqliteCommand::~SqliteCommand() {
 
 void SqliteCommand::Dispose() {
 	if (m_stmt) {
-		int rc = ::sqlite_(finalize)(exchange(m_stmt, nullptr));
-		if (rc != SQLITE_(BUSY) && !std::uncaught_exception())
-			SqliteCheck(m_con, rc);
+		sqlite_(stmt) *h = exchange(m_stmt, nullptr);
+		m_bNeedReset = false;
+		m_columnNames.clear();
+		if (!m_stmtKey.empty())
+			m_con.m_stmtCache.Put(exchange(m_stmtKey, String()), h);
+		else {
+			int rc = ::sqlite_(finalize)(h);
+			if (rc != SQLITE_(BUSY) && !std::uncaught_exception())
+				SqliteCheck(m_con, rc);
+		}
 	}
 }
 
 sqlite_(stmt) *SqliteCommand::Handle() {
 	if (!m_stmt) {
+		if (sqlite_(stmt) *h = m_con.m_stmtCache.Take(CommandText)) {
+			m_stmt.reset(h);
+			m_stmtKey = CommandText;
+			return m_stmt;
+		}
 		sqlite_(stmt) *pst;
 #if UCFG_USE_SQLITE==3
 		const void *tail = 0;
 		SqliteCheck(m_con, ::sqlite3_prepare16_v2(m_con, (const String::value_type*)CommandText, -1, &pst, &tail));
-		m_stmt.reset(pst);
+		bool bSingle = !SqliteIsComplete16(tail);
 #else
 		const char *tail = 0;
 		Blob utf = Encoding::UTF8.GetBytes(CommandText);
 		SqliteCheck(m_con, ::sqlite4_prepare(m_con, (const char*)utf.constData(), -1, &pst, &tail));
+		bool bSingle = !SqliteIsComplete(tail);
 #endif
 		m_stmt.reset(pst);
+		if (pst && bSingle)					// the key must not hide the rest of a script from SqliteConnection::ExecuteNonQuery()
+			m_stmtKey = CommandText;
 	}
 	return m_stmt;
 }
@@ -330,6 +392,26 @@ String SqliteCommand::ExecuteScalar() {
 	Throw(ExtErr::DB_NoRecord);
 }
 
+bool SqliteCommand::Step() {
+	return SqliteCheck(m_con, ::sqlite_(step)(m_stmt)) == SQLITE_(ROW);
+}
+
+int SqliteCommand::GetOrdinal(const char *name) {
+	sqlite_(stmt) *h = Handle();
+	if (m_columnNames.empty()) {
+		for (int i = 0, n = ::sqlite_(column_count)(h); i < n; ++i) {
+			const char *s = ::sqlite_(column_name)(h, i);
+			if (!s)
+				Throw(E_OUTOFMEMORY);
+			m_columnNames.push_back(s);
+		}
+	}
+	for (size_t i = 0; i < m_columnNames.size(); ++i)
+		if (m_columnNames[i] == name)
+			return int(i);
+	Throw(E_INVALIDARG);
+}
+
 int64_t SqliteCommand::ExecuteInt64Scalar() {
 	if (SqliteCheck(m_con, ::sqlite_step(ResetHandle(true))) == SQLITE_ROW)
 		return ::sqlite_column_int64(m_stmt, 0);
@@ -345,18 +427,32 @@ void SqliteConnection::ExecuteNonQuery(RCString sql) {
 	if (s.length() > 1 && s[s.length()-1] != ';')
 		s += ";";
 
+	if (sqlite_(stmt) *h = m_stmtCache.Take(s)) {		// only single statements are cached
+		SqliteCommand cmd(_self);
+		cmd.m_stmt.reset(h);
+		cmd.m_stmtKey = s;
+		cmd.ExecuteNonQuery();
+		return;
+	}
+
 	sqlite_(stmt) *pst;
 #if UCFG_USE_SQLITE==3
 	for (const void *tail=(const Char16*)s; SqliteIsComplete16(tail);) {
 		SqliteCommand cmd(_self);
+		bool bFirst = tail == (const Char16*)s;
 		SqliteCheck(_self, ::sqlite3_prepare16_v2(_self, tail, -1, &pst, &tail));
+		bool bSingle = bFirst && !SqliteIsComplete16(tail);
 #else
 	Blob utf = Encoding::UTF8.GetBytes(s);
 	for (const char *tail=(const char*)utf.constData(); SqliteIsComplete(tail);) {
 		SqliteCommand cmd(_self);
+		bool bFirst = tail == (const char*)utf.constData();
 		SqliteCheck(_self, ::sqlite_prepare(_self, tail, -1, &pst, &tail));
+		bool bSingle = bFirst && !SqliteIsComplete(tail);
 #endif
 		cmd.m_stmt.reset(pst);
+		if (pst && bSingle)
+			cmd.m_stmtKey = s;
 		cmd.ExecuteNonQuery();
 	}
 }
@@ -440,6 +536,7 @@ void SqliteConnection::Open(const path& file, FileAccess fileAccess, FileShare s
 void SqliteConnection::Close() {
 	if (m_db) {
 		DisposeCommands();
+		m_stmtCache.clear();
 		sqlite_db *db = m_db.release();
 		SqliteCheck(db, ::sqlite_close(db));
 	}
@@ -457,6 +554,311 @@ void SqliteConnection::Rollback() {
 	ExecuteNonQuery("ROLLBACK");
 }
 
+void SqliteConnection::SetStatementCacheSize(size_t maxSize) {
+	m_stmtCache.clear();
+	m_stmtCache.SetMaxSize(maxSize + 1);		// LruBase keeps at most m_maxSize-1 entries
+}
+
+SqliteConnection::StatementCacheStats SqliteConnection::get_StatementCacheStats() const {
+	StatementCacheStats r = { m_stmtCache.Hits, m_stmtCache.Misses, m_stmtCache.size(), m_stmtCache.m_maxSize - 1 };
+	return r;
+}
+
+SqliteBulkLoad& SqliteBulkLoad::Add(DbType type, const void *values, RCString parname) {
+	Column c = { parname, type, values };
+	m_columns.push_back(c);
+	return _self;
+}
+
+void SqliteBulkLoad::ExecuteRows(sqlite_(stmt) *h, const int *indexes, size_t from, size_t to) {
+	SqliteConnection& con = m_cmd.m_con;
+	for (size_t row = from; row < to; ++row) {
+		for (size_t i = 0; i < m_columns.size(); ++i) {
+			const Column& c = m_columns[i];
+			int rc;
+			switch (c.Type) {
+			case DbType::Int:
+				rc = ::sqlite_(bind_int64)(h, indexes[i], ((const int64_t*)c.Values)[row]);
+				break;
+			case DbType::Float:
+				rc = ::sqlite_(bind_double)(h, indexes[i], ((const double*)c.Values)[row]);
+				break;
+			case DbType::Blob:
+				{
+					const Span& mb = ((const Span*)c.Values)[row];
+					rc = ::sqlite_(bind_blob)(h, indexes[i], mb.data(), (int)mb.size(), SQLITE_(STATIC));
+				}
+				break;
+			default:
+				{
+					const String& s = ((const String*)c.Values)[row];
+					const Char16 *p = (const Char16*)s;
+					rc = p ? ::sqlite_(bind_text16)(h, indexes[i], p, int(s.length() * 2), SQLITE_(STATIC)) : ::sqlite_(bind_null)(h, indexes[i]);
+				}
+			}
+			if (rc != SQLITE_OK)
+				SqliteCheck(con, rc);
+		}
+		int rc = ::sqlite_(step)(h);
+		::sqlite_(reset)(h);
+		if (rc != SQLITE_DONE)
+			SqliteCheck(con, rc);
+	}
+}
+
+SqliteBulkLoad::Stats SqliteBulkLoad::Execute(size_t nRows) {
+	Stats r = { nRows, TimeSpan() };
+	MeasureTime mt(r.Duration);
+	sqlite_(stmt) *h = m_cmd.ResetHandle();
+	vector<int> indexes(m_columns.size());
+	for (size_t i = 0; i < m_columns.size(); ++i) {
+		const Column& c = m_columns[i];
+		if (!c.ParName)
+			indexes[i] = int(i + 1);
+		else if (!(indexes[i] = ::sqlite_(bind_parameter_index)(h, c.ParName)))
+			Throw(E_INVALIDARG);
+	}
+#if UCFG_USE_SQLITE==3
+	bool bChunked = ChunkSize && ::sqlite3_get_autocommit(m_cmd.m_con);
+#else
+	bool bChunked = ChunkSize;
+#endif
+	try {
+		for (size_t from = 0, to; from < nRows; from = to) {
+			to = bChunked ? (min)(nRows, from + ChunkSize) : nRows;
+			if (bChunked) {
+				TransactionScope dbtx(m_cmd.m_con);
+				ExecuteRows(h, indexes.data(), from, to);
+			} else
+				ExecuteRows(h, indexes.data(), from, to);
+		}
+	} catch (...) {
+		::sqlite_(clear_bindings)(h);
+		throw;
+	}
+	::sqlite_(clear_bindings)(h);		// don't keep SQLITE_STATIC pointers to the caller's arrays
+	mt.End();
+	return r;
+}
+
+#ifndef SQLITE_CHECKPOINT_PASSIVE
+#	define SQLITE_CHECKPOINT_PASSIVE 0
+#	define SQLITE_CHECKPOINT_RESTART 2
+#endif
+#ifndef SQLITE_CHECKPOINT_TRUNCATE
+#	define SQLITE_CHECKPOINT_TRUNCATE SQLITE_CHECKPOINT_RESTART
+#endif
+
+SqlitePool::SqlitePool()
+	: ReaderCount((max)(thread::hardware_concurrency(), 1u))
+	, PassiveWalSize(4 << 20)
+	, RestartWalSize(64 << 20)
+	, TruncateWalSize(256 << 20)
+	, CheckpointPeriod(TimeSpan::FromSeconds(30))
+	, BusyTimeout(TimeSpan::FromSeconds(5))
+	, m_stats()
+	, m_pageSize(4096)
+	, m_walPages(0)
+	, m_bStop(false)
+{
+}
+
+SqlitePool::~SqlitePool() {
+	Close();
+}
+
+void SqlitePool::Open(const path& file) {
+	Close();
+	m_stats = Stats();
+	m_walPages = 0;
+	m_bStop = false;
+	m_dtCheckpoint = Clock::now();
+	int busyTimeout = int(BusyTimeout.count() / TimeSpan::TicksPerMillisecond);
+	for (size_t i = 0; i <= ReaderCount; ++i) {
+		unique_ptr<Slot> slot(new Slot);
+		slot->Refs = 0;
+		slot->Con.reset(new SqliteConnection);
+		slot->Con->Open(file, i ? FileAccess::Read : FileAccess::ReadWrite);
+#if UCFG_USE_SQLITE==3
+		::sqlite3_busy_timeout(*slot->Con, busyTimeout);		// the writer waits out RESTART/TRUNCATE checkpoints, readers a WAL recovery
+#endif
+		if (!i) {
+			slot->Con->ExecuteNonQuery("PRAGMA journal_mode = WAL");		// read-only connections can't switch it
+			m_pageSize = SqliteCommand("PRAGMA page_size", *slot->Con).ExecuteInt64Scalar();
+#if UCFG_USE_SQLITE==3
+			::sqlite3_wal_hook(*slot->Con, &SqlitePool::WalHook, this);		// replaces wal_autocheckpoint
+#endif
+		}
+		m_slots.push_back(move(slot));
+	}
+	m_conCheckpoint.reset(new SqliteConnection(file));
+#if UCFG_USE_SQLITE==3
+	::sqlite3_busy_timeout(*m_conCheckpoint, busyTimeout);
+#endif
+	m_threadCheckpoint = thread(&SqlitePool::CheckpointLoop, this);
+}
+
+void SqlitePool::Close() {
+	if (m_threadCheckpoint.joinable()) {
+		EXT_LOCK (m_mtx) {
+			m_bStop = true;
+		}
+		m_cvCheckpoint.notify_all();
+		m_threadCheckpoint.join();
+	}
+	m_conCheckpoint.reset();
+	while (!m_slots.empty())			// the writer last
+		m_slots.pop_back();
+}
+
+SqlitePool::Slot& SqlitePool::Acquire(bool bWriter) {
+	thread::id tid = this_thread::get_id();
+	DateTime dtStart;
+	unique_lock<mutex> lk(m_mtx);
+	size_t from = bWriter || m_slots.size() < 2 ? 0 : 1,
+		to = bWriter ? 1 : m_slots.size();
+	if (from >= to)
+		Throw(E_FAIL);
+	for (bool bWaited = false;;) {
+		Slot *free = nullptr;
+		for (size_t i = from; i < to; ++i) {
+			Slot& slot = *m_slots[i];
+			if (slot.Refs && slot.Owner == tid) {
+				++slot.Refs;
+				return slot;
+			}
+			if (!slot.Refs && (!free || slot.Affinity == tid))
+				free = &slot;
+		}
+		if (free) {
+			free->Owner = tid;
+			free->Refs = 1;
+			++m_stats.Checkouts;
+			if (bWaited) {
+				TimeSpan span = Clock::now() - dtStart;
+				m_stats.WaitTime += span;
+				m_stats.MaxWaitTime = (max)(m_stats.MaxWaitTime, span);
+			}
+			return *free;
+		}
+		if (!bWaited) {
+			bWaited = true;
+			++m_stats.Waits;
+			dtStart = Clock::now();
+		}
+		m_cvFree.wait(lk);
+	}
+}
+
+void SqlitePool::Release(Slot& slot) {
+	EXT_LOCK (m_mtx) {
+		if (--slot.Refs)
+			return;
+		slot.Affinity = exchange(slot.Owner, thread::id());
+	}
+	m_cvFree.notify_all();
+}
+
+int SqlitePool::WalHook(void *p, sqlite_db *db, const char *dbName, int nPages) {
+	SqlitePool& pool = *(SqlitePool*)p;
+	uint64_t walSize = uint64_t(nPages) * pool.m_pageSize;
+	pool.m_walPages = nPages;
+	EXT_LOCK (pool.m_mtx) {
+		pool.m_stats.MaxWalSize = (max)(pool.m_stats.MaxWalSize, walSize);
+	}
+	if (walSize >= pool.PassiveWalSize)
+		pool.m_cvCheckpoint.notify_one();
+	return SQLITE_OK;
+}
+
+int SqlitePool::CheckpointMode(uint64_t walSize) {
+	if (walSize >= TruncateWalSize)
+		return SQLITE_CHECKPOINT_TRUNCATE;
+	if (walSize >= RestartWalSize)
+		return SQLITE_CHECKPOINT_RESTART;
+	if (walSize >= PassiveWalSize || walSize && Clock::now() - m_dtCheckpoint >= CheckpointPeriod)
+		return SQLITE_CHECKPOINT_PASSIVE;
+	return -1;
+}
+
+void SqlitePool::CheckpointLoop() {
+	unique_lock<mutex> lk(m_mtx);
+	while (!m_bStop) {
+		m_cvCheckpoint.wait_for(lk, CheckpointPeriod);
+		int walPages = m_walPages;
+		int mode = m_bStop ? -1 : CheckpointMode(uint64_t(walPages) * m_pageSize);
+		if (mode < 0)
+			continue;
+		lk.unlock();
+		pair<int, int> r(0, 0);
+		bool bOk = false;
+		try {
+			r = m_conCheckpoint->Checkpoint(mode);
+			bOk = true;
+		} catch (RCExc) {						// SQLITE_BUSY: readers outlasted BusyTimeout
+		}
+		lk.lock();
+		m_dtCheckpoint = Clock::now();
+		if (!bOk) {
+			++m_stats.FailedCheckpoints;
+			continue;
+		}
+		switch (mode) {
+		case SQLITE_CHECKPOINT_PASSIVE:
+			++m_stats.PassiveCheckpoints;
+			break;
+#if SQLITE_CHECKPOINT_TRUNCATE != SQLITE_CHECKPOINT_RESTART
+		case SQLITE_CHECKPOINT_TRUNCATE:
+			++m_stats.TruncateCheckpoints;
+			break;
+#endif
+		default:
+			++m_stats.RestartCheckpoints;
+		}
+		m_walPages.compare_exchange_strong(walPages, (max)(r.first - r.second, 0));		// unless a commit reported a newer size
+	}
+}
+
+SqlitePool::Stats SqlitePool::get_Stats() {
+	unique_lock<mutex> lk(m_mtx);
+	Stats r = m_stats;
+	r.WalSize = uint64_t(m_walPages) * m_pageSize;
+	return r;
+}
+
+sqlite_(stmt) *SqliteStatementCache::Take(RCString sql) {
+	iterator it = find(sql);
+	if (it == end()) {
+		++Misses;
+		return nullptr;
+	}
+	++Hits;
+	sqlite_(stmt) *r = it->second.first;
+	erase(it);
+	return r;
+}
+
+void SqliteStatementCache::Put(RCString sql, sqlite_(stmt) *stmt) {
+	::sqlite_(reset)(stmt);							// error of the last step was already reported
+	::sqlite_(clear_bindings)(stmt);
+	if (m_maxSize < 2 || find(sql) != end()) {
+		::sqlite_(finalize)(stmt);
+		return;
+	}
+	while (size() + 1 >= m_maxSize) {
+		iterator it = ListItemToIterator(m_list.back());
+		::sqlite_(finalize)(it->second.first);
+		erase(it);
+	}
+	insert(make_pair(sql, stmt));
+}
+
+void SqliteStatementCache::clear() {
+	for (iterator it = begin(), e = end(); it != e; ++it)
+		::sqlite_(finalize)(it->second.first);
+	base::clear();
+}
+
 
 #if UCFG_USE_SQLITE==3
 
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include EXT_HEADER_CONDITION_VARIABLE
+
 #include "db-itf.h"
 
 #ifndef UCFG_USE_SQLITE
@@ -15,6 +17,10 @@
 #	define UCFG_USE_SQLITE_MDB 0
 #endif
 
+#ifndef UCFG_SQLITE_STMT_CACHE_SIZE
+#	define UCFG_SQLITE_STMT_CACHE_SIZE 64
+#endif
+
 #if UCFG_USE_SQLITE == 3
 #	define sqlite_(name) sqlite3_##name
 #	define SQLITE_(name) SQLITE_##name
@@ -49,6 +55,24 @@ public:
 class SqliteConnection;
 class SqliteCommand;
 
+// Current row of a statement stepped by SqliteCommand::ForEachRow(): non-virtual accessors, string views and spans are valid until the next step
+class SqliteRow {
+	sqlite_(stmt) *m_stmt;
+public:
+	explicit SqliteRow(sqlite_(stmt) *stmt)
+		: m_stmt(stmt)
+	{}
+
+	int32_t GetInt32(int i) const;
+	int64_t GetInt64(int i) const;
+	double GetDouble(int i) const;
+	std::string_view GetStringView(int i) const;			// UTF-8 as stored, no transcoding
+	String GetString(int i) const;
+	Span GetBytes(int i) const;
+	DbType GetFieldType(int i) const;
+	bool IsDBNull(int i) const { return GetFieldType(i) == DbType::Null; }
+};
+
 class SqliteReader : public IDataReader {
 	SqliteCommand& m_cmd;
 public:
@@ -58,10 +82,12 @@ public:
 	int64_t GetInt64(int i) override;
 	double GetDouble(int i) override;
 	String GetString(int i) override;
+	std::string_view GetStringView(int i);
 	Span GetBytes(int i) override;
 	DbType GetFieldType(int i) override;
 	int FieldCount() override;
 	String GetName(int idx) override;
+	int GetOrdinal(RCString name) override;
 	bool Read() override;
 };
 
@@ -76,6 +102,7 @@ public:
 	int64_t GetInt64(int i) { return m_pimpl->GetInt64(i); }
 	double GetDouble(int i) { return m_pimpl->GetDouble(i); }
 	String GetString(int i) { return m_pimpl->GetString(i); }
+	std::string_view GetStringView(int i) { return m_pimpl->GetStringView(i); }
 	Span GetBytes(int i) { return m_pimpl->GetBytes(i); }
 	DbType GetFieldType(int i) { return m_pimpl->GetFieldType(i); }
 	int FieldCount() { return m_pimpl->FieldCount(); }
@@ -92,6 +119,8 @@ protected:
 
 class SqliteCommand : public IDbCommand {
 	observer_ptr<sqlite_(stmt)> m_stmt;
+	String m_stmtKey;							// the statement goes back to the connection's cache under this text on Dispose(), finalized if empty
+	vector<std::string> m_columnNames;			// UTF-8, filled by GetOrdinal() once per prepared statement
 	CBool m_bNeedReset;
 public:
 	SqliteConnection& m_con;
@@ -127,17 +156,52 @@ public:
 	DbDataReader ExecuteVector();
 	String ExecuteScalar() override;
 	int64_t ExecuteInt64Scalar();
+
+	int GetOrdinal(const char *name);			// resolve once, outside the row loop
+
+	// f(const SqliteRow&) for each result row
+	template <typename F> void ForEachRow(F f) {
+		SqliteRow row(ResetHandle(true));
+		while (Step())
+			f(row);
+	}
 private:
+	bool Step();
 	sqlite_(stmt) *Handle();
 	sqlite_(stmt) *ResetHandle(bool bNewNeedReset = false);
 
 	friend class SqliteConnection;
 	friend class SqliteReader;
+	friend class SqliteBulkLoad;
+};
+
+// Idle prepared statements keyed by SQL text. A command takes its statement out while it uses it and puts it back reset, so equal
+// texts run concurrently get separate statements. LruBase would drop the least recently used entry without finalizing it, so Put() evicts itself
+class SqliteStatementCache : public LruMap<String, sqlite_(stmt)*> {
+	typedef LruMap<String, sqlite_(stmt)*> base;
+public:
+	uint64_t Hits, Misses;
+
+	SqliteStatementCache(size_t maxSize = UCFG_SQLITE_STMT_CACHE_SIZE)
+		: base(maxSize + 1)						// LruBase keeps at most m_maxSize-1 entries
+		, Hits(0)
+		, Misses(0)
+	{}
+
+	sqlite_(stmt) *Take(RCString sql);			// nullptr on miss
+	void Put(RCString sql, sqlite_(stmt) *stmt);	// takes ownership
+	void clear();								// finalizes all
 };
 
 class SqliteConnection : public IDbConn, public ITransactionable {
 	observer_ptr<sqlite_db> m_db;
+	SqliteStatementCache m_stmtCache;
 public:
+	struct StatementCacheStats {
+		uint64_t Hits, Misses;
+		size_t Size, MaxSize;
+	};
+
 	SqliteConnection() {
 	}
 
@@ -165,6 +229,115 @@ public:
 	void BeginTransaction() override;
 	void Commit() override;
 	void Rollback() override;
+
+	void SetStatementCacheSize(size_t maxSize);		// number of statements kept, 0 disables the cache
+	StatementCacheStats get_StatementCacheStats() const;
+	DEFPROP_GET(StatementCacheStats, StatementCacheStats);
+
+	friend class SqliteCommand;
+};
+
+// Columnar load through one prepared statement, usually an INSERT: row i binds values[i] of every column and steps.
+// Parameter indexes are resolved once per Execute(); blobs and strings are bound SQLITE_STATIC, so the arrays must live until Execute() returns.
+// Without an open transaction the rows are committed every ChunkSize rows
+class SqliteBulkLoad : noncopyable {
+public:
+	struct Stats {
+		uint64_t Rows;
+		TimeSpan Duration;
+
+		double get_RowsPerSecond() const { return Duration.Ticks ? Rows / Duration.TotalSeconds : 0; }
+		DEFPROP_GET_CONST(double, RowsPerSecond);
+	};
+
+	SqliteCommand& m_cmd;
+	size_t ChunkSize;							// 0 to run all rows in the caller's transaction or autocommit mode
+
+	SqliteBulkLoad(SqliteCommand& cmd, size_t chunkSize = 65536)
+		: m_cmd(cmd)
+		, ChunkSize(chunkSize)
+	{}
+
+	// parname like ":hash", nullptr to bind ?N of the N-th added column
+	SqliteBulkLoad& Add(const int64_t *values, RCString parname = nullptr) { return Add(DbType::Int, values, parname); }
+	SqliteBulkLoad& Add(const double *values, RCString parname = nullptr) { return Add(DbType::Float, values, parname); }
+	SqliteBulkLoad& Add(const Span *values, RCString parname = nullptr) { return Add(DbType::Blob, values, parname); }		// null data() binds NULL
+	SqliteBulkLoad& Add(const String *values, RCString parname = nullptr) { return Add(DbType::String, values, parname); }	// null String binds NULL
+
+	Stats Execute(size_t nRows);
+private:
+	struct Column {
+		String ParName;
+		DbType Type;
+		const void *Values;
+	};
+	vector<Column> m_columns;
+
+	SqliteBulkLoad& Add(DbType type, const void *values, RCString parname);
+	void ExecuteRows(sqlite_(stmt) *h, const int *indexes, size_t from, size_t to);
+};
+
+// One writer and ReaderCount read-only connections to a WAL database. A thread gets back the connection it used last if it is free,
+// and a nested checkout on the same thread gets the connection it already holds.
+// The writer's WAL hook feeds a background thread that checkpoints on its own connection: PASSIVE by WAL size or age, RESTART/TRUNCATE under pressure
+class SqlitePool : noncopyable {
+	struct Slot {
+		unique_ptr<SqliteConnection> Con;
+		thread::id Owner, Affinity;
+		int Refs;
+	};
+public:
+	size_t ReaderCount;
+	uint64_t PassiveWalSize, RestartWalSize, TruncateWalSize;	// bytes of uncheckpointed WAL
+	TimeSpan CheckpointPeriod;							// PASSIVE at least that often while the WAL is not empty
+	TimeSpan BusyTimeout;								// busy timeout of all the connections: RESTART/TRUNCATE wait that long for readers, the writer for them
+
+	struct Stats {
+		uint64_t Checkouts, Waits;
+		TimeSpan WaitTime, MaxWaitTime;
+		uint64_t WalSize, MaxWalSize;
+		uint64_t PassiveCheckpoints, RestartCheckpoints, TruncateCheckpoints, FailedCheckpoints;
+	};
+
+	class Lease : noncopyable {
+		SqlitePool& m_pool;
+		Slot& m_slot;
+	public:
+		Lease(SqlitePool& pool, bool bWriter = false)
+			: m_pool(pool)
+			, m_slot(pool.Acquire(bWriter))
+		{}
+
+		~Lease() { m_pool.Release(m_slot); }
+
+		SqliteConnection& operator*() const { return *m_slot.Con; }
+		SqliteConnection *operator->() const { return m_slot.Con.get(); }
+	};
+
+	SqlitePool();
+	~SqlitePool();
+	void Open(const path& file);						// switches the database to WAL
+	void Close();										// no Lease may be alive
+
+	Stats get_Stats();
+	DEFPROP_GET(Stats, Stats);
+private:
+	vector<unique_ptr<Slot>> m_slots;					// [0] is the writer
+	unique_ptr<SqliteConnection> m_conCheckpoint;
+	thread m_threadCheckpoint;
+	mutex m_mtx;
+	condition_variable m_cvFree, m_cvCheckpoint;
+	Stats m_stats;
+	DateTime m_dtCheckpoint;
+	int64_t m_pageSize;
+	atomic<int> m_walPages;
+	bool m_bStop;
+
+	Slot& Acquire(bool bWriter);
+	void Release(Slot& slot);
+	int CheckpointMode(uint64_t walSize);				// -1 if none is due
+	void CheckpointLoop();
+	static int WalHook(void *p, sqlite_db *db, const char *dbName, int nPages);
 };
 
 class SqliteMalloc {
@@ -179,10 +352,21 @@ public:
 	~SqliteVfs();
 };
 
+ENUM_CLASS(MMapAdvice) {
+	Normal
+	, Random				// B-tree lookups on a database larger than RAM
+	, Sequential
+	, WillNeed				// read ahead the whole file once
+} END_ENUM_CLASS(MMapAdvice);
+
+// Maps database, journal and WAL files into a reserved address range; WAL index in the mmapped -shm file with the unix VFS lock layout (POSIX only, WAL needs OFD locks)
 class MMappedSqliteVfs : public SqliteVfs {
 	typedef SqliteVfs base;
 public:
+	static const int FCNTL_ADVISE = 0x4D4D4101;		// sqlite3_file_control() op, pArg is MMapAdvice*
+
 	MMappedSqliteVfs();
+	static bool Advise(SqliteConnection& con, MMapAdvice advice, const char *dbName = "main");		// false if the file isn't from this VFS
 };
 
 
@@ -20,10 +20,35 @@
 #	pragma comment(lib, "sqlite4")
 #endif
 
+#if !UCFG_WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
 namespace Ext { namespace DB { namespace sqlite_(NS) {
 
 #if UCFG_USE_SQLITE==3 && !UCFG_USE_SQLITE_MDB
 
+#define NO_LOCK         0
+#define SHARED_LOCK     1
+#define RESERVED_LOCK   2
+#define PENDING_LOCK    3
+#define EXCLUSIVE_LOCK  4
+
+#define PENDING_BYTE     (0x40000000)
+#define RESERVED_BYTE     (PENDING_BYTE+1)
+#define SHARED_FIRST      (PENDING_BYTE+2)
+#define SHARED_SIZE       510
+
+#define SHM_BASE		((22 + SQLITE_SHM_NLOCK) * 4)		// lock bytes of the -shm file, same as in the unix VFS
+#define SHM_DMS			(SHM_BASE + SQLITE_SHM_NLOCK)
+
+const int FILE_INCREMENT = 64*1024;
+
+#if UCFG_WIN32
+
 class CSqliteMappedFile {
 public:
 	CSqliteMappedFile()
@@ -40,6 +65,13 @@ public:
 	int Unlock(int level);
 	int CheckReservedLock(int& bLocked);
 	int Sync(int flags);
+	int FileControl(int op, void *pArg) { return SQLITE_NOTFOUND; }
+
+	// no WAL on this platform: SQLite falls back to an error instead of an exception thrown through its frames
+	int ShmMap(int iRegion, int szRegion, bool bExtend, void volatile **pp) { return SQLITE_IOERR_SHMMAP; }
+	int ShmLock(int offset, int n, int flags) { return SQLITE_IOERR_SHMLOCK; }
+	void ShmBarrier() {}
+	int ShmUnmap(bool bDelete) { return SQLITE_OK; }
 private:
 	const sqlite3_io_methods *pMethod; /*** Must be first ***/
 	sqlite3_vfs *pVfs;      /* The VFS used to open this file */
@@ -53,102 +85,6 @@ private:
 	Int64 FileSize;
 };
 
-static int MMapped_Close(sqlite3_file *file) {
-	int rc = ((CSqliteMappedFile*)file)->Close();
-	((CSqliteMappedFile*)file)->~CSqliteMappedFile();
-	return rc;
-}
-
-static int MMapped_Read(sqlite3_file *file, void *data, int iAmt, sqlite3_int64 iOfst) {
-	return ((CSqliteMappedFile*)file)->Read(data, iAmt, iOfst);
-}
-
-static int MMapped_Write(sqlite3_file *file, const void *data, int iAmt, sqlite3_int64 iOfst) {
-	return ((CSqliteMappedFile*)file)->Write(data, iAmt, iOfst);
-}
-
-static int MMapped_Truncate(sqlite3_file *file, sqlite3_int64 size) {
-	return ((CSqliteMappedFile*)file)->Truncate(size);
-}
-
-static int MMapped_Sync(sqlite3_file *file, int flags) {
-	return ((CSqliteMappedFile*)file)->Sync(flags);
-}
-
-static int MMapped_FileSize(sqlite3_file *file, sqlite3_int64 *pSize) {
-	return ((CSqliteMappedFile*)file)->GetFileSize(*pSize);
-}
-
-static int MMapped_Lock(sqlite3_file *file, int level) {
-	return ((CSqliteMappedFile*)file)->Lock(level);
-}
-
-static int MMapped_Unlock(sqlite3_file *file, int level) {
-	return ((CSqliteMappedFile*)file)->Unlock(level);
-}
-
-static int MMapped_CheckReservedLock(sqlite3_file *file, int *pResOut) {
-	return ((CSqliteMappedFile*)file)->CheckReservedLock(*pResOut);
-}
-
-static int MMapped_FileControl(sqlite3_file *file, int op, void *pArg) {
-	return SQLITE_NOTFOUND;
-}
-
-static int MMapped_SectorSize(sqlite3_file *file) {
-	return 4096;
-}
-
-static int MMapped_DeviceCharacteristics(sqlite3_file *file) {
-	return SQLITE_IOCAP_UNDELETABLE_WHEN_OPEN | SQLITE_IOCAP_ATOMIC512 | SQLITE_IOCAP_ATOMIC1K | SQLITE_IOCAP_ATOMIC2K | SQLITE_IOCAP_ATOMIC4K | SQLITE_IOCAP_SAFE_APPEND;		//!!!? SQLITE_IOCAP_SAFE_APPEND 
-}
-
-static int MMapped_ShmMap(sqlite3_file *file, int iPg, int pgsz, int, void volatile**) {
-	Throw(E_NOTIMPL);
-}
-
-static int MMapped_ShmLock(sqlite3_file *file, int offset, int n, int flags) {
-	Throw(E_NOTIMPL);
-}
-
-static void MMapped_ShmBarrier(sqlite3_file *file) {
-	Throw(E_NOTIMPL);
-}
-
-static int MMapped_ShmUnmap(sqlite3_file *file, int deleteFlag) {
-	Throw(E_NOTIMPL);
-}
-
-static sqlite3_io_methods s_mmappedMethods = {
-	2,
-	&MMapped_Close,
-	&MMapped_Read,
-	&MMapped_Write,
-	&MMapped_Truncate,
-	&MMapped_Sync,
-	&MMapped_FileSize,
-	&MMapped_Lock,
-	&MMapped_Unlock,
-	&MMapped_CheckReservedLock,
-	&MMapped_FileControl,
-	&MMapped_SectorSize,
-	&MMapped_DeviceCharacteristics,
-	&MMapped_ShmMap,
-	&MMapped_ShmLock,
-	&MMapped_ShmBarrier,
-	&MMapped_ShmUnmap
-};
-
-static int MMapped_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int flags, int *pOutFlags) {
-	CSqliteMappedFile *mf = new(file) CSqliteMappedFile;
-	int rc = mf->Open(zName, flags, pOutFlags);
-	if (SQLITE_OK == rc) {
-		file->pMethods = &s_mmappedMethods;
-	}
-	return rc;
-}
-
-
 int CSqliteMappedFile::Open(const char *zName, int flags, int *pOutFlags) {
 	String path;
 	if (zName)
@@ -159,7 +95,7 @@ int CSqliteMappedFile::Open(const char *zName, int flags, int *pOutFlags) {
 	FileMode mode = FileMode::Open;
 	FileAccess access = FileAccess::ReadWrite;
 	if (flags & SQLITE_OPEN_CREATE)
-		mode = FileMode::Create;
+		mode = FileMode::OpenOrCreate;
 //	if (flags & SQLITE_OPEN_READONLY)
 //		access = FileAccess::Read;
 	m_file.Open(path, mode, access);
@@ -191,8 +127,6 @@ int CSqliteMappedFile::Read(void *data, int size, Int64 offset) {
 		return SQLITE_OK;
 }
 
-const int FILE_INCREMENT = 64*1024;
-
 int CSqliteMappedFile::Write(const void *data, int size, Int64 offset) {
 	if (FileSize < offset+size) {
 		m_mview.Unmap();
@@ -236,16 +170,6 @@ int CSqliteMappedFile::Unlock(int level) {
 	return SQLITE_ERROR;
 }
 
-#define NO_LOCK         0
-#define SHARED_LOCK     1
-#define RESERVED_LOCK   2
-#define PENDING_LOCK    3
-#define EXCLUSIVE_LOCK  4
-
-#define PENDING_BYTE     (0x40000000)
-#define RESERVED_BYTE     (PENDING_BYTE+1)
-
-
 int CSqliteMappedFile::CheckReservedLock(int& bLocked) {
 	if (m_lockLevel >= RESERVED_LOCK)
 		bLocked = 1;
@@ -266,13 +190,616 @@ int CSqliteMappedFile::Sync(int flags) {
 	return SQLITE_OK;
 }
 
+#else // UCFG_WIN32
+
+#ifdef F_OFD_SETLK
+#	define MMAPPED_SETLK	F_OFD_SETLK			// owned by the open file description, so connections of one process exclude each other
+#	define MMAPPED_SETLKW	F_OFD_SETLKW
+#	define MMAPPED_GETLK	F_OFD_GETLK
+#else
+#	define MMAPPED_SETLK	F_SETLK				// owned by the process, see MMappedInode
+#	define MMAPPED_SETLKW	F_SETLKW
+#	define MMAPPED_GETLK	F_GETLK
+#endif
+
+#if UCFG_64
+const size_t MMAPPED_RESERVE = size_t(64) << 30;		// address space mapped up front, the file grows into it without remapping
+#else
+const size_t MMAPPED_RESERVE = 1 << 20;					// address space is scarce: map twice the file and remap as it outgrows that
+#endif
+const int64_t MAX_FILE_INCREMENT = 256 << 20;
+
+static int MMappedLock(int fd, short type, int64_t start, int64_t len, bool bWait = false) {
+	struct flock fl;
+	memset(&fl, 0, sizeof fl);
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = len;
+	if (!::fcntl(fd, bWait ? MMAPPED_SETLKW : MMAPPED_SETLK, &fl))
+		return SQLITE_OK;
+	return errno == EAGAIN || errno == EACCES || errno == EINTR ? SQLITE_BUSY : SQLITE_IOERR_LOCK;
+}
+
+#ifndef F_OFD_SETLK
+// Process-owned locks don't exclude the connections of one process from each other, and closing any fd of the file drops them all.
+// As in the unix VFS, the connections of the process arbitrate through a record per inode, and only the process-level transitions reach fcntl
+struct MMappedInode {
+	pair<dev_t, ino_t> Key;
+	int Refs;
+	int LockLevel;						// of the process
+	int Shared;							// connections holding SHARED or above
+	vector<int> PendingClose;			// fds of closed connections, kept open while the others hold locks
+
+	MMappedInode()
+		: Refs(0)
+		, LockLevel(NO_LOCK)
+		, Shared(0)
+	{}
+};
+
+static mutex s_mtxInodes;
+static map<pair<dev_t, ino_t>, MMappedInode> s_inodes;
+#else
+struct MMappedInode;
+#endif
+
+// The whole file is mapped MAP_SHARED into a reserved range. Reads and writes are memcpy, xSync msyncs only the range written since the last sync.
+// The file grows geometrically, SQLite tolerates the zero tail as with SQLITE_FCNTL_CHUNK_SIZE
+class CSqliteMappedFile {
+public:
+	CSqliteMappedFile()
+		: m_fd(-1)
+		, m_fdShm(-1)
+		, m_base(0)
+		, m_reserved(0)
+		, m_fileSize(0)
+		, m_dirtyBegin(INT64_MAX)
+		, m_dirtyEnd(0)
+		, m_shmRegionSize(0)
+		, m_lockLevel(NO_LOCK)
+		, m_inode(0)
+		, m_advice(POSIX_MADV_NORMAL)
+		, m_bReadOnly(false)
+		, m_bSizeChanged(false)
+	{}
+
+	int Open(const char *zName, int flags, int *pOutFlags);
+	int Close();
+	int Read(void *data, int size, int64_t offset);
+	int Write(const void *data, int size, int64_t offset);
+	int GetFileSize(sqlite3_int64& fileSize);
+	int Truncate(int64_t size);
+	int Lock(int level);
+	int Unlock(int level);
+	int CheckReservedLock(int& bLocked);
+	int Sync(int flags);
+	int FileControl(int op, void *pArg);
+	int ShmMap(int iRegion, int szRegion, bool bExtend, void volatile **pp);
+	int ShmLock(int offset, int n, int flags);
+	void ShmBarrier();
+	int ShmUnmap(bool bDelete);
+private:
+	const sqlite3_io_methods *pMethod; /*** Must be first ***/
+	String FilePath;
+	int m_fd, m_fdShm;
+	uint8_t *m_base;
+	size_t m_reserved;
+	int64_t m_fileSize;
+	int64_t m_dirtyBegin, m_dirtyEnd;
+	vector<void*> m_shmRegions;
+	int m_shmRegionSize;
+	int m_lockLevel;
+	MMappedInode *m_inode;
+	int m_advice;
+	bool m_bReadOnly, m_bSizeChanged;
+
+	int Map(int64_t size);
+	int RefreshSize();
+	int Grow(int64_t size);
+	int LockFd(int& lockLevel, int level);			// lockLevel is the connection's, or the process' without OFD locks
+	int UnlockFd(int& lockLevel, int level);
+	int ShmOpen();
+};
+
+int CSqliteMappedFile::Open(const char *zName, int flags, int *pOutFlags) {
+	FilePath = zName ? String(zName) : String(Path::GetTempFileName());
+	int oflags = O_CLOEXEC | (flags & SQLITE_OPEN_CREATE ? O_CREAT : 0) | (zName && (flags & SQLITE_OPEN_EXCLUSIVE) ? O_EXCL : 0);		// GetTempFileName() creates the file
+	m_bReadOnly = flags & SQLITE_OPEN_READONLY;
+	if (!m_bReadOnly && (m_fd = ::open(FilePath, oflags | O_RDWR, 0644)) < 0 && (errno == EACCES || errno == EROFS)) {
+		m_bReadOnly = true;
+		flags = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) | SQLITE_OPEN_READONLY;
+	}
+	if (m_bReadOnly)
+		m_fd = ::open(FilePath, oflags & ~O_CREAT | O_RDONLY);
+	if (m_fd < 0)
+		return SQLITE_CANTOPEN;
+	if (flags & SQLITE_OPEN_DELETEONCLOSE)
+		::unlink(FilePath);
+#ifndef F_OFD_SETLK
+	struct stat st;
+	if (::fstat(m_fd, &st))
+		return SQLITE_IOERR_FSTAT;
+	EXT_LOCK (s_mtxInodes) {
+		m_inode = &s_inodes[make_pair(st.st_dev, st.st_ino)];
+		m_inode->Key = make_pair(st.st_dev, st.st_ino);
+		++m_inode->Refs;
+	}
+#endif
+	if (pOutFlags)
+		*pOutFlags = flags;
+	return RefreshSize();
+}
+
+int CSqliteMappedFile::Close() {
+	ShmUnmap(false);
+	if (m_base)
+		::munmap(m_base, m_reserved);
+	m_base = 0;
+#ifndef F_OFD_SETLK
+	if (m_inode) {
+		Unlock(NO_LOCK);
+		EXT_LOCK (s_mtxInodes) {
+			if (m_inode->Shared)
+				m_inode->PendingClose.push_back(exchange(m_fd, -1));		// close() would drop the locks of the other connections
+			if (!--m_inode->Refs)
+				s_inodes.erase(m_inode->Key);
+		}
+		m_inode = 0;
+	}
+#endif
+	if (m_fd >= 0)
+		::close(exchange(m_fd, -1));				// releases the OFD locks
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::Map(int64_t size) {
+	if (size <= int64_t(m_reserved) && m_base)
+		return SQLITE_OK;
+	if (uint64_t(size) > SIZE_MAX / 2)
+		return SQLITE_IOERR_MMAP;
+	size_t reserved = (max)(MMAPPED_RESERVE, size_t(size) * 2);
+	if (m_base)
+		::munmap(m_base, m_reserved);
+	void *p = ::mmap(0, reserved, m_bReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, m_fd, 0);
+	if (p == MAP_FAILED) {
+		m_base = 0;
+		m_reserved = 0;
+		return SQLITE_IOERR_MMAP;
+	}
+	m_base = (uint8_t*)p;
+	m_reserved = reserved;
+	if (m_advice != POSIX_MADV_NORMAL)
+		::posix_madvise(m_base, m_reserved, m_advice);
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::RefreshSize() {					// other connections grow and truncate the file too
+	struct stat st;
+	if (::fstat(m_fd, &st))
+		return SQLITE_IOERR_FSTAT;
+	m_fileSize = st.st_size;
+	m_dirtyEnd = (min)(m_dirtyEnd, m_fileSize);			// nothing left to msync past a truncation by another connection
+	return Map(m_fileSize);
+}
+
+int CSqliteMappedFile::Grow(int64_t size) {
+	if (int rc = RefreshSize())
+		return rc;
+	if (size <= m_fileSize)
+		return SQLITE_OK;
+	int64_t step = (max)(int64_t(FILE_INCREMENT), (min)(m_fileSize / 4, MAX_FILE_INCREMENT));
+	int64_t newSize = ((max)(size, m_fileSize + step) + FILE_INCREMENT - 1) & ~int64_t(FILE_INCREMENT - 1);
+	if (int rc = Map(newSize))
+		return rc;
+	if (::ftruncate(m_fd, newSize))
+		return errno == ENOSPC ? SQLITE_FULL : SQLITE_IOERR_TRUNCATE;
+	m_fileSize = newSize;
+	m_bSizeChanged = true;
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::Read(void *data, int size, int64_t offset) {
+	if (offset + size > m_fileSize) {
+		if (int rc = RefreshSize())
+			return rc;
+	}
+	int n = offset >= m_fileSize ? 0 : int((min)(int64_t(size), m_fileSize - offset));
+	if (n)
+		memcpy(data, m_base + offset, n);
+	if (n < size) {
+		memset((uint8_t*)data + n, 0, size - n);
+		return SQLITE_IOERR_SHORT_READ;
+	}
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::Write(const void *data, int size, int64_t offset) {
+	if (m_bReadOnly)
+		return SQLITE_READONLY;
+	int64_t end = offset + size;
+	if (end > m_fileSize) {
+		if (int rc = Grow(end))
+			return rc;
+	} else if (int rc = RefreshSize())		// the cached size may be stale: the -wal is truncated by whichever connection checkpoints, and a store past EOF through the map is SIGBUS
+		return rc;
+	else if (end > m_fileSize) {
+		if (int rc = Grow(end))
+			return rc;
+	}
+	memcpy(m_base + offset, data, size);
+	m_dirtyBegin = (min)(m_dirtyBegin, offset);
+	m_dirtyEnd = (max)(m_dirtyEnd, end);
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::GetFileSize(sqlite3_int64& fileSize) {
+	int rc = RefreshSize();
+	fileSize = m_fileSize;
+	return rc;
+}
+
+int CSqliteMappedFile::Truncate(int64_t size) {
+	if (::ftruncate(m_fd, size))
+		return SQLITE_IOERR_TRUNCATE;
+	m_fileSize = size;
+	m_dirtyEnd = (min)(m_dirtyEnd, size);
+	m_bSizeChanged = true;
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::Sync(int flags) {
+	if (m_dirtyBegin < m_dirtyEnd) {
+		static const int64_t s_pageSize = ::sysconf(_SC_PAGESIZE);
+		int64_t begin = m_dirtyBegin & ~(s_pageSize - 1);
+		if (::msync(m_base + begin, size_t(m_dirtyEnd - begin), MS_SYNC))
+			return SQLITE_IOERR_FSYNC;
+	}
+	m_dirtyBegin = INT64_MAX;
+	m_dirtyEnd = 0;
+#ifdef F_FULLFSYNC
+	if ((flags & 0x0F) == SQLITE_SYNC_FULL && !::fcntl(m_fd, F_FULLFSYNC, 0)) {
+		m_bSizeChanged = false;
+		return SQLITE_OK;
+	}
+#endif
+	if (m_bSizeChanged) {
+#if defined(__APPLE__)
+		if (::fsync(m_fd))
+#else
+		if (::fdatasync(m_fd))						// the new size; msync doesn't cover metadata everywhere
+#endif
+			return SQLITE_IOERR_FSYNC;
+		m_bSizeChanged = false;
+	}
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::LockFd(int& lockLevel, int level) {
+	if (lockLevel >= level)
+		return SQLITE_OK;
+	int rc;
+	switch (level) {
+	case SHARED_LOCK:
+		if ((rc = MMappedLock(m_fd, F_RDLCK, PENDING_BYTE, 1)) != SQLITE_OK)	// no new readers while a writer waits for EXCLUSIVE
+			return rc;
+		rc = MMappedLock(m_fd, F_RDLCK, SHARED_FIRST, SHARED_SIZE);
+		MMappedLock(m_fd, F_UNLCK, PENDING_BYTE, 1);
+		if (rc == SQLITE_OK)
+			lockLevel = SHARED_LOCK;
+		return rc;
+	case RESERVED_LOCK:
+		if ((rc = MMappedLock(m_fd, F_WRLCK, RESERVED_BYTE, 1)) == SQLITE_OK)
+			lockLevel = RESERVED_LOCK;
+		return rc;
+	default:
+		if (lockLevel < PENDING_LOCK) {
+			if ((rc = MMappedLock(m_fd, F_WRLCK, PENDING_BYTE, 1)) != SQLITE_OK)
+				return rc;
+			lockLevel = PENDING_LOCK;
+		}
+		if (level == EXCLUSIVE_LOCK && (rc = MMappedLock(m_fd, F_WRLCK, SHARED_FIRST, SHARED_SIZE)) != SQLITE_OK)
+			return rc;
+		lockLevel = level;
+		return SQLITE_OK;
+	}
+}
+
+int CSqliteMappedFile::UnlockFd(int& lockLevel, int level) {
+	if (lockLevel <= level)
+		return SQLITE_OK;
+	if (level == SHARED_LOCK && lockLevel == EXCLUSIVE_LOCK && MMappedLock(m_fd, F_RDLCK, SHARED_FIRST, SHARED_SIZE) != SQLITE_OK)
+		return SQLITE_IOERR_RDLOCK;
+	if (lockLevel > SHARED_LOCK && MMappedLock(m_fd, F_UNLCK, PENDING_BYTE, 2) != SQLITE_OK)		// PENDING and RESERVED
+		return SQLITE_IOERR_UNLOCK;
+	if (level == NO_LOCK && MMappedLock(m_fd, F_UNLCK, SHARED_FIRST, SHARED_SIZE) != SQLITE_OK)
+		return SQLITE_IOERR_UNLOCK;
+	lockLevel = level;
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::Lock(int level) {
+	if (m_lockLevel >= level)
+		return SQLITE_OK;
+	int rc;
+#ifdef F_OFD_SETLK
+	rc = LockFd(m_lockLevel, level);
+#else
+	EXT_LOCK (s_mtxInodes) {
+		MMappedInode& inode = *m_inode;
+		if (m_lockLevel != inode.LockLevel && (inode.LockLevel >= PENDING_LOCK || level > SHARED_LOCK))	// another connection of the process writes or is about to
+			rc = SQLITE_BUSY;
+		else if (level == SHARED_LOCK && inode.LockLevel >= SHARED_LOCK)		// the process already holds it
+			rc = SQLITE_OK;
+		else {
+			if ((rc = LockFd(inode.LockLevel, level == EXCLUSIVE_LOCK && inode.Shared > 1 ? PENDING_LOCK : level)) == SQLITE_OK && inode.LockLevel < level)
+				rc = SQLITE_BUSY;													// EXCLUSIVE waits for the other readers of the process, PENDING keeps new ones out
+			if (level > SHARED_LOCK)
+				m_lockLevel = inode.LockLevel;
+		}
+		if (level == SHARED_LOCK && rc == SQLITE_OK) {
+			m_lockLevel = SHARED_LOCK;
+			++inode.Shared;
+		}
+	}
+#endif
+	if (level == SHARED_LOCK && rc == SQLITE_OK && (rc = RefreshSize()) != SQLITE_OK)
+		Unlock(NO_LOCK);
+	return rc;
+}
+
+int CSqliteMappedFile::Unlock(int level) {
+	if (m_lockLevel <= level)
+		return SQLITE_OK;
+#ifdef F_OFD_SETLK
+	return UnlockFd(m_lockLevel, level);
+#else
+	int rc = SQLITE_OK;
+	EXT_LOCK (s_mtxInodes) {
+		MMappedInode& inode = *m_inode;
+		if (m_lockLevel > SHARED_LOCK)						// the process-level lock above SHARED is ours
+			rc = UnlockFd(inode.LockLevel, SHARED_LOCK);
+		if (level == NO_LOCK && !--inode.Shared) {
+			int rcUnlock = UnlockFd(inode.LockLevel, NO_LOCK);
+			rc = rc != SQLITE_OK ? rc : rcUnlock;
+			for (size_t i = 0; i < inode.PendingClose.size(); ++i)
+				::close(inode.PendingClose[i]);
+			inode.PendingClose.clear();
+		}
+		m_lockLevel = level;
+	}
+	return rc;
+#endif
+}
+
+int CSqliteMappedFile::CheckReservedLock(int& bLocked) {
+	int level = m_lockLevel;
+#ifndef F_OFD_SETLK
+	EXT_LOCK (s_mtxInodes) {
+		level = m_inode->LockLevel;				// of any connection of the process; F_GETLK doesn't report the process' own locks
+	}
+#endif
+	if (level >= RESERVED_LOCK) {
+		bLocked = 1;
+		return SQLITE_OK;
+	}
+	struct flock fl;
+	memset(&fl, 0, sizeof fl);
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = RESERVED_BYTE;
+	fl.l_len = 1;
+	if (::fcntl(m_fd, MMAPPED_GETLK, &fl))
+		return SQLITE_IOERR_CHECKRESERVEDLOCK;
+	bLocked = fl.l_type != F_UNLCK;
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::FileControl(int op, void *pArg) {
+	switch (op) {
+	case SQLITE_FCNTL_LOCKSTATE:
+		*(int*)pArg = m_lockLevel;
+		return SQLITE_OK;
+	case SQLITE_FCNTL_SIZE_HINT:
+		return m_bReadOnly ? SQLITE_OK : Grow(*(sqlite3_int64*)pArg);
+	case MMappedSqliteVfs::FCNTL_ADVISE:
+		switch (*(MMapAdvice*)pArg) {
+		case MMapAdvice::Normal:		m_advice = POSIX_MADV_NORMAL; break;
+		case MMapAdvice::Random:		m_advice = POSIX_MADV_RANDOM; break;
+		case MMapAdvice::Sequential:	m_advice = POSIX_MADV_SEQUENTIAL; break;
+		case MMapAdvice::WillNeed:													// one-shot readahead of the current file, not kept for remaps
+			return m_base && m_fileSize && ::posix_madvise(m_base, size_t(m_fileSize), POSIX_MADV_WILLNEED) ? SQLITE_IOERR : SQLITE_OK;
+		default:
+			return SQLITE_MISUSE;
+		}
+		return m_base && ::posix_madvise(m_base, m_reserved, m_advice) ? SQLITE_IOERR : SQLITE_OK;
+	}
+	return SQLITE_NOTFOUND;
+}
+
+int CSqliteMappedFile::ShmOpen() {
+#ifndef F_OFD_SETLK
+	return SQLITE_IOERR_SHMOPEN;			// the -shm locks would need the same per-inode arbitration; no WAL without OFD locks
+#else
+	struct stat st;
+	if (::fstat(m_fd, &st))
+		return SQLITE_IOERR_FSTAT;
+	if ((m_fdShm = ::open(FilePath + "-shm", O_RDWR | O_CREAT | O_CLOEXEC, st.st_mode & 0777)) < 0)
+		return SQLITE_CANTOPEN;
+	if (MMappedLock(m_fdShm, F_WRLCK, SHM_DMS, 1) == SQLITE_OK && ::ftruncate(m_fdShm, 0)) {			// the only user: start from an empty wal-index
+		::close(exchange(m_fdShm, -1));
+		return SQLITE_IOERR_SHMOPEN;
+	}
+	if (int rc = MMappedLock(m_fdShm, F_RDLCK, SHM_DMS, 1, true)) {									// held while mapped
+		::close(exchange(m_fdShm, -1));
+		return rc;
+	}
+	return SQLITE_OK;
+#endif
+}
+
+int CSqliteMappedFile::ShmMap(int iRegion, int szRegion, bool bExtend, void volatile **pp) {
+	*pp = 0;
+	if (m_fdShm < 0) {
+		if (int rc = ShmOpen())
+			return rc;
+		m_shmRegionSize = szRegion;
+	}
+	if (size_t(iRegion) >= m_shmRegions.size()) {
+		int64_t size = int64_t(iRegion + 1) * szRegion;
+		struct stat st;
+		if (::fstat(m_fdShm, &st))
+			return SQLITE_IOERR_SHMSIZE;
+		if (st.st_size < size) {
+			if (!bExtend)
+				return SQLITE_OK;
+			if (::ftruncate(m_fdShm, size))
+				return SQLITE_IOERR_SHMSIZE;
+		}
+		while (m_shmRegions.size() <= size_t(iRegion)) {
+			void *p = ::mmap(0, szRegion, PROT_READ | PROT_WRITE, MAP_SHARED, m_fdShm, off_t(m_shmRegions.size()) * szRegion);
+			if (p == MAP_FAILED)
+				return SQLITE_IOERR_SHMMAP;
+			m_shmRegions.push_back(p);
+		}
+	}
+	*pp = m_shmRegions[iRegion];
+	return SQLITE_OK;
+}
+
+int CSqliteMappedFile::ShmLock(int offset, int n, int flags) {
+	short type = flags & SQLITE_SHM_UNLOCK ? F_UNLCK : flags & SQLITE_SHM_SHARED ? F_RDLCK : F_WRLCK;
+	int rc = MMappedLock(m_fdShm, type, SHM_BASE + offset, n);
+	return rc == SQLITE_IOERR_LOCK ? SQLITE_IOERR_SHMLOCK : rc;
+}
+
+void CSqliteMappedFile::ShmBarrier() {
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+int CSqliteMappedFile::ShmUnmap(bool bDelete) {
+	if (m_fdShm < 0)
+		return SQLITE_OK;
+	for (size_t i = 0; i < m_shmRegions.size(); ++i)
+		::munmap(m_shmRegions[i], m_shmRegionSize);
+	m_shmRegions.clear();
+	if (bDelete && MMappedLock(m_fdShm, F_WRLCK, SHM_DMS, 1) == SQLITE_OK)		// nobody else has it mapped
+		::unlink(FilePath + "-shm");
+	::close(exchange(m_fdShm, -1));
+	return SQLITE_OK;
+}
+
+#endif // UCFG_WIN32
+
+static int MMapped_Close(sqlite3_file *file) {
+	int rc = ((CSqliteMappedFile*)file)->Close();
+	((CSqliteMappedFile*)file)->~CSqliteMappedFile();
+	return rc;
+}
+
+static int MMapped_Read(sqlite3_file *file, void *data, int iAmt, sqlite3_int64 iOfst) {
+	return ((CSqliteMappedFile*)file)->Read(data, iAmt, iOfst);
+}
+
+static int MMapped_Write(sqlite3_file *file, const void *data, int iAmt, sqlite3_int64 iOfst) {
+	return ((CSqliteMappedFile*)file)->Write(data, iAmt, iOfst);
+}
+
+static int MMapped_Truncate(sqlite3_file *file, sqlite3_int64 size) {
+	return ((CSqliteMappedFile*)file)->Truncate(size);
+}
+
+static int MMapped_Sync(sqlite3_file *file, int flags) {
+	return ((CSqliteMappedFile*)file)->Sync(flags);
+}
+
+static int MMapped_FileSize(sqlite3_file *file, sqlite3_int64 *pSize) {
+	return ((CSqliteMappedFile*)file)->GetFileSize(*pSize);
+}
+
+static int MMapped_Lock(sqlite3_file *file, int level) {
+	return ((CSqliteMappedFile*)file)->Lock(level);
+}
+
+static int MMapped_Unlock(sqlite3_file *file, int level) {
+	return ((CSqliteMappedFile*)file)->Unlock(level);
+}
+
+static int MMapped_CheckReservedLock(sqlite3_file *file, int *pResOut) {
+	return ((CSqliteMappedFile*)file)->CheckReservedLock(*pResOut);
+}
+
+static int MMapped_FileControl(sqlite3_file *file, int op, void *pArg) {
+	return ((CSqliteMappedFile*)file)->FileControl(op, pArg);
+}
+
+static int MMapped_SectorSize(sqlite3_file *file) {
+	return 4096;
+}
+
+static int MMapped_DeviceCharacteristics(sqlite3_file *file) {
+	return SQLITE_IOCAP_UNDELETABLE_WHEN_OPEN | SQLITE_IOCAP_ATOMIC512 | SQLITE_IOCAP_ATOMIC1K | SQLITE_IOCAP_ATOMIC2K | SQLITE_IOCAP_ATOMIC4K;		// no SAFE_APPEND: the file grows with a zero tail
+}
+
+static int MMapped_ShmMap(sqlite3_file *file, int iPg, int pgsz, int bExtend, void volatile **pp) {
+	return ((CSqliteMappedFile*)file)->ShmMap(iPg, pgsz, bExtend, pp);
+}
+
+static int MMapped_ShmLock(sqlite3_file *file, int offset, int n, int flags) {
+	return ((CSqliteMappedFile*)file)->ShmLock(offset, n, flags);
+}
+
+static void MMapped_ShmBarrier(sqlite3_file *file) {
+	((CSqliteMappedFile*)file)->ShmBarrier();
+}
+
+static int MMapped_ShmUnmap(sqlite3_file *file, int deleteFlag) {
+	return ((CSqliteMappedFile*)file)->ShmUnmap(deleteFlag);
+}
+
+static sqlite3_io_methods s_mmappedMethods = {
+	2,
+	&MMapped_Close,
+	&MMapped_Read,
+	&MMapped_Write,
+	&MMapped_Truncate,
+	&MMapped_Sync,
+	&MMapped_FileSize,
+	&MMapped_Lock,
+	&MMapped_Unlock,
+	&MMapped_CheckReservedLock,
+	&MMapped_FileControl,
+	&MMapped_SectorSize,
+	&MMapped_DeviceCharacteristics,
+	&MMapped_ShmMap,
+	&MMapped_ShmLock,
+	&MMapped_ShmBarrier,
+	&MMapped_ShmUnmap
+};
+
+static int MMapped_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int flags, int *pOutFlags) {
+	CSqliteMappedFile *mf = new(file) CSqliteMappedFile;
+	int rc = mf->Open(zName, flags, pOutFlags);
+	if (SQLITE_OK == rc) {
+		file->pMethods = &s_mmappedMethods;
+	} else {
+		mf->Close();
+		mf->~CSqliteMappedFile();
+		file->pMethods = 0;
+	}
+	return rc;
+}
+
 MMappedSqliteVfs::MMappedSqliteVfs() {
 	m_pimpl->szOsFile = sizeof(CSqliteMappedFile);
 	m_pimpl->xOpen = &MMapped_xOpen;
 
 }
 
+bool MMappedSqliteVfs::Advise(SqliteConnection& con, MMapAdvice advice, const char *dbName) {
+	int rc = ::sqlite3_file_control(con, dbName, FCNTL_ADVISE, &advice);
+	return rc != SQLITE_NOTFOUND && SqliteCheck(con, rc) == SQLITE_OK;
+}
+
 #endif // UCFG_USE_SQLITE==3
 }}} // namespace Ext::DB::sqlite_(NS)::
-
-
@@ -0,0 +1,262 @@
+/*######   Copyright (c) 1997-2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+namespace Ext {
+
+static const uint32_t
+	CRC32_POLY = 0xEDB88320,		// reflected polynomials
+	CRC32C_POLY = 0x82F63B78;
+
+// All Update() functions work on the inverted register, the public API does the pre/post inversion
+struct CrcTables {
+	uint32_t Slice[16][256];	// Slice[k][i]: CRC of byte i followed by k zero bytes
+	uint32_t X2n[32];			// x^(2^n) mod P(x)
+	uint32_t Poly;
+
+	CrcTables(uint32_t poly);
+
+	// a*b mod P(x), in the reflected bit order
+	uint32_t MultModP(uint32_t a, uint32_t b) const {
+		uint32_t p = 0;
+		for (uint32_t m = 1U << 31; ; m >>= 1) {
+			if (a & m) {
+				p ^= b;
+				if (!(a & (m - 1)))
+					break;
+			}
+			b = (b >> 1) ^ (Poly & ~((b & 1) - 1));
+		}
+		return p;
+	}
+
+	// x^(n * 2^k) mod P(x)
+	uint32_t X2nModP(uint64_t n, int k) const {
+		uint32_t p = 1U << 31;					// x^0
+		for (; n; n >>= 1, ++k)
+			if (n & 1)
+				p = MultModP(X2n[k & 31], p);
+		return p;
+	}
+
+	// Register after feeding n zero bytes
+	uint32_t Shift(uint32_t crc, uint64_t n) const {
+		return MultModP(X2nModP(n, 3), crc);
+	}
+
+	uint32_t Update(uint32_t crc, const uint8_t *p, size_t size) const;
+};
+
+CrcTables::CrcTables(uint32_t poly)
+	: Poly(poly)
+{
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t r = i;
+		for (int j = 0; j < 8; ++j)
+			r = (r >> 1) ^ (poly & ~((r & 1) - 1));
+		Slice[0][i] = r;
+	}
+	for (int k = 1; k < 16; ++k)
+		for (int i = 0; i < 256; ++i)
+			Slice[k][i] = (Slice[k - 1][i] >> 8) ^ Slice[0][Slice[k - 1][i] & 0xFF];
+	uint32_t p = 1U << 30;						// x^1
+	X2n[0] = p;
+	for (int n = 1; n < 32; ++n)
+		X2n[n] = p = MultModP(p, p);
+}
+
+// Slice-by-16: 16 independent table lookups per 16 bytes instead of a serial chain of byte steps
+uint32_t CrcTables::Update(uint32_t crc, const uint8_t *p, size_t size) const {
+	const uint32_t (*t)[256] = Slice;
+	for (; size >= 16; p += 16, size -= 16) {
+		uint32_t a = GetLeUInt32(p) ^ crc,
+			b = GetLeUInt32(p + 4),
+			c = GetLeUInt32(p + 8),
+			d = GetLeUInt32(p + 12);
+		crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24]
+			^ t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24]
+			^ t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24]
+			^ t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+	}
+	for (; size; --size)
+		crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+static const CrcTables& Crc32Tables() {
+	static const CrcTables s_tables(CRC32_POLY);
+	return s_tables;
+}
+
+static const CrcTables& Crc32cTables() {
+	static const CrcTables s_tables(CRC32C_POLY);
+	return s_tables;
+}
+
+#if UCFG_CPU_X86_X64
+
+static bool s_bHasPclmul = CpuInfo().Features.PCLMULQDQ && CpuInfo().Features.SSE41,
+	s_bHasCrc32c = CpuInfo().Features.SSE42;
+
+static CpuDispatch::Registration
+	s_regCrc32("CRC-32", s_bHasPclmul ? "pclmulqdq" : "slice-by-16"),
+	s_regCrc32c("CRC-32C", s_bHasCrc32c ? "sse4.2" : "slice-by-16");
+
+// PCLMULQDQ folding of CRC-32 (Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction").
+// size >= 64 and multiple of 16
+static uint32_t Crc32Pclmul(uint32_t crc, const uint8_t *p, size_t size) {
+	static const DECLSPEC_ALIGN(16) uint64_t
+		k1k2[2] = { 0x0154442BD4, 0x01C6E41596 },		// x^(4*128+32), x^(4*128-32) mod P
+		k3k4[2] = { 0x01751997D0, 0x00CCAA009E },		// x^(128+32), x^(128-32) mod P
+		k5k0[2] = { 0x0163CD6124, 0 },					// x^64 mod P
+		poly[2] = { 0x01DB710641, 0x01F7011641 };		// P', Barrett mu
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i*)(p + 16));
+	x3 = _mm_loadu_si128((const __m128i*)(p + 32));
+	x4 = _mm_loadu_si128((const __m128i*)(p + 48));
+	p += 64;
+	size -= 64;
+
+	x0 = _mm_load_si128((const __m128i*)k1k2);
+	for (; size >= 64; p += 64, size -= 64) {				// 4 independent folds per 64 bytes
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)p));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 48)));
+	}
+
+	x0 = _mm_load_si128((const __m128i*)k3k4);				// fold 4x128 -> 128
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x4), x5);
+
+	for (; size >= 16; p += 16, size -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), _mm_loadu_si128((const __m128i*)p)), x5);
+	}
+
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);				// fold 128 -> 64
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x00), x2);
+
+	x0 = _mm_load_si128((const __m128i*)poly);				// Barrett reduction 64 -> 32
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, x3), x0, 0x00);
+	return _mm_extract_epi32(_mm_xor_si128(x1, x2), 1);
+}
+
+static __forceinline uint32_t Crc32cHwRun(uint32_t crc, const uint8_t *p, size_t n8) {
+#if UCFG_64
+	uint64_t c = crc;
+	for (size_t i = 0; i < n8; ++i)
+		c = _mm_crc32_u64(c, GetLeUInt64(p + i * 8));
+	return uint32_t(c);
+#else
+	for (size_t i = 0; i < n8 * 2; ++i)
+		crc = _mm_crc32_u32(crc, GetLeUInt32(p + i * 4));
+	return crc;
+#endif
+}
+
+static const size_t CRC32C_STRIPE = 4096;		// bytes per stream in the 3-way interleave
+
+// crc32 has 3-cycle latency and 1-cycle throughput: run 3 independent streams over adjacent stripes and merge them by shifting
+static uint32_t Crc32cHw(uint32_t crc, const uint8_t *p, size_t size) {
+	if (size >= CRC32C_STRIPE * 3) {
+		static const uint32_t
+			shift1 = Crc32cTables().X2nModP(CRC32C_STRIPE, 3),
+			shift2 = Crc32cTables().X2nModP(CRC32C_STRIPE * 2, 3);
+		const CrcTables& tables = Crc32cTables();
+		for (; size >= CRC32C_STRIPE * 3; p += CRC32C_STRIPE * 3, size -= CRC32C_STRIPE * 3) {
+#if UCFG_64
+			uint64_t a = crc, b = 0, c = 0;
+			for (size_t i = 0; i < CRC32C_STRIPE; i += 8) {
+				a = _mm_crc32_u64(a, GetLeUInt64(p + i));
+				b = _mm_crc32_u64(b, GetLeUInt64(p + CRC32C_STRIPE + i));
+				c = _mm_crc32_u64(c, GetLeUInt64(p + CRC32C_STRIPE * 2 + i));
+			}
+#else
+			uint32_t a = crc, b = 0, c = 0;
+			for (size_t i = 0; i < CRC32C_STRIPE; i += 4) {
+				a = _mm_crc32_u32(a, GetLeUInt32(p + i));
+				b = _mm_crc32_u32(b, GetLeUInt32(p + CRC32C_STRIPE + i));
+				c = _mm_crc32_u32(c, GetLeUInt32(p + CRC32C_STRIPE * 2 + i));
+			}
+#endif
+			crc = tables.MultModP(shift2, uint32_t(a)) ^ tables.MultModP(shift1, uint32_t(b)) ^ uint32_t(c);
+		}
+	}
+	crc = Crc32cHwRun(crc, p, size / 8);
+	p += size & ~size_t(7);
+	for (size &= 7; size; --size)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+#endif // UCFG_CPU_X86_X64
+
+uint32_t Crc32Update(uint32_t crc, RCSpan s) {
+	const uint8_t *p = s.data();
+	size_t size = s.size();
+	crc = ~crc;
+#if UCFG_CPU_X86_X64
+	if (s_bHasPclmul && size >= 64) {
+		size_t n = size & ~size_t(15);
+		crc = Crc32Pclmul(crc, p, n);
+		p += n;
+		size -= n;
+	}
+#endif
+	return ~Crc32Tables().Update(crc, p, size);
+}
+
+uint32_t Crc32cUpdate(uint32_t crc, RCSpan s) {
+#if UCFG_CPU_X86_X64
+	if (s_bHasCrc32c)
+		return ~Crc32cHw(~crc, s.data(), s.size());
+#endif
+	return ~Crc32cTables().Update(~crc, s.data(), s.size());
+}
+
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+	return Crc32Tables().Shift(crc1, len2) ^ crc2;
+}
+
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+	return Crc32cTables().Shift(crc1, len2) ^ crc2;
+}
+
+hashval Crc32::ComputeHash(RCSpan s) {
+	uint32_t val = Update(0, s);
+	return hashval((const uint8_t*)&val, sizeof val);
+}
+
+hashval Crc32::ComputeHash(Stream& stm) {
+	DECLSPEC_ALIGN(16) uint8_t buf[16384];
+	uint32_t val = 0;
+	for (size_t cb; (cb = stm.Read(buf, sizeof buf));)
+		val = Update(val, Span(buf, cb));
+	return hashval((const uint8_t*)&val, sizeof val);
+}
+
+} // Ext::
@@ -411,6 +411,7 @@ int CConApp::Main(int argc, argv_char_t *argv[]) {
 		if (!CTrace::GetOStream())
 			CTrace::SetOStream(new CIosStream(clog));
 		CTrace::s_nLevel = atoi(slevel);
+		CpuDispatch::Trace();
 	}
 
 #if UCFG_USE_POSIX
@@ -689,5 +689,6 @@ public:
 
 unsigned int MurmurHashAligned2(RCSpan cbuf, uint32_t seed);
 uint32_t MurmurHash3_32(RCSpan cbuf, uint32_t seed);
+void MurmurHash3_128(RCSpan cbuf, uint32_t seed, uint64_t r[2]);		// MurmurHash3_x64_128
 
 } // namespace Ext
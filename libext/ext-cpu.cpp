@@ -10,12 +10,111 @@ using namespace std;
 
 #if UCFG_CPU_X86_X64
 
+static const char * const s_cpuTierNames[] = { "generic", "sse2", "ssse3", "sse4", "avx", "avx2", "avx512" };
+
+const char *CpuInfo::TierName(CpuTier tier) {
+	return s_cpuTierNames[(int)tier];
+}
+
+bool CpuInfo::TryParseTier(const char *s, CpuTier& tier) {
+	for (size_t i = 0; i < _countof(s_cpuTierNames); ++i)
+		if (!strcmp(s, s_cpuTierNames[i])) {
+			tier = (CpuTier)i;
+			return true;
+		}
+	return false;
+}
+
+static uint64_t XGetBv0() {
+#	ifdef _MSC_VER
+	return _xgetbv(0);
+#	else
+	uint32_t lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return lo | (uint64_t(hi) << 32);
+#	endif
+}
+
 CpuInfo::FeatureInfo::FeatureInfo() {
 	ZeroStruct(_self);
 	auto maxFun = Cpuid(0).EAX;
 	IdInfo1 = Cpuid(1);
 	if (maxFun >= 7)
 		IdInfo7 = Cpuid(7);
+	UpdateTier();
+
+	if (AVX) {
+		uint64_t xcr0 = OXSAVE ? XGetBv0() : 0;
+		if ((xcr0 & 6) != 6)								// XMM|YMM
+			LimitTier(CpuTier::SSE4);
+		else if ((xcr0 & 0xE6) != 0xE6)						// + opmask|ZMM_Hi256|Hi16_ZMM
+			LimitTier(CpuTier::AVX2);
+	}
+
+	CpuTier tier;
+	if (const char *s = getenv("UCFG_CPU_TIER"))
+		if (TryParseTier(s, tier))
+			LimitTier(tier);
+	if (const char *s = getenv("UCFG_CPU_DISABLE")) {
+		string names = s;
+		for (size_t beg = 0, end; beg < names.size(); beg = end + 1) {
+			if ((end = names.find(',', beg)) == string::npos)
+				end = names.size();
+			DisableFeature(names.substr(beg, end - beg).c_str());
+		}
+	}
+}
+
+void CpuInfo::FeatureInfo::UpdateTier() {
+	Tier = AVX512F ? CpuTier::AVX512
+		: AVX2 ? CpuTier::AVX2
+		: AVX ? CpuTier::AVX
+		: SSE41 && SSE42 ? CpuTier::SSE4
+		: SSSE3 ? CpuTier::SSSE3
+		: SSE2 ? CpuTier::SSE2
+		: CpuTier::Generic;
+}
+
+void CpuInfo::FeatureInfo::LimitTier(CpuTier tier) {
+	if (tier < CpuTier::AVX512)
+		AVX512F = AVX512DQ = AVX512IFMA = AVX512PF = AVX512ER = AVX512CD = AVX512BW = AVX512VL = AVX512VBMI = AVX512VBMI2 = AVX512VNNI = AVX512BITALG
+			= VAES = VPCLMULQDQ = false;
+	if (tier < CpuTier::AVX2)
+		AVX2 = false;
+	if (tier < CpuTier::AVX)
+		AVX = FMA = F16C = false;
+	if (tier < CpuTier::SSE4)
+		SSE41 = SSE42 = false;
+	if (tier < CpuTier::SSSE3)
+		SSE3 = SSSE3 = false;
+	if (tier < CpuTier::SSE2)
+		SSE = SSE2 = AES = PCLMULQDQ = SHA = GFNI = false;
+	UpdateTier();
+}
+
+bool CpuInfo::FeatureInfo::DisableFeature(const char *name) {
+	CpuTier tier;
+	if (TryParseTier(name, tier)) {
+		if (tier != CpuTier::Generic)
+			LimitTier(CpuTier((int)tier - 1));
+	} else if (!strcmp(name, "aes"))
+		AES = VAES = false;
+	else if (!strcmp(name, "pclmulqdq"))
+		PCLMULQDQ = VPCLMULQDQ = false;
+	else if (!strcmp(name, "sha"))
+		SHA = false;
+	else if (!strcmp(name, "bmi2"))
+		BMI2 = false;
+	else if (!strcmp(name, "vaes"))
+		VAES = false;
+	else if (!strcmp(name, "vpclmulqdq"))
+		VPCLMULQDQ = false;
+	else if (!strcmp(name, "sse4.2"))
+		SSE42 = false;
+	else
+		return false;
+	UpdateTier();
+	return true;
 }
 
 const CpuInfo::FeatureInfo& CpuInfo::get_Features() {
@@ -49,4 +148,44 @@ bool CpuInfo::get_ConstantTsc() {
 
 #endif // UCFG_CPU_X86_X64
 
+struct CpuDispatchRegistry {
+	mutex Mtx;
+	map<String, String> Kernels;
+	bool Traced;
+
+	CpuDispatchRegistry()
+		: Traced(false)
+	{}
+};
+
+static CpuDispatchRegistry& GetCpuDispatchRegistry() {		// registrations come from static initializers of other modules
+	static CpuDispatchRegistry s_registry;
+	return s_registry;
+}
+
+void CpuDispatch::Register(const char *primitive, const char *kernel) {
+	CpuDispatchRegistry& r = GetCpuDispatchRegistry();
+	lock_guard<mutex> lk(r.Mtx);
+	r.Kernels[primitive] = kernel;
+	if (r.Traced)
+		TRC(2, primitive << ": " << kernel);
+}
+
+vector<pair<String, String>> CpuDispatch::Kernels() {
+	CpuDispatchRegistry& r = GetCpuDispatchRegistry();
+	lock_guard<mutex> lk(r.Mtx);
+	return vector<pair<String, String>>(r.Kernels.begin(), r.Kernels.end());
+}
+
+void CpuDispatch::Trace() {
+#if UCFG_CPU_X86_X64
+	TRC(2, "CPU tier: " << CpuInfo::TierName(CpuInfo().Features.Tier));
+#endif
+	CpuDispatchRegistry& r = GetCpuDispatchRegistry();
+	lock_guard<mutex> lk(r.Mtx);
+	for (auto& kv : r.Kernels)
+		TRC(2, kv.first << ": " << kv.second);
+	r.Traced = true;
+}
+
 } // Ext::
@@ -7,6 +7,17 @@
 
 namespace Ext {
 
+// Levels of the vector ISA, each implies the preceding ones. AES-NI, PCLMULQDQ, SHA-NI and BMI are orthogonal flags
+ENUM_CLASS(CpuTier) {
+	Generic,
+	SSE2,
+	SSSE3,
+	SSE4,
+	AVX,
+	AVX2,
+	AVX512
+} END_ENUM_CLASS(CpuTier);
+
 struct CpuVendor {
 	char Name[13];
 
@@ -135,13 +146,39 @@ public:
 					SHA : 1,
 					AVX512BW : 1,
 					AVX512VL : 1;
-				int : 32;
+
+				bool PREFETCHWT1 : 1,
+					AVX512VBMI : 1,
+					: 4,
+					AVX512VBMI2 : 1,
+					: 1,
+					GFNI : 1,
+					VAES : 1,
+					VPCLMULQDQ : 1,
+					AVX512VNNI : 1,
+					AVX512BITALG : 1,
+					: 3,
+					: 8,
+					: 8;
 
 				int : 32;
 			};
 		};
+
+		CpuTier Tier;
+
+		// Features are cleared when the OS doesn't save YMM/ZMM state, and by the environment, to test lower tiers on a capable CPU:
+		//	UCFG_CPU_TIER=sse2|ssse3|...|avx512		highest tier to use
+		//	UCFG_CPU_DISABLE=aes,sha,avx2,...		comma-separated features; a tier name disables that tier and above
+		void LimitTier(CpuTier tier);
+		bool DisableFeature(const char *name);
+	private:
+		void UpdateTier();
 	};
 
+	static const char *TierName(CpuTier tier);
+	static bool TryParseTier(const char *s, CpuTier& tier);
+
 	struct SFamilyModelStepping {
 		int Family, Model, Stepping;
 	};
@@ -1126,7 +1126,8 @@ void HashAlgorithm::PrepareEndiannessAndHashBlock(void* dst, uint8_t src[256], u
 
 template <typename W>
 hashval ComputeHashImp(HashAlgorithm& algo, void *hash, Stream& stm, uint64_t processedLen) {
-	const size_t dataSize = HashAlgorithm::WordCount * sizeof(W);
+	const size_t dataSize = HashAlgorithm::WordCount * sizeof(W),
+		cbLen = algo.IsBlockCounted ? 8 : sizeof(W) * 2;					// length field: 64 bits, 128 for the 64-bit word algorithms
 	DECLSPEC_ALIGN(32) W buf[64];									// input data & scratchbuffer
 	uint64_t counter;
 	bool bLast = false;
@@ -1143,7 +1144,7 @@ hashval ComputeHashImp(HashAlgorithm& algo, void *hash, Stream& stm, uint64_t pr
 		}
 		processedLen += cb;
 		counter = processedLen << 3;
-		if (bLast && (processedLen & (dataSize - 1)) < dataSize - int(bool(algo.IsHaifa)) - 8) {
+		if (bLast && (processedLen & (dataSize - 1)) + 1 + cbLen <= dataSize) {		// 0x80 and the length fit; HAIFA's final bit shares the byte before the length
 			if (!(processedLen & (dataSize - 1)))
 				counter = 0;
 			break;
@@ -1151,7 +1152,7 @@ hashval ComputeHashImp(HashAlgorithm& algo, void *hash, Stream& stm, uint64_t pr
 		algo.PrepareEndiannessAndHashBlock(hash, (uint8_t*)buf, counter);
 	}
 	if (algo.IsHaifa)
-		((uint8_t*)buf)[dataSize - sizeof(W) * 2 - 1] = 1;
+		((uint8_t*)buf)[dataSize - cbLen - 1] |= 1;
 	processedLen = algo.IsBlockCounted ? (processedLen + 8 + dataSize) / dataSize
 		: processedLen << 3;
 	*(uint64_t*)((uint8_t*)buf + dataSize - 8) = algo.IsLenBigEndian ? htobe(processedLen) : htole(processedLen);
@@ -1185,6 +1186,50 @@ hashval HashAlgorithm::Finalize(void *hash, Stream& stm, uint64_t processedLen)
 		: ComputeHashImp<uint32_t>(_self, hash, stm, processedLen);
 }
 
+HashContext::HashContext(HashAlgorithm& algo)
+	: m_algo(&algo)
+{
+	Reset();
+}
+
+void HashContext::Reset() {
+	m_algo->InitHash(m_hash);
+	m_processedLen = 0;
+	m_cbBuf = 0;
+}
+
+void HashContext::HashBlock(const uint8_t *p) {
+	DECLSPEC_ALIGN(32) uint64_t buf[64];							// HashBlock() uses the input as scratch buffer
+	size_t blockSize = BlockSize();
+	memcpy(buf, p, blockSize);
+	m_processedLen += blockSize;
+	m_algo->PrepareEndiannessAndHashBlock(m_hash, (uint8_t*)buf, m_processedLen << 3);
+}
+
+HashContext& HashContext::Update(RCSpan s) {
+	const uint8_t *p = s.data();
+	size_t size = s.size(), blockSize = BlockSize();
+	if (m_cbBuf) {
+		size_t cb = (min)(size, blockSize - m_cbBuf);
+		memcpy(m_buf + m_cbBuf, p, cb);
+		p += cb;
+		size -= cb;
+		if ((m_cbBuf += cb) < blockSize)
+			return _self;
+		HashBlock(m_buf);
+		m_cbBuf = 0;
+	}
+	for (; size >= blockSize; p += blockSize, size -= blockSize)
+		HashBlock(p);
+	memcpy(m_buf, p, m_cbBuf = size);
+	return _self;
+}
+
+hashval HashContext::Final() const {
+	HashContext ctx = _self;
+	CMemReadStream stm(Span(m_buf, m_cbBuf));
+	return m_algo->Finalize(ctx.m_hash, stm, m_processedLen);
+}
 
 // RFC 2104
 hashval HMAC(HashAlgorithm& halgo, RCSpan key, RCSpan text) {
@@ -1207,28 +1252,63 @@ hashval HMAC(HashAlgorithm& halgo, RCSpan key, RCSpan text) {
 }
 
 
-static uint32_t s_crcTable[256];
-
-static bool Crc32GenerateTable() {
-	uint32_t poly = 0xEDB88320;
-	for (uint32_t i = 0; i < 256; i++) {
-		uint32_t r = i;
-		for (int j = 0; j < 8; j++)
-			r = (r >> 1) ^ (poly & ~((r & 1) - 1));
-		s_crcTable[i] = r;
+HmacContext::HmacContext(HashAlgorithm& algo, RCSpan key)
+	: m_inner(algo)
+	, m_outer(algo)
+{
+	if (algo.IsHaifa || algo.IsBlockCounted)
+		Throw(E_NOTIMPL);
+	Span k = key;
+	hashval hk;
+	size_t blockSize = m_inner.BlockSize();
+	if (key.size() > blockSize) {
+		hk = algo.ComputeHash(key);
+		k = Span(hk);
+	}
+	uint8_t ipad[128], opad[128];
+	for (size_t i = 0; i < blockSize; ++i) {
+		ipad[i] = i < k.size() ? k[i] ^ 0x36 : 0x36;
+		opad[i] = i < k.size() ? k[i] ^ 0x5C : 0x5C;
+	}
+	m_inner.Update(Span(ipad, blockSize));
+	m_outer.Update(Span(opad, blockSize));
+}
+
+hashval HmacContext::Compute(RCSpan text) const {
+	HashContext inner = m_inner;
+	hashval hv = inner.Update(text).Final();
+	HashContext outer = m_outer;
+	return outer.Update(hv).Final();
+}
+
+void HmacContext::Iterate(uint8_t *u, uint8_t *acc, uint32_t n) const {
+	HashAlgorithm& algo = *m_inner.m_algo;
+	size_t blockSize = m_inner.BlockSize(), hashSize = algo.HashSize;
+	uint64_t counter = uint64_t(blockSize + hashSize) << 3;
+	DECLSPEC_ALIGN(32) uint8_t tmpl[128];				// single padded block of the HashSize-byte message following ipad/opad
+	memset(tmpl, 0, blockSize);
+	tmpl[hashSize] = 0x80;
+	*(uint64_t*)(tmpl + blockSize - 8) = algo.IsLenBigEndian ? htobe(counter) : htole(counter);
+	DECLSPEC_ALIGN(32) uint64_t buf[64];				// HashBlock() uses the input as scratch buffer
+	DECLSPEC_ALIGN(32) uint64_t h[16];
+	for (uint32_t i = 0; i < n; ++i) {
+		memcpy(buf, tmpl, blockSize);
+		memcpy(buf, u, hashSize);
+		memcpy(h, m_inner.m_hash, sizeof h);
+		algo.PrepareEndiannessAndHashBlock(h, (uint8_t*)buf, counter);
+		algo.OutTransform(h);
+		algo.PrepareEndianness(h, 8);
+
+		memcpy(buf, tmpl, blockSize);
+		memcpy(buf, h, hashSize);
+		memcpy(h, m_outer.m_hash, sizeof h);
+		algo.PrepareEndiannessAndHashBlock(h, (uint8_t*)buf, counter);
+		algo.OutTransform(h);
+		algo.PrepareEndianness(h, 8);
+		memcpy(u, h, hashSize);
+		for (size_t j = 0; j < hashSize; ++j)
+			acc[j] ^= u[j];
 	}
-	return true;
-}
-
-hashval Crc32::ComputeHash(Stream& stm) {
-	static once_flag once;
-	call_once(once, &Crc32GenerateTable);
-
-	uint32_t val = 0xFFFFFFFF;
-	for (int v; (v=stm.ReadByte())!=-1;)
-		val = s_crcTable[(val ^ v) & 0xFF] ^ (val >> 8);
-	val = ~val;
-	return hashval((const uint8_t*)&val, sizeof val);
 }
 
 CMessageProcessor g_messageProcessor;
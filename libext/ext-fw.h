@@ -1229,16 +1229,104 @@ public:
 	virtual void PrepareEndiannessAndHashBlock(void* dst, uint8_t src[256], uint64_t counter) noexcept;
 	virtual void OutTransform(void *dst) noexcept {}
 protected:
-	hashval Finalize(void *hash, Stream& stm, uint64_t processedLen);
+	virtual hashval Finalize(void *hash, Stream& stm, uint64_t processedLen);
+
+	friend class HashContext;
+};
+
+// Incremental hashing: Update() may be called for each piece of the message, copies of the context fork the midstate
+class HashContext {
+	typedef HashContext class_type;
+	HashAlgorithm *m_algo;
+#if UCFG_CPU_X86_X64
+	__m128i m_hash[8];
+#else
+	uint64_t m_hash[16];
+#endif
+	DECLSPEC_ALIGN(32) uint8_t m_buf[128];		// pending partial block
+	uint64_t m_processedLen;					// bytes already compressed into m_hash
+	size_t m_cbBuf;
+public:
+	HashContext(HashAlgorithm& algo);
+	void Reset();
+	HashContext& Update(RCSpan s);
+	hashval Final() const;						// doesn't change the context, so Update() may continue
+
+	uint64_t get_Length() const { return m_processedLen + m_cbBuf; }
+	DEFPROP_GET(uint64_t, Length);
+private:
+	size_t BlockSize() const { return m_algo->Is64Bit ? 128 : 64; }	// HashAlgorithm::WordCount words
+	void HashBlock(const uint8_t *p);
+
+	friend class HmacContext;
 };
 
 hashval HMAC(HashAlgorithm& halgo, RCSpan key, RCSpan text);
 
+// RFC 2104 with the ipad/opad midstates computed once per key. Only for the Merkle-Damgard algorithms implementing InitHash()/HashBlock()
+class HmacContext {
+	HashContext m_inner, m_outer;
+public:
+	HmacContext(HashAlgorithm& algo, RCSpan key);
+	hashval Compute(RCSpan text) const;
+	void Iterate(uint8_t *u, uint8_t *acc, uint32_t n) const;		// n times: u = HMAC(key, u), acc ^= u; 2 compressions per step
+};
+
+// Kernels chosen from CpuInfo().Features, one per primitive, so the code path of a process can be traced and the tiers A/B tested
+// with UCFG_CPU_TIER / UCFG_CPU_DISABLE (see CpuInfo::FeatureInfo) without rebuilding
+class CpuDispatch {
+public:
+	template <typename F>
+	struct Kernel {
+		const char *Name;
+		bool Supported;
+		F Fn;
+	};
+
+	// The first supported kernel wins, so list them from the fastest down to the portable one
+	template <typename F>
+	static F Select(const char *primitive, std::initializer_list<Kernel<F>> kernels) {
+		for (const Kernel<F>& k : kernels)
+			if (k.Supported) {
+				Register(primitive, k.Name);
+				return k.Fn;
+			}
+		Register(primitive, "none");
+		return F();
+	}
+
+	// For the code dispatching by flags rather than by a function pointer
+	struct Registration {
+		Registration(const char *primitive, const char *kernel) { Register(primitive, kernel); }
+	};
+
+	static void Register(const char *primitive, const char *kernel);
+	static vector<pair<String, String>> Kernels();		// sorted by primitive
+	static void Trace();								// tier and kernels at trace level 2, then each later registration
+};
+
+// zlib-style running CRCs: pass 0 for the first piece, then the result of the preceding one
+uint32_t Crc32Update(uint32_t crc, RCSpan s);						// CRC-32 (IEEE 802.3, gzip)
+uint32_t Crc32cUpdate(uint32_t crc, RCSpan s);						// CRC-32C (Castagnoli)
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, uint64_t len2);		// CRC of A+B from CRC(A), CRC(B) and the length of B
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
 class Crc32 : public HashAlgorithm {
 	typedef HashAlgorithm base;
 public:
-	using base::ComputeHash;
+	Crc32() {
+		HashSize = 4;
+	}
+
 	hashval ComputeHash(Stream& stm) override;
+	hashval ComputeHash(RCSpan s) override;
+protected:
+	virtual uint32_t Update(uint32_t crc, RCSpan s) { return Crc32Update(crc, s); }
+};
+
+class Crc32c : public Crc32 {
+protected:
+	uint32_t Update(uint32_t crc, RCSpan s) override { return Crc32cUpdate(crc, s); }
 };
 
 extern EXT_DATA std::mutex g_mfcCS;
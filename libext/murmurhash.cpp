@@ -161,4 +161,64 @@ uint32_t MurmurHash3_32(RCSpan cbuf, uint32_t seed) {
 	return fmix32(h1 ^ len);
 }
 
+__forceinline uint64_t fmix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+void MurmurHash3_128(RCSpan cbuf, uint32_t seed, uint64_t r[2]) {
+	const uint8_t *data = cbuf.data();
+	size_t len = cbuf.size(),
+		nblocks = len / 16;
+	uint64_t h1 = seed, h2 = seed;
+	const uint64_t c1 = 0x87c37b91114253d5ULL,
+		c2 = 0x4cf5ad432745937fULL;
+
+	for (size_t i = 0; i < nblocks; i++) {
+		uint64_t k1 = GetLeUInt64(data + i*16),
+			k2 = GetLeUInt64(data + i*16 + 8);
+		k1 *= c1; k1 = _rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = _rotl64(h1, 27); h1 += h2; h1 = h1*5+0x52dce729;
+		k2 *= c2; k2 = _rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = _rotl64(h2, 31); h2 += h1; h2 = h2*5+0x38495ab5;
+	}
+
+	const uint8_t *tail = data + nblocks*16;
+	uint64_t k1 = 0, k2 = 0;
+	switch(len & 15) {
+	case 15: k2 ^= uint64_t(tail[14]) << 48;
+	case 14: k2 ^= uint64_t(tail[13]) << 40;
+	case 13: k2 ^= uint64_t(tail[12]) << 32;
+	case 12: k2 ^= uint64_t(tail[11]) << 24;
+	case 11: k2 ^= uint64_t(tail[10]) << 16;
+	case 10: k2 ^= uint64_t(tail[9]) << 8;
+	case 9: k2 ^= uint64_t(tail[8]);
+		k2 *= c2; k2 = _rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	case 8: k1 ^= uint64_t(tail[7]) << 56;
+	case 7: k1 ^= uint64_t(tail[6]) << 48;
+	case 6: k1 ^= uint64_t(tail[5]) << 40;
+	case 5: k1 ^= uint64_t(tail[4]) << 32;
+	case 4: k1 ^= uint64_t(tail[3]) << 24;
+	case 3: k1 ^= uint64_t(tail[2]) << 16;
+	case 2: k1 ^= uint64_t(tail[1]) << 8;
+	case 1: k1 ^= uint64_t(tail[0]);
+		k1 *= c1; k1 = _rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	r[0] = h1;
+	r[1] = h2;
+}
+
 } // Ext::